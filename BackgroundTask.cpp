@@ -23,7 +23,7 @@ const char* BackgroundTask::CancelledException::what() const noexcept {
 }
 
 void BackgroundTask::throwIfCancelled() const {
-  if (isCancelled()) {
+  if (isCancelledOrPreempted()) {
     throw CancelledException();
   }
 }
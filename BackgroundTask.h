@@ -45,13 +45,55 @@ class BackgroundTask : public AbstractCommand<FilterResultPtr>, public TaskStatu
   bool isCancelled() const override { return m_cancelFlag.load() != 0; }
 
   /**
-   * \brief If cancelled, throws CancelledException.
+   * \brief Makes the task stop as if it was cancelled, but with the intention
+   *        of running it again later.
+   *
+   * Unlike cancellation, preemption is undone by clearPreemption().
+   * A preempted task that manages to complete anyway delivers its result
+   * as usual.
+   */
+  void preempt() {
+    m_preemptFlag.store(1);
+    m_wasPreemptedFlag.store(1);
+  }
+
+  /**
+   * \return true if the task was preempted but not cancelled.
+   */
+  bool isPreempted() const { return (m_preemptFlag.load() != 0) && (m_cancelFlag.load() == 0); }
+
+  void clearPreemption() { m_preemptFlag.store(0); }
+
+  /**
+   * \return true if the task was ever preempted, even if that was undone
+   *         by clearPreemption().
+   */
+  bool wasPreempted() const { return m_wasPreemptedFlag.load() != 0; }
+
+  /**
+   * \return true if the task is to stop processing, either for good or
+   *         to be restarted later.
+   */
+  bool isCancelledOrPreempted() const { return (m_cancelFlag.load() != 0) || (m_preemptFlag.load() != 0); }
+
+  /**
+   * \brief If cancelled or preempted, throws CancelledException.
    */
   void throwIfCancelled() const override;
 
+  /**
+   * \brief Estimated peak memory usage of the task in bytes, or 0 if unknown.
+   */
+  qint64 memoryFootprint() const { return m_memoryFootprint; }
+
+  void setMemoryFootprint(qint64 bytes) { m_memoryFootprint = bytes; }
+
  private:
   QAtomicInt m_cancelFlag;
+  QAtomicInt m_preemptFlag;
+  QAtomicInt m_wasPreemptedFlag;
   const Type m_type;
+  qint64 m_memoryFootprint = 0;
 };
 
 
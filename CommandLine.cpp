@@ -18,12 +18,15 @@
  */
 
 #include <tiff.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
+#include <tuple>
 
 #include <QDir>
 #include <QMap>
+#include <QThread>
 
 #include "CommandLine.h"
 #include "Dpi.h"
@@ -115,6 +118,24 @@ bool CommandLine::parseCli(const QStringList& argv) {
   opts << "tiff-force-rgb";
   opts << "tiff-force-grayscale";
   opts << "tiff-force-keep-color-space";
+  opts << "threads";
+  opts << "single-pass";
+  opts << "shard";
+  opts << "merge-projects";
+  opts << "checkpoint-every";
+  opts << "resume";
+  opts << "tiff-profile";
+  opts << "tiff-compression-bw";
+  opts << "tiff-compression-color";
+  opts << "tiff-compression-level";
+  opts << "tiff-predictor";
+  opts << "benchmark-tiff-codecs";
+  opts << "output-format";
+  opts << "jpeg-quality";
+  opts << "jpeg-subsampling";
+  opts << "output-container";
+  opts << "extract-output-container";
+  opts << "pdf";
 
   QMap<QString, QString> shortMap;
   shortMap["h"] = "help";
@@ -164,6 +185,7 @@ bool CommandLine::parseCli(const QStringList& argv) {
     } else if (rx_project.exactMatch(argv[i])) {
       // project file
       CommandLine::m_projectFile = argv[i];
+      CommandLine::m_projectFiles << argv[i];
     } else {
       // handle input images and output directory
       QFileInfo file(argv[i]);
@@ -245,6 +267,11 @@ void CommandLine::setup() {
   m_pageDetectionBox = fetchPageDetectionBox();
   m_pageDetectionTolerance = fetchPageDetectionTolerance();
   m_defaultNull = fetchDefaultNull();
+  m_threads = fetchThreads();
+  std::tie(m_shardIndex, m_shardCount) = fetchShard();
+  m_checkpointEvery = fetchCheckpointEvery();
+  m_tiffCodecOptions = fetchTiffCodecOptions();
+  m_jpegOutputOptions = fetchJpegOutputOptions();
 
   QRegExp exp(".*(tif|tiff|jpg|jpeg|bmp|gif|png|pbm|pgm|ppm|xbm|xpm)$", Qt::CaseInsensitive);
   for (auto& m_file : m_files) {
@@ -367,10 +394,51 @@ void CommandLine::printHelp() {
   std::cout << "\t--tiff-force-rgb\t\t\t-- all output tiffs will be rgb" << std::endl;
   std::cout << "\t--tiff-force-grayscale\t\t\t-- all output tiffs will be grayscale" << std::endl;
   std::cout << "\t--tiff-force-keep-color-space\t\t-- output tiffs will be in original color space" << std::endl;
+  std::cout << "\t--tiff-profile=<default|fast>\t\t-- fast: ZSTD (or Deflate) at the lowest level with the predictor"
+            << std::endl;
+  std::cout << "\t\t--tiff-compression-bw=<none|lzw|deflate|zstd|g4>\t-- default: g4" << std::endl;
+  std::cout << "\t\t--tiff-compression-color=<none|lzw|deflate|zstd|jpeg>\t-- default: lzw" << std::endl;
+  std::cout << "\t\t--tiff-compression-level=<0...22>\t-- deflate: 1...9, zstd: 1...22; default: 0 (codec's own)"
+            << std::endl;
+  std::cout << "\t\t--tiff-predictor=<true|false>\t\t-- default: true; for 8-bit gray and rgb images" << std::endl;
+  std::cout << "\t--output-format=<tiff|jpeg>\t\t-- default: tiff; jpeg applies to color, grayscale and mixed pages"
+            << std::endl;
+  std::cout << "\t\t--jpeg-quality=<1...100>\t\t-- default: 90" << std::endl;
+  std::cout << "\t\t--jpeg-subsampling=<444|422|420>\t-- default: 420" << std::endl;
+  std::cout << "\t--output-container\t\t\t-- append the output pages to a single file in the output directory "
+               "instead of writing a file per page"
+            << std::endl;
+  std::cout << "\t--extract-output-container\t\t-- write the pages of the output directory's container into files "
+               "of their own there, instead of processing"
+            << std::endl;
+  std::cout << "\t--pdf=<file>\t\t\t-- also write the output pages into a PDF file, passing G4 and JPEG data "
+               "through as they are"
+            << std::endl;
+  std::cout << "\t--benchmark-tiff-codecs\t\t\t-- report the encoding time and size per codec for the given images, "
+               "or the ones in the output directory, instead of processing them"
+            << std::endl;
   std::cout << "\t--window-title=WindowTitle\t\t-- default: project name" << std::endl;
   std::cout << "\t--page-detection-box=<widthxheight>\t\t-- in mm" << std::endl;
   std::cout << "\t\t--page-detection-tolerance=<0.0..1.0>\t-- default: 0.1" << std::endl;
-  std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6";
+  std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6"
+            << std::endl;
+  std::cout << "\t--threads=<0|1...>\t\t\t-- default: 1; number of pages processed in parallel, 0 means "
+               "one per CPU core"
+            << std::endl;
+  std::cout << "\t--single-pass\t\t\t\t-- run all filters on a page after loading it once, instead of one filter "
+               "at a time; page layout is settled between an analysis and a render pass"
+            << std::endl;
+  std::cout << "\t--shard=<i/N>\t\t\t\t-- process only every N-th image, starting with the i-th one (0 <= i < N), "
+               "so that a project may be processed by N processes at once; not with --output-container"
+            << std::endl;
+  std::cout << "\t--merge-projects\t\t\t-- merge the projects saved by the shards, given in the shard order, "
+               "into --output-project"
+            << std::endl;
+  std::cout << "\t--checkpoint-every=<1...>\t\t-- save --output-project every N processed pages "
+               "and after every filter"
+            << std::endl;
+  std::cout << "\t--resume\t\t\t\t-- continue from --output-project if it exists, skipping the pages "
+               "already output";
   std::cout << std::endl;
 }  // CommandLine::printHelp
 
@@ -779,3 +847,168 @@ bool CommandLine::fetchDefaultNull() {
 
   return m_defaultNull;
 }
+
+int CommandLine::fetchThreads() const {
+  if (!hasThreads()) {
+    return 1;
+  }
+
+  const int threads = m_options["threads"].toInt();
+  if (threads <= 0) {
+    return std::max(1, QThread::idealThreadCount());
+  }
+
+  return threads;
+}
+
+std::pair<int, int> CommandLine::fetchShard() const {
+  if (!hasShard()) {
+    return {0, 1};
+  }
+  if (hasOutputContainer()) {
+    // The shards would all append to the same container.
+    std::cout << "--shard can't be used with --output-container" << std::endl;
+    exit(1);
+  }
+
+  QRegExp rx(R"((\d+)/(\d+))");
+  if (rx.exactMatch(m_options["shard"])) {
+    const int index = rx.cap(1).toInt();
+    const int count = rx.cap(2).toInt();
+    if ((count > 0) && (index < count)) {
+      return {index, count};
+    }
+  }
+
+  std::cout << "invalid --shard=" << m_options["shard"].toLatin1().constData() << std::endl;
+  exit(1);
+}
+
+int CommandLine::fetchCheckpointEvery() const {
+  if (!hasCheckpointEvery()) {
+    return 0;
+  }
+
+  bool ok = false;
+  const int pages = m_options["checkpoint-every"].toInt(&ok);
+  if (!ok || (pages <= 0)) {
+    std::cout << "invalid --checkpoint-every=" << m_options["checkpoint-every"].toLatin1().constData() << std::endl;
+    exit(1);
+  }
+
+  return pages;
+}
+
+TiffCodecOptions CommandLine::fetchTiffCodecOptions() const {
+  if (!hasTiffCodecOptions()) {
+    return TiffCodecOptions();
+  }
+
+  TiffCodecOptions options(TiffCodecOptions::fromSettings());
+  if (contains("tiff-profile")) {
+    const QString profile = m_options["tiff-profile"].toLower();
+    if (profile == "fast") {
+      options = TiffCodecOptions::fastProfile();
+    } else if (profile == "default") {
+      options = TiffCodecOptions();
+    } else {
+      std::cout << "invalid --tiff-profile=" << m_options["tiff-profile"].toLatin1().constData() << std::endl;
+      exit(1);
+    }
+  }
+
+  if (contains("tiff-compression-bw")) {
+    options.setBwCompression(fetchTiffCompression("tiff-compression-bw"));
+  }
+  if (contains("tiff-compression-color")) {
+    options.setColorCompression(fetchTiffCompression("tiff-compression-color"));
+  }
+  if (contains("tiff-compression-level")) {
+    bool ok = false;
+    const int level = m_options["tiff-compression-level"].toInt(&ok);
+    if (!ok || (level < 0)) {
+      std::cout << "invalid --tiff-compression-level=" << m_options["tiff-compression-level"].toLatin1().constData()
+                << std::endl;
+      exit(1);
+    }
+    options.setLevel(level);
+  }
+  if (contains("tiff-predictor")) {
+    options.setPredictor(m_options["tiff-predictor"].toLower() != "false");
+  }
+
+  return options;
+}  // CommandLine::fetchTiffCodecOptions
+
+uint16 CommandLine::fetchTiffCompression(const QString& key) const {
+  const QString name = m_options[key].toLower();
+  const bool bw = (key == "tiff-compression-bw");
+
+  uint16 compression = COMPRESSION_NONE;
+  if (name == "none") {
+    compression = COMPRESSION_NONE;
+  } else if (name == "lzw") {
+    compression = COMPRESSION_LZW;
+  } else if (name == "deflate") {
+    compression = COMPRESSION_DEFLATE;
+#ifdef COMPRESSION_ZSTD
+  } else if (name == "zstd") {
+    compression = COMPRESSION_ZSTD;
+#endif
+  } else if (bw && (name == "g4")) {
+    compression = COMPRESSION_CCITTFAX4;
+  } else if (!bw && (name == "jpeg")) {
+    compression = COMPRESSION_JPEG;
+  } else {
+    std::cout << "invalid --" << key.toStdString() << "=" << m_options[key].toLatin1().constData() << std::endl;
+    exit(1);
+  }
+
+  if (!TiffCodecOptions::isCodecSupported(compression)) {
+    std::cout << "--" << key.toStdString() << "=" << name.toStdString() << " isn't supported by libtiff"
+              << std::endl;
+    exit(1);
+  }
+
+  return compression;
+}
+
+JpegOutputOptions CommandLine::fetchJpegOutputOptions() const {
+  if (!hasJpegOutputOptions()) {
+    return JpegOutputOptions();
+  }
+
+  JpegOutputOptions options(JpegOutputOptions::fromSettings());
+  if (contains("output-format")) {
+    const QString format = m_options["output-format"].toLower();
+    if ((format != "tiff") && (format != "jpeg")) {
+      std::cout << "invalid --output-format=" << m_options["output-format"].toLatin1().constData() << std::endl;
+      exit(1);
+    }
+    options.setEnabled(format == "jpeg");
+  }
+  if (contains("jpeg-quality")) {
+    bool ok = false;
+    const int quality = m_options["jpeg-quality"].toInt(&ok);
+    if (!ok || (quality < 1) || (quality > 100)) {
+      std::cout << "invalid --jpeg-quality=" << m_options["jpeg-quality"].toLatin1().constData() << std::endl;
+      exit(1);
+    }
+    options.setQuality(quality);
+  }
+  if (contains("jpeg-subsampling")) {
+    const QString subsampling = m_options["jpeg-subsampling"];
+    if (subsampling == "444") {
+      options.setSubsampling(JpegWriter::SUBSAMPLING_444);
+    } else if (subsampling == "422") {
+      options.setSubsampling(JpegWriter::SUBSAMPLING_422);
+    } else if (subsampling == "420") {
+      options.setSubsampling(JpegWriter::SUBSAMPLING_420);
+    } else {
+      std::cout << "invalid --jpeg-subsampling=" << subsampling.toLatin1().constData() << std::endl;
+      exit(1);
+    }
+  }
+
+  return options;
+}  // CommandLine::fetchJpegOutputOptions
@@ -30,7 +30,9 @@
 #include "Despeckle.h"
 #include "Dpi.h"
 #include "ImageFileInfo.h"
+#include "JpegOutputOptions.h"
 #include "Margins.h"
+#include "TiffCodecOptions.h"
 #include "filters/output/ColorParams.h"
 #include "filters/output/DepthPerception.h"
 #include "filters/output/DespeckleLevel.h"
@@ -75,6 +77,8 @@ class CommandLine {
 
   const QString& projectFile() const { return m_projectFile; }
 
+  const QStringList& projectFiles() const { return m_projectFiles; }
+
   const QString& outputProjectFile() const { return m_outputProjectFile; }
 
   bool isContentDetectionEnabled() const { return !contains("disable-content-detection"); }
@@ -169,6 +173,37 @@ class CommandLine {
 
   bool hasDisableCheckOutput() const { return contains("disable-check-output"); }
 
+  bool hasThreads() const { return contains("threads") && !m_options["threads"].isEmpty(); }
+
+  bool isSinglePassEnabled() const { return contains("single-pass"); }
+
+  bool hasShard() const { return contains("shard") && !m_options["shard"].isEmpty(); }
+
+  bool isMergeProjects() const { return contains("merge-projects"); }
+
+  bool hasCheckpointEvery() const { return contains("checkpoint-every") && !m_options["checkpoint-every"].isEmpty(); }
+
+  bool isResume() const { return contains("resume"); }
+
+  bool hasTiffCodecOptions() const {
+    return contains("tiff-profile") || contains("tiff-compression-bw") || contains("tiff-compression-color")
+           || contains("tiff-compression-level") || contains("tiff-predictor");
+  }
+
+  bool isBenchmarkTiffCodecs() const { return contains("benchmark-tiff-codecs"); }
+
+  bool hasOutputContainer() const { return contains("output-container"); }
+
+  bool isExtractOutputContainer() const { return contains("extract-output-container"); }
+
+  bool hasPdf() const { return contains("pdf") && !m_options["pdf"].isEmpty(); }
+
+  QString pdfFile() const { return m_options["pdf"]; }
+
+  bool hasJpegOutputOptions() const {
+    return contains("output-format") || contains("jpeg-quality") || contains("jpeg-subsampling");
+  }
+
   page_split::LayoutType getLayout() const { return m_layoutType; }
 
   Qt::LayoutDirection getLayoutDirection() const { return m_layoutDirection; }
@@ -229,6 +264,18 @@ class CommandLine {
 
   double getPageDetectionTolerance() const { return m_pageDetectionTolerance; }
 
+  int getThreads() const { return m_threads; }
+
+  int getShardIndex() const { return m_shardIndex; }
+
+  int getShardCount() const { return m_shardCount; }
+
+  int getCheckpointEvery() const { return m_checkpointEvery; }
+
+  const TiffCodecOptions& getTiffCodecOptions() const { return m_tiffCodecOptions; }
+
+  const JpegOutputOptions& getJpegOutputOptions() const { return m_jpegOutputOptions; }
+
   bool getDefaultNull() const { return m_defaultNull; }
 
   bool help() { return m_options.contains("help"); }
@@ -256,6 +303,7 @@ class CommandLine {
 
   QMap<QString, QString> m_options;
   QString m_projectFile;
+  QStringList m_projectFiles;
   QString m_outputProjectFile;
   std::vector<QFileInfo> m_files;
   std::vector<ImageFileInfo> m_images;
@@ -287,6 +335,12 @@ class CommandLine {
   double m_despeckleLevel{2.0};
   output::DepthPerception m_depthPerception;
   float m_matchLayoutTolerance{0.2f};
+  int m_threads{1};
+  int m_shardIndex{0};
+  int m_shardCount{1};
+  int m_checkpointEvery{0};
+  TiffCodecOptions m_tiffCodecOptions;
+  JpegOutputOptions m_jpegOutputOptions;
 
   bool parseCli(const QStringList& argv);
 
@@ -350,6 +404,18 @@ class CommandLine {
 
   double fetchPageDetectionTolerance() const;
 
+  int fetchThreads() const;
+
+  std::pair<int, int> fetchShard() const;
+
+  int fetchCheckpointEvery() const;
+
+  TiffCodecOptions fetchTiffCodecOptions() const;
+
+  uint16 fetchTiffCompression(const QString& key) const;
+
+  JpegOutputOptions fetchJpegOutputOptions() const;
+
   bool fetchDefaultNull();
 };
 
@@ -18,21 +18,36 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
 #include <cassert>
+#include <functional>
 #include <iostream>
+#include <unordered_map>
 #include <vector>
 
+#include "AtomicFileOverwriter.h"
 #include "FileNameDisambiguator.h"
+#include "ImageLoader.h"
+#include "ImagePrefetcher.h"
 #include "LoadFileTask.h"
+#include "NonCopyable.h"
+#include "OutputContainer.h"
 #include "OutputFileNameGenerator.h"
 #include "PageSelectionAccessor.h"
 #include "PageSequence.h"
+#include "PdfWriter.h"
 #include "ProcessingTaskQueue.h"
 #include "ProjectPages.h"
 #include "ProjectReader.h"
 #include "ProjectWriter.h"
 #include "StageSequence.h"
 #include "Utils.h"
+#include "filter_dc/OutputUpToDateCollector.h"
 
 #include "filters/deskew/CacheDrivenTask.h"
 #include "filters/deskew/Task.h"
@@ -42,6 +57,7 @@
 #include "filters/output/CacheDrivenTask.h"
 #include "filters/output/Settings.h"
 #include "filters/output/Task.h"
+#include "filters/output/Utils.h"
 #include "filters/page_layout/CacheDrivenTask.h"
 #include "filters/page_layout/Task.h"
 #include "filters/page_split/CacheDrivenTask.h"
@@ -52,6 +68,213 @@
 
 #include "ConsoleBatch.h"
 
+/**
+ * Moves the elements of \p shard_el referring to the images and pages of \p shard
+ * into \p merged_el, replacing the ones \p merged_el has for them.  Elements
+ * that don't refer to an image or page, like per-project settings, are merged
+ * recursively, as they may contain per-page ones.
+ */
+static void mergeShardSettings(QDomElement& merged_el,
+                               const QDomElement& shard_el,
+                               const int shard,
+                               const std::unordered_map<int, int>& shard_by_numeric_id) {
+  const auto shardOf = [&](const QDomElement& el) {
+    bool ok = false;
+    const int numeric_id = el.attribute("id").toInt(&ok);
+    if (!ok) {
+      return -1;
+    }
+    const auto it(shard_by_numeric_id.find(numeric_id));
+    return (it != shard_by_numeric_id.end()) ? it->second : -1;
+  };
+
+  for (QDomElement el(merged_el.firstChildElement()); !el.isNull();) {
+    const QDomElement next(el.nextSiblingElement());
+    if (shardOf(el) == shard) {
+      merged_el.removeChild(el);
+    } else if (!el.hasAttribute("id")) {
+      QDomElement shard_child(shard_el.firstChildElement(el.tagName()));
+      if (!shard_child.isNull()) {
+        mergeShardSettings(el, shard_child, shard, shard_by_numeric_id);
+      }
+    }
+    el = next;
+  }
+
+  for (QDomElement el(shard_el.firstChildElement()); !el.isNull(); el = el.nextSiblingElement()) {
+    if (shardOf(el) == shard) {
+      merged_el.appendChild(el.cloneNode(true));
+    }
+  }
+}
+
+/**
+ * \return The contents of an output file, which may be stored in the container
+ *         of its directory, or a null array if there is no such file.
+ */
+static QByteArray readOutputFile(const QString& file_path) {
+  QFile file(file_path);
+  if (file.open(QIODevice::ReadOnly)) {
+    return file.readAll();
+  }
+
+  return OutputContainer::readFile(file_path);
+}
+
+/**
+ * \brief Executes composite tasks of a single filter pass, possibly in parallel.
+ *
+ * With a single thread, tasks are executed right away on the calling thread,
+ * which is how batch processing has always worked.  Otherwise they are pushed
+ * to a thread pool and waitForDone() acts as a barrier between filter passes,
+ * as setupFilter() and updateStatistics() expect all pages of the previous
+ * pass to be done.
+ */
+class ConsoleBatch::TaskRunner {
+  DECLARE_NON_COPYABLE(TaskRunner)
+
+ public:
+  /**
+   * \param task_done Called after each task that completed without failing,
+   *        on the thread that executed it.
+   */
+  TaskRunner(int num_threads, std::function<void()> task_done);
+
+  void submit(const BackgroundTaskPtr& task);
+
+  /**
+   * \brief Waits for all submitted tasks to finish.
+   *
+   * If any of them has failed, throws std::runtime_error describing
+   * the first failure.
+   */
+  void waitForDone();
+
+ private:
+  class Runnable;
+
+  void taskFailed(const char* what);
+
+  QThreadPool m_pool;
+  QMutex m_mutex;
+  std::string m_error;
+  const bool m_multiThreaded;
+  const std::function<void()> m_taskDone;
+};
+
+
+class ConsoleBatch::TaskRunner::Runnable : public QRunnable {
+ public:
+  Runnable(TaskRunner& owner, BackgroundTaskPtr task) : m_owner(owner), m_task(std::move(task)) {
+    setAutoDelete(true);
+  }
+
+  void run() override {
+    try {
+      (*m_task)();
+      m_owner.m_taskDone();
+    } catch (const std::bad_alloc&) {
+      m_owner.taskFailed("Out of memory");
+    } catch (const std::exception& e) {
+      m_owner.taskFailed(e.what());
+    }
+  }
+
+ private:
+  TaskRunner& m_owner;
+  BackgroundTaskPtr m_task;
+};
+
+
+ConsoleBatch::TaskRunner::TaskRunner(const int num_threads, std::function<void()> task_done)
+    : m_multiThreaded(num_threads > 1), m_taskDone(std::move(task_done)) {
+  m_pool.setMaxThreadCount(std::max(1, num_threads));
+}
+
+void ConsoleBatch::TaskRunner::submit(const BackgroundTaskPtr& task) {
+  if (!m_multiThreaded) {
+    (*task)();
+    m_taskDone();
+    return;
+  }
+
+  m_pool.start(new Runnable(*this, task));
+}
+
+void ConsoleBatch::TaskRunner::waitForDone() {
+  m_pool.waitForDone();
+
+  const QMutexLocker locker(&m_mutex);
+  if (!m_error.empty()) {
+    throw std::runtime_error(m_error);
+  }
+}
+
+void ConsoleBatch::TaskRunner::taskFailed(const char* what) {
+  const QMutexLocker locker(&m_mutex);
+  if (m_error.empty()) {
+    m_error = what;
+  }
+}
+
+/**
+ * \brief Loads an image once and runs the analysis filters on all of its pages.
+ *
+ * The page split filter is run on the image first, as it's the one
+ * that decides what pages the image consists of.
+ */
+class ConsoleBatch::ImageAnalysisTask : public BackgroundTask {
+ public:
+  ImageAnalysisTask(ConsoleBatch& owner, const PageInfo& image_page, int start_filter_idx, int last_filter_idx)
+      : BackgroundTask(BATCH),
+        m_owner(owner),
+        m_imagePage(image_page),
+        m_startFilterIdx(start_filter_idx),
+        m_lastFilterIdx(last_filter_idx) {}
+
+  FilterResultPtr operator()() override;
+
+ private:
+  ConsoleBatch& m_owner;
+  PageInfo m_imagePage;
+  int m_startFilterIdx;
+  int m_lastFilterIdx;
+};
+
+
+FilterResultPtr ConsoleBatch::ImageAnalysisTask::operator()() {
+  const CommandLine& cli = CommandLine::get();
+  const StageSequence& stages = *m_owner.m_stages;
+  const int page_split_idx = stages.pageSplitFilterIdx();
+
+  if (cli.isVerbose()) {
+    std::cout << "\tProcessing: " << m_imagePage.imageId().filePath().toLatin1().constData() << "\n";
+  }
+
+  QImage image(ImagePrefetcher::instance().take(m_imagePage.imageId()));
+  if (image.isNull()) {
+    image = ImageLoader::load(m_imagePage.imageId());
+  }
+  (*m_owner.createCompositeTask(m_imagePage, std::min(m_lastFilterIdx, page_split_idx), image))();
+  if (m_lastFilterIdx <= page_split_idx) {
+    return nullptr;
+  }
+
+  for (const PageInfo& page : m_owner.m_pages->pagesOf(m_imagePage.imageId())) {
+    const std::set<PageId> page_ids{page.id()};
+    for (int j = std::max(m_startFilterIdx, page_split_idx + 1); j <= m_lastFilterIdx; j++) {
+      if ((j == stages.pageLayoutFilterIdx()) && cli.hasMatchLayoutTolerance()) {
+        // Needs all the pages, so it's done after the pass.
+        continue;
+      }
+      m_owner.setupFilter(j, page_ids);
+    }
+    (*m_owner.createCompositeTask(page, m_lastFilterIdx, image))();
+  }
+
+  return nullptr;
+}
+
 ConsoleBatch::ConsoleBatch(const std::vector<ImageFileInfo>& images,
                            const QString& output_directory,
                            const Qt::LayoutDirection layout)
@@ -68,19 +291,7 @@ ConsoleBatch::ConsoleBatch(const std::vector<ImageFileInfo>& images,
 }
 
 ConsoleBatch::ConsoleBatch(const QString project_file) : batch(true), debug(true) {
-  QFile file(project_file);
-  if (!file.open(QIODevice::ReadOnly)) {
-    throw std::runtime_error("ConsoleBatch: Unable to open the project file.");
-  }
-
-  QDomDocument doc;
-  if (!doc.setContent(&file)) {
-    throw std::runtime_error("ConsoleBatch: The project file is broken.");
-  }
-
-  file.close();
-
-  m_reader = std::make_unique<ProjectReader>(doc);
+  m_reader = readProject(project_file);
   m_pages = m_reader->pages();
 
   const PageSelectionAccessor accessor(nullptr);  // Won't be used anyway.
@@ -100,7 +311,72 @@ ConsoleBatch::ConsoleBatch(const QString project_file) : batch(true), debug(true
   m_outFileNameGen = OutputFileNameGenerator(m_disambiguator, output_directory, m_pages->layoutDirection());
 }
 
-BackgroundTaskPtr ConsoleBatch::createCompositeTask(const PageInfo& page, const int last_filter_idx) {
+std::unique_ptr<ProjectReader> ConsoleBatch::readProject(const QString& project_file) {
+  QFile file(project_file);
+  if (!file.open(QIODevice::ReadOnly)) {
+    throw std::runtime_error("ConsoleBatch: Unable to open the project file.");
+  }
+
+  QDomDocument doc;
+  if (!doc.setContent(&file)) {
+    throw std::runtime_error("ConsoleBatch: The project file is broken.");
+  }
+
+  file.close();
+
+  return std::make_unique<ProjectReader>(doc);
+}
+
+std::unordered_set<ImageId> ConsoleBatch::shardImages(const ProjectPages& pages,
+                                                      const int shard_index,
+                                                      const int shard_count) {
+  std::unordered_set<ImageId> images;
+  int idx = 0;
+  for (const PageInfo& image_page : pages.toPageSequence(IMAGE_VIEW)) {
+    if (idx++ % shard_count == shard_index) {
+      images.insert(image_page.imageId());
+    }
+  }
+
+  return images;
+}
+
+PageSequence ConsoleBatch::toShardPageSequence(const PageView view) const {
+  const CommandLine& cli = CommandLine::get();
+  std::unordered_set<ImageId> images;
+  if (cli.hasShard()) {
+    images = shardImages(*m_pages, cli.getShardIndex(), cli.getShardCount());
+  }
+
+  const auto isUpToDate = [this, view](const PageInfo& page) {
+    if (view == PAGE_VIEW) {
+      return m_upToDatePages.find(page.id()) != m_upToDatePages.end();
+    }
+    for (const PageInfo& image_page : m_pages->pagesOf(page.imageId())) {
+      if (m_upToDatePages.find(image_page.id()) == m_upToDatePages.end()) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  PageSequence page_sequence;
+  for (const PageInfo& page : m_pages->toPageSequence(view)) {
+    if (cli.hasShard() && (images.find(page.imageId()) == images.end())) {
+      continue;
+    }
+    if (!m_upToDatePages.empty() && isUpToDate(page)) {
+      continue;
+    }
+    page_sequence.append(page);
+  }
+
+  return page_sequence;
+}
+
+BackgroundTaskPtr ConsoleBatch::createCompositeTask(const PageInfo& page,
+                                                   const int last_filter_idx,
+                                                   const QImage& preloaded_image) {
   intrusive_ptr<fix_orientation::Task> fix_orientation_task;
   intrusive_ptr<page_split::Task> page_split_task;
   intrusive_ptr<deskew::Task> deskew_task;
@@ -108,9 +384,9 @@ BackgroundTaskPtr ConsoleBatch::createCompositeTask(const PageInfo& page, const
   intrusive_ptr<page_layout::Task> page_layout_task;
   intrusive_ptr<output::Task> output_task;
 
-  if (batch) {
-    debug = false;
-  }
+  // This may be called for different pages concurrently, so we don't touch
+  // the debug member here.
+  bool debug = this->debug && !batch;
 
   if (last_filter_idx >= m_stages->outputFilterIdx()) {
     output_task = m_stages->outputFilter()->createTask(page.id(), m_thumbnailCache, m_outFileNameGen, batch, debug);
@@ -138,9 +414,44 @@ BackgroundTaskPtr ConsoleBatch::createCompositeTask(const PageInfo& page, const
   }
   assert(fix_orientation_task);
 
-  return make_intrusive<LoadFileTask>(BackgroundTask::BATCH, page, m_thumbnailCache, m_pages, fix_orientation_task);
+  return make_intrusive<LoadFileTask>(BackgroundTask::BATCH, page, m_thumbnailCache, m_pages, fix_orientation_task,
+                                      preloaded_image);
 }  // ConsoleBatch::createCompositeTask
 
+intrusive_ptr<CompositeCacheDrivenTask> ConsoleBatch::createCompositeCacheDrivenTask() {
+  const intrusive_ptr<output::CacheDrivenTask> output_task(
+      m_stages->outputFilter()->createCacheDrivenTask(m_outFileNameGen));
+  const intrusive_ptr<page_layout::CacheDrivenTask> page_layout_task(
+      m_stages->pageLayoutFilter()->createCacheDrivenTask(output_task));
+  const intrusive_ptr<select_content::CacheDrivenTask> select_content_task(
+      m_stages->selectContentFilter()->createCacheDrivenTask(page_layout_task));
+  const intrusive_ptr<deskew::CacheDrivenTask> deskew_task(
+      m_stages->deskewFilter()->createCacheDrivenTask(select_content_task));
+  const intrusive_ptr<page_split::CacheDrivenTask> page_split_task(
+      m_stages->pageSplitFilter()->createCacheDrivenTask(deskew_task));
+
+  return m_stages->fixOrientationFilter()->createCacheDrivenTask(page_split_task);
+}
+
+void ConsoleBatch::findUpToDatePages() {
+  const CommandLine& cli = CommandLine::get();
+  m_upToDatePages.clear();
+
+  const PageSequence page_sequence = toShardPageSequence(PAGE_VIEW);
+  const intrusive_ptr<CompositeCacheDrivenTask> task(createCompositeCacheDrivenTask());
+  for (const PageInfo& page : page_sequence) {
+    OutputUpToDateCollector collector;
+    task->process(page, &collector);
+    if (collector.isUpToDate()) {
+      m_upToDatePages.insert(page.id());
+    }
+  }
+
+  if (cli.isVerbose()) {
+    std::cout << "Up to date: " << m_upToDatePages.size() << " of " << page_sequence.numPages() << " pages\n";
+  }
+}
+
 // process the image vector **images** and save output to **output_dir**
 void ConsoleBatch::process() {
   const CommandLine& cli = CommandLine::get();
@@ -163,33 +474,149 @@ void ConsoleBatch::process() {
     endFilterIdx = ef;
   }
 
-  for (int j = startFilterIdx; j <= endFilterIdx; j++) {
-    if (cli.isVerbose()) {
-      std::cout << "Filter: " << (j + 1) << "\n";
-    }
+  m_upToDatePages.clear();
 
-    PageSequence page_sequence = m_pages->toPageSequence(PAGE_VIEW);
-    setupFilter(j, page_sequence.selectAll());
-    for (unsigned i = 0; i < page_sequence.numPages(); i++) {
-      PageInfo page = page_sequence.pageAt(i);
+  TaskRunner task_runner(cli.getThreads(), [this]() { taskDone(); });
+
+  if (cli.isSinglePassEnabled() && (startFilterIdx <= m_stages->pageLayoutFilterIdx())) {
+    processSinglePass(task_runner, startFilterIdx, endFilterIdx);
+  } else {
+    for (int j = startFilterIdx; j <= endFilterIdx; j++) {
       if (cli.isVerbose()) {
-        std::cout << "\tProcessing: " << page.imageId().filePath().toLatin1().constData() << "\n";
+        std::cout << "Filter: " << (j + 1) << "\n";
+      }
+
+      PageSequence page_sequence = toShardPageSequence(PAGE_VIEW);
+      setupFilter(j, page_sequence.selectAll());
+      if (j == m_stages->outputFilterIdx()) {
+        // The earlier passes are done, so the aggregate page size is final.
+        findUpToDatePages();
+        page_sequence = toShardPageSequence(PAGE_VIEW);
       }
-      BackgroundTaskPtr bgTask = createCompositeTask(page, j);
-      (*bgTask)();
+      prefetchImages(page_sequence);
+      for (unsigned i = 0; i < page_sequence.numPages(); i++) {
+        PageInfo page = page_sequence.pageAt(i);
+        if (cli.isVerbose()) {
+          std::cout << "\tProcessing: " << page.imageId().filePath().toLatin1().constData() << "\n";
+        }
+        BackgroundTaskPtr bgTask = createCompositeTask(page, j);
+        task_runner.submit(bgTask);
+      }
+      // The next filter has to see the results of this one for all pages.
+      task_runner.waitForDone();
+      checkpoint();
     }
   }
 
   for (int j = endFilterIdx + 1; j <= m_stages->count(); j++) {
-    PageSequence page_sequence = m_pages->toPageSequence(PAGE_VIEW);
+    PageSequence page_sequence = toShardPageSequence(PAGE_VIEW);
     setupFilter(j, page_sequence.selectAll());
   }
 
+  ImagePrefetcher::instance().clear();
+  // All the output pages are written by now.
+  OutputContainer::compactAllIfWorthIt();
+
   for (int j = 0; j <= endFilterIdx; j++) {
     m_stages->filterAt(j)->updateStatistics();
   }
 }  // ConsoleBatch::process
 
+void ConsoleBatch::processSinglePass(TaskRunner& task_runner, const int start_filter_idx, const int end_filter_idx) {
+  const CommandLine& cli = CommandLine::get();
+  const int analysis_end_idx = std::min(end_filter_idx, m_stages->pageLayoutFilterIdx());
+
+  if (cli.isVerbose()) {
+    std::cout << "Filters: " << (start_filter_idx + 1) << "-" << (analysis_end_idx + 1) << "\n";
+  }
+
+  // Until page split is done, there is a single page per image.
+  for (int j = start_filter_idx; j <= std::min(analysis_end_idx, m_stages->pageSplitFilterIdx()); j++) {
+    setupFilter(j, toShardPageSequence(PAGE_VIEW).selectAll());
+  }
+
+  const PageSequence image_sequence = toShardPageSequence(IMAGE_VIEW);
+  prefetchImages(image_sequence);
+  for (const PageInfo& image_page : image_sequence) {
+    task_runner.submit(make_intrusive<ImageAnalysisTask>(*this, image_page, start_filter_idx, analysis_end_idx));
+  }
+  task_runner.waitForDone();
+  checkpoint();
+
+  if (analysis_end_idx < m_stages->pageLayoutFilterIdx()) {
+    return;
+  }
+  if (cli.hasMatchLayoutTolerance() && (start_filter_idx <= m_stages->pageLayoutFilterIdx())) {
+    setupPageLayout(toShardPageSequence(PAGE_VIEW).selectAll());
+  }
+  if (end_filter_idx <= analysis_end_idx) {
+    return;
+  }
+
+  // Output depends on the aggregate page size, which is only known now.
+  if (cli.isVerbose()) {
+    std::cout << "Filters: " << (analysis_end_idx + 2) << "-" << (end_filter_idx + 1) << "\n";
+  }
+
+  PageSequence page_sequence = toShardPageSequence(PAGE_VIEW);
+  for (int j = analysis_end_idx + 1; j <= end_filter_idx; j++) {
+    setupFilter(j, page_sequence.selectAll());
+  }
+  if (end_filter_idx == m_stages->outputFilterIdx()) {
+    findUpToDatePages();
+    page_sequence = toShardPageSequence(PAGE_VIEW);
+  }
+  prefetchImages(page_sequence);
+  for (const PageInfo& page : page_sequence) {
+    if (cli.isVerbose()) {
+      std::cout << "\tProcessing: " << page.imageId().filePath().toLatin1().constData() << "\n";
+    }
+    task_runner.submit(createCompositeTask(page, end_filter_idx));
+  }
+  task_runner.waitForDone();
+  checkpoint();
+}  // ConsoleBatch::processSinglePass
+
+void ConsoleBatch::prefetchImages(const PageSequence& page_sequence) {
+  std::vector<ImageId> images;
+  for (const PageInfo& page : page_sequence) {
+    images.push_back(page.imageId());
+  }
+  // Every processing thread should find its next image decoded.
+  const int num_threads = CommandLine::get().getThreads();
+  ImagePrefetcher::instance().setSequence(images, std::max(2, num_threads), num_threads);
+}
+
+void ConsoleBatch::taskDone() {
+  const int checkpoint_every = CommandLine::get().getCheckpointEvery();
+  if (checkpoint_every <= 0) {
+    return;
+  }
+
+  const QMutexLocker locker(&m_checkpointMutex);
+  if (++m_tasksSinceCheckpoint >= checkpoint_every) {
+    writeCheckpoint();
+  }
+}
+
+void ConsoleBatch::checkpoint() {
+  if (CommandLine::get().getCheckpointEvery() <= 0) {
+    return;
+  }
+
+  const QMutexLocker locker(&m_checkpointMutex);
+  writeCheckpoint();
+}
+
+void ConsoleBatch::writeCheckpoint() {
+  const CommandLine& cli = CommandLine::get();
+  m_tasksSinceCheckpoint = 0;
+  if (cli.isVerbose()) {
+    std::cout << "Checkpoint: " << cli.outputProjectFile().toLocal8Bit().constData() << "\n";
+  }
+  saveProject(cli.outputProjectFile());
+}
+
 void ConsoleBatch::saveProject(const QString project_file) {
   PageInfo fpage = m_pages->toPageSequence(PAGE_VIEW).pageAt(0);
   SelectedPage sPage(fpage.id(), IMAGE_VIEW);
@@ -197,6 +624,123 @@ void ConsoleBatch::saveProject(const QString project_file) {
   writer.write(project_file, m_stages->filters());
 }
 
+void ConsoleBatch::exportPdf(const QString& pdf_file) {
+  const CommandLine& cli = CommandLine::get();
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* device = overwriter.startWriting(pdf_file);
+  if (!device) {
+    throw std::runtime_error("ConsoleBatch: Unable to write the PDF file.");
+  }
+
+  const QDir foreground_dir(output::Utils::foregroundDir(m_outFileNameGen.outDir()));
+  const QDir background_dir(output::Utils::backgroundDir(m_outFileNameGen.outDir()));
+
+  // Only the shard's own pages, whether they were processed this time or not.
+  std::unordered_set<ImageId> shard_images;
+  if (cli.hasShard()) {
+    shard_images = shardImages(*m_pages, cli.getShardIndex(), cli.getShardCount());
+  }
+
+  PdfWriter writer(*device);
+  for (const PageInfo& page : m_pages->toPageSequence(PAGE_VIEW)) {
+    if (cli.hasShard() && (shard_images.find(page.imageId()) == shard_images.end())) {
+      continue;
+    }
+    const QString tiff_file_name(m_outFileNameGen.fileNameFor(page.id()));
+    const QString jpeg_file_path(m_outFileNameGen.filePathFor(page.id(), OutputFileNameGenerator::JPEG_FORMAT));
+    QByteArray data(readOutputFile(jpeg_file_path));
+    if (data.isNull()) {
+      data = readOutputFile(m_outFileNameGen.filePathFor(page.id()));
+    }
+    if (data.isNull()) {
+      std::cerr << "No output for " << tiff_file_name.toLocal8Bit().constData() << ", skipping it\n";
+      continue;
+    }
+    if (cli.isVerbose()) {
+      std::cout << "PDF page: " << tiff_file_name.toLocal8Bit().constData() << "\n";
+    }
+
+    // Split mixed pages keep their layers, the foreground being stencilled over the background.
+    const QByteArray foreground(readOutputFile(foreground_dir.absoluteFilePath(tiff_file_name)));
+    const QByteArray background(readOutputFile(background_dir.absoluteFilePath(tiff_file_name)));
+    if (!foreground.isNull() && !background.isNull() && writer.addMaskedPage(background, foreground)) {
+      continue;
+    }
+
+    if (!writer.addPage(data)) {
+      throw std::runtime_error("ConsoleBatch: Unable to read an output file for the PDF.");
+    }
+  }
+
+  if (!writer.finish() || !overwriter.commit()) {
+    throw std::runtime_error("ConsoleBatch: Unable to write the PDF file.");
+  }
+}  // ConsoleBatch::exportPdf
+
+void ConsoleBatch::mergeProjects(const QStringList& shard_project_files, const QString& output_project_file) {
+  const int shard_count = shard_project_files.size();
+  if (shard_count == 0) {
+    throw std::runtime_error("ConsoleBatch: No projects to merge.");
+  }
+
+  const PageSelectionAccessor accessor(nullptr);  // Won't be used anyway.
+  std::vector<std::unique_ptr<ProjectReader>> readers;
+  std::vector<intrusive_ptr<StageSequence>> stages;
+  for (const QString& project_file : shard_project_files) {
+    readers.push_back(readProject(project_file));
+    if (!readers.back()->success()) {
+      throw std::runtime_error("ConsoleBatch: Unable to read the project file.");
+    }
+    stages.push_back(make_intrusive<StageSequence>(readers.back()->pages(), accessor));
+    readers.back()->readFilterSettings(stages.back()->filters());
+  }
+
+  // The pages of the first shard are the base, but the page split results
+  // of the other shards have to be carried over to them.
+  const intrusive_ptr<ProjectPages>& pages = readers.front()->pages();
+  std::unordered_map<ImageId, int> shard_by_image;
+  for (int shard = 0; shard < shard_count; ++shard) {
+    for (const ImageId& image_id : shardImages(*pages, shard, shard_count)) {
+      shard_by_image[image_id] = shard;
+      if (shard == 0) {
+        continue;
+      }
+      const size_t num_sub_pages = readers[shard]->pages()->pagesOf(image_id).size();
+      if (num_sub_pages > 0) {
+        pages->setLayoutTypeFor(image_id,
+                                (num_sub_pages > 1) ? ProjectPages::TWO_PAGE_LAYOUT : ProjectPages::ONE_PAGE_LAYOUT);
+      }
+    }
+  }
+
+  const PageInfo first_page(pages->toPageSequence(PAGE_VIEW).pageAt(0));
+  const ProjectWriter writer(pages, SelectedPage(first_page.id(), IMAGE_VIEW),
+                             OutputFileNameGenerator(readers.front()->namingDisambiguator(),
+                                                     readers.front()->outputDirectory(), pages->layoutDirection()));
+
+  std::unordered_map<int, int> shard_by_numeric_id;
+  writer.enumImages([&](const ImageId& image_id, const int numeric_id) {
+    shard_by_numeric_id[numeric_id] = shard_by_image[image_id];
+  });
+  writer.enumPages([&](const PageId& page_id, const int numeric_id) {
+    shard_by_numeric_id[numeric_id] = shard_by_image[page_id.imageId()];
+  });
+
+  QDomDocument doc(writer.toDocument(stages.front()->filters()));
+  QDomElement filter_el(doc.documentElement().firstChildElement("filters").firstChildElement());
+  for (int i = 0; i < stages.front()->count(); ++i, filter_el = filter_el.nextSiblingElement()) {
+    for (int shard = 1; shard < shard_count; ++shard) {
+      const QDomElement shard_filter_el(stages[shard]->filterAt(i)->saveSettings(writer, doc));
+      mergeShardSettings(filter_el, shard_filter_el, shard, shard_by_numeric_id);
+    }
+  }
+
+  if (!ProjectWriter::writeDocument(output_project_file, doc)) {
+    throw std::runtime_error("ConsoleBatch: Unable to write the merged project file.");
+  }
+}  // ConsoleBatch::mergeProjects
+
 void ConsoleBatch::setupFilter(int idx, std::set<PageId> allPages) {
   if (idx == m_stages->fixOrientationFilterIdx()) {
     setupFixOrientation(allPages);
@@ -21,16 +21,23 @@
 #ifndef CONSOLEBATCH_H_
 #define CONSOLEBATCH_H_
 
+#include <QImage>
+#include <QMutex>
 #include <QString>
+#include <QStringList>
+#include <set>
+#include <unordered_set>
 #include <vector>
 
 #include "BackgroundTask.h"
+#include "CompositeCacheDrivenTask.h"
 #include "FilterResult.h"
 #include "ImageFileInfo.h"
 #include "OutputFileNameGenerator.h"
 #include "PageId.h"
 #include "PageInfo.h"
 #include "PageSelectionAccessor.h"
+#include "PageSequence.h"
 #include "PageView.h"
 #include "ProjectPages.h"
 #include "ProjectReader.h"
@@ -52,6 +59,24 @@ class ConsoleBatch {
 
   void saveProject(const QString project_file);
 
+  /**
+   * \brief Writes the output pages into a PDF file, in page order.
+   *
+   * Mixed pages split into layers get their bi-level foreground painted over
+   * the background.  Pages without an output file are skipped.  With --shard,
+   * only the pages of that shard are written.
+   */
+  void exportPdf(const QString& pdf_file);
+
+  /**
+   * \brief Merges the projects saved by --shard=i/N runs into one.
+   *
+   * \param shard_project_files The project files, ordered by shard index.
+   *        The settings of an image are taken from the shard that processed it.
+   * \param output_project_file The merged project file to write.
+   */
+  static void mergeProjects(const QStringList& shard_project_files, const QString& output_project_file);
+
  private:
   bool batch;
   bool debug;
@@ -61,6 +86,61 @@ class ConsoleBatch {
   OutputFileNameGenerator m_outFileNameGen;
   intrusive_ptr<ThumbnailPixmapCache> m_thumbnailCache;
   std::unique_ptr<ProjectReader> m_reader;
+  std::set<PageId> m_upToDatePages;
+  QMutex m_checkpointMutex;
+  int m_tasksSinceCheckpoint = 0;
+
+  static std::unique_ptr<ProjectReader> readProject(const QString& project_file);
+
+  /**
+   * \return The images processed by the given shard, that is every
+   *         shard_count-th image starting with shard_index-th one.
+   */
+  static std::unordered_set<ImageId> shardImages(const ProjectPages& pages, int shard_index, int shard_count);
+
+  /**
+   * \brief Same as ProjectPages::toPageSequence(), but limited to the shard
+   *        given on the command line and excluding the pages found
+   *        to be up to date.
+   *
+   * In IMAGE_VIEW, an image is excluded if all of its pages are up to date.
+   */
+  PageSequence toShardPageSequence(PageView view) const;
+
+  /**
+   * \brief Makes the images of the pages to be processed next get decoded
+   *        in the background.
+   */
+  static void prefetchImages(const PageSequence& page_sequence);
+
+  /**
+   * \brief Fills m_upToDatePages with the pages whose output files match
+   *        their current settings.
+   *
+   * This is decided from the settings and file stats alone, so that
+   * such pages can be skipped without loading their images.  It's only
+   * meaningful right before the output pass, once the passes before it
+   * have settled the aggregate page size, and the output filter has its
+   * command line options applied.  Nothing is changed in the settings.
+   */
+  void findUpToDatePages();
+
+  /**
+   * \brief Counts a finished task and saves a checkpoint every
+   *        --checkpoint-every tasks.  May be called from any thread.
+   */
+  void taskDone();
+
+  /**
+   * \brief Saves a checkpoint if --checkpoint-every was given.
+   */
+  void checkpoint();
+
+  /**
+   * \brief Writes the project to --output-project.  Must be called with
+   *        m_checkpointMutex locked.
+   */
+  void writeCheckpoint();
 
   void setupFilter(int idx, std::set<PageId> allPages);
 
@@ -76,7 +156,24 @@ class ConsoleBatch {
 
   void setupOutput(std::set<PageId> allPages);
 
-  BackgroundTaskPtr createCompositeTask(const PageInfo& page, const int last_filter_idx);
+  BackgroundTaskPtr createCompositeTask(const PageInfo& page,
+                                        const int last_filter_idx,
+                                        const QImage& preloaded_image = QImage());
+
+  intrusive_ptr<CompositeCacheDrivenTask> createCompositeCacheDrivenTask();
+
+  class TaskRunner;
+  class ImageAnalysisTask;
+
+  /**
+   * \brief Processes the filters in [start_filter_idx, end_filter_idx] decoding
+   *        each image once per pass rather than once per filter.
+   *
+   * The first pass runs everything up to page layout for all the pages
+   * of an image in one go.  As page layout depends on all the pages,
+   * output is rendered in a second pass.
+   */
+  void processSinglePass(TaskRunner& task_runner, int start_filter_idx, int end_filter_idx);
 };
 
 
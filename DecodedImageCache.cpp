@@ -0,0 +1,141 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "DecodedImageCache.h"
+#include <QFileInfo>
+#include <QSettings>
+#include <algorithm>
+#include <iterator>
+#include "Utils.h"
+
+static int defaultCacheSizeMb() {
+  // Address space is precious on 32-bit systems.
+  const qint64 max_mb = (sizeof(void*) <= 4) ? 128 : 512;
+
+  // The cache counts against the processing memory budget, which is
+  // derived from the physical memory as well, so it mustn't take much of it.
+  const qint64 physical_mb = Utils::physicalMemorySize() / (1024 * 1024);
+  if (physical_mb <= 0) {
+    return static_cast<int>(max_mb);
+  }
+
+  return static_cast<int>(std::min<qint64>(std::max<qint64>(physical_mb / 16, 64), max_mb));
+}
+
+DecodedImageCache::Entry::Entry(const ImageId& image_id,
+                                const FileStamp& file_stamp,
+                                const Dpi& dpi,
+                                const FilterData& data)
+    : imageId(image_id),
+      fileStamp(file_stamp),
+      dpi(dpi),
+      data(data),
+      bytes(qint64(data.origImage().bytesPerLine()) * data.origImage().height()
+            + qint64(data.grayImage().stride()) * data.grayImage().height()) {}
+
+DecodedImageCache& DecodedImageCache::instance() {
+  static DecodedImageCache object;
+
+  return object;
+}
+
+DecodedImageCache::DecodedImageCache() : m_totalBytes(0) {
+  const int max_mb = QSettings().value("settings/decoded_image_cache_mb", defaultCacheSizeMb()).toInt();
+  m_maxBytes = qint64(std::max(0, max_mb)) * 1024 * 1024;
+}
+
+std::unique_ptr<FilterData> DecodedImageCache::find(const ImageId& image_id, const Dpi& dpi) {
+  const FileStamp file_stamp(fileStampOf(image_id));
+
+  const QMutexLocker locker(&m_mutex);
+
+  const auto map_it(m_entryByImage.find(image_id));
+  if (map_it == m_entryByImage.end()) {
+    return nullptr;
+  }
+
+  const EntryList::iterator it(map_it->second);
+  if (!(it->fileStamp == file_stamp) || (it->dpi != dpi)) {
+    removeEntry(it);
+    return nullptr;
+  }
+
+  m_entries.splice(m_entries.begin(), m_entries, it);
+
+  return std::make_unique<FilterData>(it->data);
+}
+
+void DecodedImageCache::insert(const ImageId& image_id, const Dpi& dpi, const FilterData& data) {
+  const FileStamp file_stamp(fileStampOf(image_id));
+  if (file_stamp.size < 0) {
+    return;
+  }
+
+  const QMutexLocker locker(&m_mutex);
+
+  const auto map_it(m_entryByImage.find(image_id));
+  if (map_it != m_entryByImage.end()) {
+    removeEntry(map_it->second);
+  }
+
+  m_entries.emplace_front(image_id, file_stamp, dpi, data);
+  if (m_entries.front().bytes > m_maxBytes) {
+    // Wouldn't fit anyway.
+    m_entries.pop_front();
+    return;
+  }
+  m_entryByImage[image_id] = m_entries.begin();
+  m_totalBytes += m_entries.front().bytes;
+
+  while (m_totalBytes > m_maxBytes) {
+    removeEntry(std::prev(m_entries.end()));
+  }
+}
+
+void DecodedImageCache::clear() {
+  const QMutexLocker locker(&m_mutex);
+
+  m_entries.clear();
+  m_entryByImage.clear();
+  m_totalBytes = 0;
+}
+
+qint64 DecodedImageCache::totalBytes() const {
+  const QMutexLocker locker(&m_mutex);
+
+  return m_totalBytes;
+}
+
+DecodedImageCache::FileStamp DecodedImageCache::fileStampOf(const ImageId& image_id) {
+  FileStamp stamp;
+
+  const QFileInfo file_info(image_id.filePath());
+  if (file_info.exists()) {
+    stamp.modified = file_info.lastModified();
+    stamp.size = file_info.size();
+  }
+
+  return stamp;
+}
+
+void DecodedImageCache::removeEntry(const EntryList::iterator it) {
+  m_totalBytes -= it->bytes;
+  m_entryByImage.erase(it->imageId);
+  m_entries.erase(it);
+}
@@ -0,0 +1,102 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DECODED_IMAGE_CACHE_H_
+#define DECODED_IMAGE_CACHE_H_
+
+#include <QDateTime>
+#include <QMutex>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "Dpi.h"
+#include "FilterData.h"
+#include "ImageId.h"
+#include "NonCopyable.h"
+
+/**
+ * \brief A process-wide LRU cache of decoded images along with their
+ *        grayscale versions, as the processing chain starts from them.
+ *
+ * An entry is only valid while the file's modification time and size
+ * remain the same.  The total size of entries is bounded by
+ * settings/decoded_image_cache_mb, which defaults to 1/16 of the physical
+ * memory, but no more than 512 MB.
+ *
+ * All methods may be called from any thread.
+ */
+class DecodedImageCache {
+  DECLARE_NON_COPYABLE(DecodedImageCache)
+
+ public:
+  static DecodedImageCache& instance();
+
+  /**
+   * \return The cached data for the image decoded with the given DPI,
+   *         or null if there is no such entry or the file has changed.
+   */
+  std::unique_ptr<FilterData> find(const ImageId& image_id, const Dpi& dpi);
+
+  void insert(const ImageId& image_id, const Dpi& dpi, const FilterData& data);
+
+  void clear();
+
+  /**
+   * \return The total size of the cached images, in bytes.
+   */
+  qint64 totalBytes() const;
+
+ private:
+  struct FileStamp {
+    QDateTime modified;
+    qint64 size = -1;
+
+    bool operator==(const FileStamp& other) const { return (modified == other.modified) && (size == other.size); }
+  };
+
+  struct Entry {
+    ImageId imageId;
+    FileStamp fileStamp;
+    Dpi dpi;
+    FilterData data;
+    qint64 bytes;
+
+    Entry(const ImageId& image_id, const FileStamp& file_stamp, const Dpi& dpi, const FilterData& data);
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  DecodedImageCache();
+
+  static FileStamp fileStampOf(const ImageId& image_id);
+
+  /**
+   * Must be called with m_mutex locked.
+   */
+  void removeEntry(EntryList::iterator it);
+
+  mutable QMutex m_mutex;
+  EntryList m_entries;  // Most recently used first.
+  std::unordered_map<ImageId, EntryList::iterator> m_entryByImage;
+  qint64 m_totalBytes;
+  qint64 m_maxBytes;
+};
+
+
+#endif  // ifndef DECODED_IMAGE_CACHE_H_
@@ -17,13 +17,56 @@
  */
 
 #include "FilterData.h"
+#include <cstdint>
+#include <new>
 #include "Dpm.h"
 #include "imageproc/Grayscale.h"
 
 using namespace imageproc;
 
+namespace {
+/**
+ * Image loaders keep 16-bit samples, but the processing works on 8-bit ones,
+ * so they are reduced here, with rounding.
+ */
+QImage toEightBitsPerSample(const QImage& image) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+  switch (image.format()) {
+    case QImage::Format_Grayscale16: {
+      QImage dst(image.size(), QImage::Format_Indexed8);
+      dst.setColorTable(createGrayscalePalette());
+      if (dst.isNull()) {
+        throw std::bad_alloc();
+      }
+      for (int y = 0; y < image.height(); ++y) {
+        const auto* src_line = reinterpret_cast<const uint16_t*>(image.constScanLine(y));
+        uint8_t* dst_line = dst.scanLine(y);
+        for (int x = 0; x < image.width(); ++x) {
+          dst_line[x] = static_cast<uint8_t>((src_line[x] + 128) / 257);
+        }
+      }
+      dst.setDotsPerMeterX(image.dotsPerMeterX());
+      dst.setDotsPerMeterY(image.dotsPerMeterY());
+
+      return dst;
+    }
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+      return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    default:
+      break;
+  }
+#endif
+
+  return image;
+}
+}  // namespace
+
 FilterData::FilterData(const QImage& image)
-    : m_origImage(image), m_grayImage(toGrayscale(m_origImage)), m_xform(image.rect(), Dpm(image)) {}
+    : m_origImage(toEightBitsPerSample(image)),
+      m_grayImage(toGrayscale(m_origImage)),
+      m_xform(image.rect(), Dpm(image)) {}
 
 FilterData::FilterData(const FilterData& other, const ImageTransformation& xform)
     : m_origImage(other.m_origImage),
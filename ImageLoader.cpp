@@ -19,7 +19,9 @@
 #include "ImageLoader.h"
 #include <QFile>
 #include <QImage>
+#include <QRect>
 #include <QtGui/QImageReader>
+#include <algorithm>
 #include "ImageId.h"
 #include "TiffReader.h"
 
@@ -51,3 +53,79 @@ QImage ImageLoader::load(QIODevice& io_dev, const int page_num) {
 
   return image;
 }
+
+QImage ImageLoader::load(const ImageId& image_id, const QRect& roi, const int scale_denom) {
+  QFile file(image_id.filePath());
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QImage();
+  }
+
+  return load(file, image_id.zeroBasedPage(), roi, scale_denom);
+}
+
+QImage ImageLoader::load(QIODevice& io_dev, const int page_num, const QRect& roi, int scale_denom) {
+  scale_denom = std::max(1, scale_denom);
+
+  if (TiffReader::canRead(io_dev)) {
+    return scaleDown(TiffReader::readImage(io_dev, page_num, roi), scale_denom);
+  }
+
+  if (page_num != 0) {
+    // Qt can only load the first page of multi-page images.
+    return QImage();
+  }
+
+  QImageReader reader(&io_dev);
+  const QSize full_size(reader.size());
+  if (!full_size.isValid()) {
+    // We can't tell the reader what to do without knowing the image size.
+    QImage image;
+    if (!reader.read(&image)) {
+      return QImage();
+    }
+    if (!roi.isNull()) {
+      image = image.copy(roi.intersected(image.rect()));
+    }
+
+    return scaleDown(image, scale_denom);
+  }
+
+  const QRect full_rect(QPoint(0, 0), full_size);
+  const QRect rect(roi.isNull() ? full_rect : roi.intersected(full_rect));
+  if (rect.isEmpty()) {
+    return QImage();
+  }
+  if (rect != full_rect) {
+    reader.setClipRect(rect);
+  }
+  if (scale_denom > 1) {
+    // The JPEG plugin implements this with DCT scaling.  For formats
+    // that can't, QImageReader scales the image itself.
+    reader.setScaledSize(scaledSize(rect.size(), scale_denom));
+  }
+
+  QImage image;
+  if (!reader.read(&image)) {
+    return QImage();
+  }
+  image.setDotsPerMeterX(image.dotsPerMeterX() / scale_denom);
+  image.setDotsPerMeterY(image.dotsPerMeterY() / scale_denom);
+
+  return image;
+}  // ImageLoader::load
+
+QSize ImageLoader::scaledSize(const QSize& size, const int scale_denom) {
+  return QSize((size.width() + scale_denom - 1) / scale_denom, (size.height() + scale_denom - 1) / scale_denom);
+}
+
+QImage ImageLoader::scaleDown(const QImage& image, const int scale_denom) {
+  if (image.isNull() || (scale_denom <= 1)) {
+    return image;
+  }
+
+  QImage scaled(image.scaled(scaledSize(image.size(), scale_denom), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+  scaled.setDotsPerMeterX(image.dotsPerMeterX() / scale_denom);
+  scaled.setDotsPerMeterY(image.dotsPerMeterY() / scale_denom);
+
+  return scaled;
+}
@@ -23,6 +23,8 @@ class ImageId;
 class QImage;
 class QString;
 class QIODevice;
+class QRect;
+class QSize;
 
 class ImageLoader {
  public:
@@ -31,6 +33,28 @@ class ImageLoader {
   static QImage load(const ImageId& image_id);
 
   static QImage load(QIODevice& io_dev, int page_num);
+
+  /**
+   * \brief Loads a part of an image, possibly at a reduced resolution.
+   *
+   * Decoders are asked to do the work themselves where they can do it
+   * cheaply.  That is, JPEG images are downscaled while decoding and
+   * TIFF strips outside of \p roi aren't decoded.
+   *
+   * \param roi The area to load, in full resolution image coordinates.
+   *        A null rectangle stands for the whole image.
+   * \param scale_denom The width and height of \p roi are divided
+   *        by this number, rounding up.  The DPI is adjusted accordingly.
+   * \return The resulting image, or a null image in case of failure.
+   */
+  static QImage load(const ImageId& image_id, const QRect& roi, int scale_denom);
+
+  static QImage load(QIODevice& io_dev, int page_num, const QRect& roi, int scale_denom);
+
+ private:
+  static QSize scaledSize(const QSize& size, int scale_denom);
+
+  static QImage scaleDown(const QImage& image, int scale_denom);
 };
 
 
@@ -0,0 +1,162 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ImageMetadataCache.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include "AtomicFileOverwriter.h"
+
+namespace {
+const quint32 MAGIC = 0x53544d31;  // "STM1"
+
+// Past this, the entries not used by this process are dropped on save().
+const int MAX_ENTRIES = 100000;
+}  // namespace
+
+ImageMetadataCache& ImageMetadataCache::instance() {
+  static ImageMetadataCache object;
+
+  return object;
+}
+
+ImageMetadataCache::ImageMetadataCache()
+    : m_filePath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/image_metadata.cache"),
+      m_loaded(false),
+      m_modified(false) {}
+
+ImageMetadataLoader::Status ImageMetadataCache::load(const QFileInfo& file_info,
+                                                     std::vector<ImageMetadata>& per_page_metadata) {
+  const QString file_path(file_info.absoluteFilePath());
+  const qint64 size = file_info.size();
+  const qint64 modified_time = file_info.lastModified().toMSecsSinceEpoch();
+
+  {
+    const QMutexLocker locker(&m_mutex);
+    ensureLoaded();
+
+    const auto it(m_entries.find(file_path));
+    if ((it != m_entries.end()) && (it->size == size) && (it->modifiedTime == modified_time)) {
+      it->used = true;
+      per_page_metadata = it->perPageMetadata;
+
+      return ImageMetadataLoader::LOADED;
+    }
+  }
+
+  std::vector<ImageMetadata> loaded;
+  const ImageMetadataLoader::Status status
+      = ImageMetadataLoader::load(file_path, [&](const ImageMetadata& metadata) { loaded.push_back(metadata); });
+  if (status != ImageMetadataLoader::LOADED) {
+    return status;
+  }
+
+  {
+    const QMutexLocker locker(&m_mutex);
+
+    Entry& entry = m_entries[file_path];
+    entry.size = size;
+    entry.modifiedTime = modified_time;
+    entry.perPageMetadata = loaded;
+    entry.used = true;
+    m_modified = true;
+  }
+
+  per_page_metadata.swap(loaded);
+
+  return status;
+}  // ImageMetadataCache::load
+
+void ImageMetadataCache::save() {
+  const QMutexLocker locker(&m_mutex);
+
+  if (!m_modified || !QDir().mkpath(QFileInfo(m_filePath).absolutePath())) {
+    return;
+  }
+
+  if (m_entries.size() > MAX_ENTRIES) {
+    for (auto it(m_entries.begin()); it != m_entries.end();) {
+      if (it->used) {
+        ++it;
+      } else {
+        it = m_entries.erase(it);
+      }
+    }
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* const device = overwriter.startWriting(m_filePath);
+  if (!device) {
+    return;
+  }
+
+  QDataStream strm(device);
+  strm << MAGIC << quint32(m_entries.size());
+  for (auto it(m_entries.constBegin()); it != m_entries.constEnd(); ++it) {
+    strm << it.key() << it->size << it->modifiedTime << quint32(it->perPageMetadata.size());
+    for (const ImageMetadata& metadata : it->perPageMetadata) {
+      strm << qint32(metadata.size().width()) << qint32(metadata.size().height())
+           << qint32(metadata.dpi().horizontal()) << qint32(metadata.dpi().vertical());
+    }
+  }
+
+  if ((strm.status() == QDataStream::Ok) && overwriter.commit()) {
+    m_modified = false;
+  }
+}  // ImageMetadataCache::save
+
+void ImageMetadataCache::ensureLoaded() {
+  if (m_loaded) {
+    return;
+  }
+  m_loaded = true;
+
+  QFile file(m_filePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return;
+  }
+
+  QDataStream strm(&file);
+  quint32 magic = 0;
+  quint32 num_entries = 0;
+  strm >> magic >> num_entries;
+  if ((strm.status() != QDataStream::Ok) || (magic != MAGIC)) {
+    return;
+  }
+
+  for (quint32 i = 0; i < num_entries; ++i) {
+    QString file_path;
+    Entry entry;
+    quint32 num_pages = 0;
+    strm >> file_path >> entry.size >> entry.modifiedTime >> num_pages;
+    for (quint32 page = 0; (page < num_pages) && (strm.status() == QDataStream::Ok); ++page) {
+      qint32 width = 0, height = 0, dpi_x = 0, dpi_y = 0;
+      strm >> width >> height >> dpi_x >> dpi_y;
+      entry.perPageMetadata.emplace_back(QSize(width, height), Dpi(dpi_x, dpi_y));
+    }
+    if (strm.status() != QDataStream::Ok) {
+      // A truncated file.  Whatever was read before is fine.
+      break;
+    }
+    m_entries.insert(file_path, entry);
+  }
+}  // ImageMetadataCache::ensureLoaded
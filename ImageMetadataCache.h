@@ -0,0 +1,88 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_METADATA_CACHE_H_
+#define IMAGE_METADATA_CACHE_H_
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <vector>
+#include "ImageMetadata.h"
+#include "ImageMetadataLoader.h"
+#include "NonCopyable.h"
+
+class QFileInfo;
+
+/**
+ * \brief A persistent cache of the metadata of image files, so that adding
+ *        the same files to a project again doesn't require reading them.
+ *
+ * Entries are keyed by the absolute path of a file and are only used while
+ * its size and modification time stay the same.  The cache lives in a file
+ * in the user's cache directory, read on first use and written by save().
+ *
+ * All methods may be called from any thread.
+ */
+class ImageMetadataCache {
+  DECLARE_NON_COPYABLE(ImageMetadataCache)
+
+ public:
+  static ImageMetadataCache& instance();
+
+  /**
+   * \brief Gets the metadata of every page of a file, from the cache if
+   *        possible, otherwise by loading and caching it.
+   *
+   * \param file_info The file.  Its cached size and modification time are used,
+   *        so a QFileInfo obtained from a directory listing doesn't make
+   *        the file to be accessed at all on a hit.
+   * \param per_page_metadata Receives the metadata on success.
+   */
+  ImageMetadataLoader::Status load(const QFileInfo& file_info, std::vector<ImageMetadata>& per_page_metadata);
+
+  /**
+   * \brief Writes the cache file, if anything was added since it was read.
+   */
+  void save();
+
+ private:
+  struct Entry {
+    qint64 size = 0;
+    qint64 modifiedTime = 0;  // Milliseconds since the epoch.
+    std::vector<ImageMetadata> perPageMetadata;
+    bool used = false;  // Looked up or added by this process.
+  };
+
+  ImageMetadataCache();
+
+  /**
+   * \brief Reads the cache file unless already done.  Must be called
+   *        with m_mutex locked.
+   */
+  void ensureLoaded();
+
+  QMutex m_mutex;
+  QString m_filePath;
+  QHash<QString, Entry> m_entries;
+  bool m_loaded;
+  bool m_modified;
+};
+
+
+#endif  // ifndef IMAGE_METADATA_CACHE_H_
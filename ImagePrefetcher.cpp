@@ -0,0 +1,226 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ImagePrefetcher.h"
+#include <QRunnable>
+#include <algorithm>
+#include "ImageLoader.h"
+
+class ImagePrefetcher::Decoder : public QRunnable {
+ public:
+  Decoder(ImagePrefetcher& owner, const ImageId& image_id, int generation)
+      : m_owner(owner), m_imageId(image_id), m_generation(generation) {
+    setAutoDelete(true);
+  }
+
+  void run() override {
+    QImage image;
+    try {
+      image = ImageLoader::load(m_imageId);
+    } catch (const std::bad_alloc&) {
+      // The task will load the image itself, or fail on its own.
+    }
+    m_owner.decoded(m_imageId, image, m_generation);
+  }
+
+ private:
+  ImagePrefetcher& m_owner;
+  ImageId m_imageId;
+  int m_generation;
+};
+
+
+ImagePrefetcher& ImagePrefetcher::instance() {
+  static ImagePrefetcher object;
+
+  return object;
+}
+
+ImagePrefetcher::ImagePrefetcher() : m_nextToSchedule(0), m_furthestConsumed(0), m_depth(0), m_generation(0) {}
+
+void ImagePrefetcher::setSequence(const std::vector<ImageId>& images, const int depth, const int num_threads) {
+  const QMutexLocker locker(&m_mutex);
+
+  // Decoding compressed images is CPU bound, so a single thread
+  // can't keep up with several processing ones.
+  m_pool.setMaxThreadCount(std::max(1, num_threads));
+
+  ++m_generation;
+  m_sequence.clear();
+  m_usesLeft.clear();
+  m_positions.clear();
+  m_entries.clear();
+  m_decodedCond.wakeAll();
+
+  for (const ImageId& image_id : images) {
+    if (!m_sequence.empty() && (m_sequence.back() == image_id)) {
+      ++m_usesLeft.back();
+      continue;
+    }
+    if (m_positions.find(image_id) != m_positions.end()) {
+      // Only the first occurrence is prefetched.
+      continue;
+    }
+    m_positions[image_id] = m_sequence.size();
+    m_sequence.push_back(image_id);
+    m_usesLeft.push_back(1);
+  }
+
+  m_nextToSchedule = 0;
+  m_furthestConsumed = 0;
+  m_depth = std::max(0, depth);
+  if (m_depth > 0) {
+    scheduleUpTo(size_t(m_depth - 1));
+  }
+}
+
+QImage ImagePrefetcher::take(const ImageId& image_id) {
+  QMutexLocker locker(&m_mutex);
+
+  const auto pos_it(m_positions.find(image_id));
+  if (pos_it == m_positions.end()) {
+    return QImage();
+  }
+  const size_t position = pos_it->second;
+
+  QImage image;
+  auto it(m_entries.find(image_id));
+  if (it != m_entries.end()) {
+    const int generation = m_generation;
+    while (!it->second.ready) {
+      m_decodedCond.wait(&m_mutex);
+      if (generation != m_generation) {
+        return QImage();
+      }
+      it = m_entries.find(image_id);
+      if (it == m_entries.end()) {
+        return QImage();
+      }
+    }
+
+    image = it->second.image;
+  }
+
+  consume(position);
+  expireBehind(position);
+  scheduleUpTo(position + m_depth);
+
+  return image;
+}
+
+void ImagePrefetcher::release(const ImageId& image_id) {
+  const QMutexLocker locker(&m_mutex);
+
+  const auto pos_it(m_positions.find(image_id));
+  if (pos_it == m_positions.end()) {
+    return;
+  }
+  const size_t position = pos_it->second;
+
+  consume(position);
+  expireBehind(position);
+  scheduleUpTo(position + m_depth);
+}
+
+void ImagePrefetcher::consume(const size_t position) {
+  if (m_usesLeft[position] <= 0) {
+    return;
+  }
+  if (--m_usesLeft[position] == 0) {
+    // Drops the image if it's decoded, or makes decoded() ignore it
+    // if it's being decoded.  If it's yet to be scheduled, scheduleUpTo()
+    // will skip it.
+    m_entries.erase(m_sequence[position]);
+  }
+}
+
+void ImagePrefetcher::expireBehind(const size_t position) {
+  m_furthestConsumed = std::max(m_furthestConsumed, position);
+  if (m_furthestConsumed < size_t(m_depth)) {
+    return;
+  }
+  const size_t first_kept = m_furthestConsumed - m_depth;
+
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    const size_t entry_position = m_positions[it->first];
+    if (entry_position < first_kept) {
+      // Its task won't take it anymore, or it will load the image itself.
+      m_usesLeft[entry_position] = 0;
+      it = m_entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ImagePrefetcher::clear() {
+  const QMutexLocker locker(&m_mutex);
+
+  ++m_generation;
+  m_sequence.clear();
+  m_usesLeft.clear();
+  m_positions.clear();
+  m_entries.clear();
+  m_nextToSchedule = 0;
+  m_furthestConsumed = 0;
+  m_decodedCond.wakeAll();
+}
+
+qint64 ImagePrefetcher::totalBytes() const {
+  const QMutexLocker locker(&m_mutex);
+
+  qint64 total = 0;
+  for (const auto& kv : m_entries) {
+    const QImage& image = kv.second.image;
+    total += qint64(image.bytesPerLine()) * image.height();
+  }
+
+  return total;
+}
+
+void ImagePrefetcher::scheduleUpTo(const size_t last_position) {
+  const size_t end = std::min(last_position + 1, m_sequence.size());
+  while ((m_nextToSchedule < end) && (m_entries.size() < size_t(m_depth))) {
+    const size_t position = m_nextToSchedule++;
+    if (m_usesLeft[position] <= 0) {
+      // Already taken or released.
+      continue;
+    }
+    const ImageId& image_id = m_sequence[position];
+    m_entries[image_id];
+    m_pool.start(new Decoder(*this, image_id, m_generation));
+  }
+}
+
+void ImagePrefetcher::decoded(const ImageId& image_id, const QImage& image, const int generation) {
+  const QMutexLocker locker(&m_mutex);
+
+  if (generation != m_generation) {
+    return;
+  }
+
+  const auto it(m_entries.find(image_id));
+  if (it == m_entries.end()) {
+    return;
+  }
+
+  it->second.image = image;
+  it->second.ready = true;
+  m_decodedCond.wakeAll();
+}
@@ -0,0 +1,137 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef IMAGE_PREFETCHER_H_
+#define IMAGE_PREFETCHER_H_
+
+#include <QImage>
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "ImageId.h"
+#include "NonCopyable.h"
+
+/**
+ * \brief Decodes images ahead of the tasks that are going to need them.
+ *
+ * The order the images are going to be requested in is set with setSequence().
+ * Then, each time an image is taken, the following ones are decoded on
+ * a background thread, keeping at most a given number of decoded images around.
+ * This lets disk and decoding time overlap with processing.
+ *
+ * All methods may be called from any thread.
+ */
+class ImagePrefetcher {
+  DECLARE_NON_COPYABLE(ImagePrefetcher)
+
+ public:
+  static ImagePrefetcher& instance();
+
+  /**
+   * \brief Sets the order images are going to be taken in, and starts
+   *        decoding the first ones.
+   *
+   * \param images The images to decode, in order.  Consecutive duplicates,
+   *        as in the pages of a split image, are decoded once.
+   * \param depth The maximum number of decoded images to keep.
+   * \param num_threads The number of images to decode in parallel,
+   *        normally the number of processing threads.
+   */
+  void setSequence(const std::vector<ImageId>& images, int depth, int num_threads);
+
+  /**
+   * \brief Returns a decoded image and continues decoding the following ones.
+   *
+   * If the image is being decoded, waits for it.  If it's not a part of
+   * the sequence, or wasn't scheduled for decoding, returns a null image,
+   * in which case the caller is to load it itself.  An image that is taken
+   * before being scheduled won't be decoded later on.
+   */
+  QImage take(const ImageId& image_id);
+
+  /**
+   * \brief Tells the image won't be taken, as the caller got it elsewhere.
+   *
+   * Every image in the sequence is to be either taken or released, as
+   * the images decoded but never taken would keep new ones from being
+   * decoded.  The ones left a whole \p depth behind the furthest image
+   * taken or released are dropped anyway, as their tasks were likely
+   * cancelled before they started.
+   */
+  void release(const ImageId& image_id);
+
+  /**
+   * \brief Forgets the sequence and drops decoded images.
+   */
+  void clear();
+
+  /**
+   * \return The total size of the decoded images being kept, in bytes.
+   */
+  qint64 totalBytes() const;
+
+ private:
+  class Decoder;
+
+  struct Entry {
+    QImage image;
+    bool ready = false;
+  };
+
+  ImagePrefetcher();
+
+  /**
+   * Must be called with m_mutex locked.
+   */
+  void scheduleUpTo(size_t last_position);
+
+  /**
+   * \brief Accounts for a use of the image at \p position.
+   *
+   * Must be called with m_mutex locked.
+   */
+  void consume(size_t position);
+
+  /**
+   * \brief Drops the images too far behind \p position to be taken.
+   *
+   * Must be called with m_mutex locked.
+   */
+  void expireBehind(size_t position);
+
+  void decoded(const ImageId& image_id, const QImage& image, int generation);
+
+  mutable QMutex m_mutex;
+  QWaitCondition m_decodedCond;
+  QThreadPool m_pool;
+  std::vector<ImageId> m_sequence;
+  std::vector<int> m_usesLeft;
+  std::unordered_map<ImageId, size_t> m_positions;
+  std::unordered_map<ImageId, Entry> m_entries;
+  size_t m_nextToSchedule;
+  size_t m_furthestConsumed;
+  int m_depth;
+  int m_generation;
+};
+
+
+#endif  // ifndef IMAGE_PREFETCHER_H_
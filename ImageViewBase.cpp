@@ -26,6 +26,10 @@
 #include <QSettings>
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QStatusBar>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
 #include "BackgroundExecutor.h"
 #include "ColorSchemeManager.h"
 #include "Dpm.h"
@@ -40,11 +44,30 @@
 
 using namespace imageproc;
 
-class ImageViewBase::HqTransformTask : public AbstractCommand<intrusive_ptr<AbstractCommand<void>>>, public QObject {
-  DECLARE_NON_COPYABLE(HqTransformTask)
+namespace {
+const int TILE_SIZE = 256;
+
+/**
+ * Enough for a few screenfuls of tiles at a couple of zoom levels.
+ */
+const qint64 MAX_TILE_CACHE_BYTES = qint64(64) << 20;
+
+const int NO_TILE_LEVEL = std::numeric_limits<int>::min();
+}  // namespace
+
+class ImageViewBase::TileTask : public AbstractCommand<intrusive_ptr<AbstractCommand<void>>>, public QObject {
+  DECLARE_NON_COPYABLE(TileTask)
 
  public:
-  HqTransformTask(ImageViewBase* image_view, const QImage& image, const QTransform& xform, const QSize& target_size);
+  /**
+   * \param xform The transformation from image to level coordinates.
+   * \param target_rect The area of the tile to render, in level coordinates.
+   */
+  TileTask(ImageViewBase* image_view,
+           const QImage& image,
+           const QTransform& xform,
+           const QRect& target_rect,
+           const TileKey& key);
 
   void cancel() { m_result->cancel(); }
 
@@ -55,9 +78,9 @@ class ImageViewBase::HqTransformTask : public AbstractCommand<intrusive_ptr<Abst
  private:
   class Result : public AbstractCommand<void> {
    public:
-    explicit Result(ImageViewBase* image_view);
+    Result(ImageViewBase* image_view, const TileKey& key, const QRect& rect);
 
-    void setData(const QPoint& origin, const QImage& hq_image);
+    void setData(const QImage& hq_image);
 
     void cancel() { m_cancelFlag.fetchAndStoreRelaxed(1); }
 
@@ -67,7 +90,8 @@ class ImageViewBase::HqTransformTask : public AbstractCommand<intrusive_ptr<Abst
 
    private:
     QPointer<ImageViewBase> m_imageView;
-    QPoint m_origin;
+    TileKey m_key;
+    QRect m_rect;
     QImage m_hqImage;
     mutable QAtomicInt m_cancelFlag;
   };
@@ -76,7 +100,7 @@ class ImageViewBase::HqTransformTask : public AbstractCommand<intrusive_ptr<Abst
   intrusive_ptr<Result> m_result;
   QImage m_image;
   QTransform m_xform;
-  QSize m_targetSize;
+  QRect m_targetRect;
 };
 
 
@@ -128,6 +152,11 @@ ImageViewBase::ImageViewBase(const QImage& image,
                              const ImagePresentation& presentation,
                              const Margins& margins)
     : m_image(image),
+      m_tileCacheBytes(0),
+      m_tileUseCounter(0),
+      m_tileLevel(NO_TILE_LEVEL),
+      m_potentialTileLevel(NO_TILE_LEVEL),
+      m_tilesSourceId(0),
       m_virtualImageCropArea(presentation.cropArea()),
       m_virtualDisplayArea(presentation.displayArea()),
       m_imageToVirtual(presentation.transform()),
@@ -216,18 +245,17 @@ ImageViewBase::ImageViewBase(const QImage& image,
   connect(verticalScrollBar(), SIGNAL(valueChanged(int)), SLOT(reactToScrollBars()));
 }
 
-ImageViewBase::~ImageViewBase() = default;
+ImageViewBase::~ImageViewBase() {
+  clearTiles();
+}
 
 void ImageViewBase::hqTransformSetEnabled(const bool enabled) {
   if (!enabled && m_hqTransformEnabled) {
     // Turning off.
     m_hqTransformEnabled = false;
-    if (m_hqTransformTask) {
-      m_hqTransformTask->cancel();
-      m_hqTransformTask.reset();
-    }
-    if (!m_hqPixmap.isNull()) {
-      m_hqPixmap = QPixmap();
+    const bool had_tiles = !m_tiles.empty();
+    clearTiles();
+    if (had_tiles) {
       update();
     }
   } else if (enabled && !m_hqTransformEnabled) {
@@ -424,26 +452,27 @@ void ImageViewBase::paintEvent(QPaintEvent* event) {
   // Disable antialiasing for large zoom levels.
   painter.setRenderHint(QPainter::SmoothPixmapTransform, pixel_width < 0.5);
 
-  if (validateHqPixmap()) {
-    // HQ pixmap maps one to one to screen pixels, so antialiasing is not necessary.
-    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+  // The downscaled version shows through where the tiles are not ready yet.
+  const QTransform pixmap_to_virtual(m_pixmapToImage * m_imageToVirtual);
+  painter.setWorldTransform(pixmap_to_virtual * m_virtualToWidget);
 
-    QPainterPath clip_path;
-    clip_path.addPolygon(m_virtualToWidget.map(m_virtualImageCropArea));
-    painter.setClipPath(clip_path);
+  QPainterPath clip_path;
+  clip_path.addPolygon(pixmap_to_virtual.inverted().map(m_virtualImageCropArea));
+  painter.setClipPath(clip_path);
 
-    painter.drawPixmap(m_hqPixmapPos, m_hqPixmap);
-  } else {
-    scheduleHqVersionRebuild();
+  PixmapRenderer::drawPixmap(painter, m_pixmap);
 
-    const QTransform pixmap_to_virtual(m_pixmapToImage * m_imageToVirtual);
-    painter.setWorldTransform(pixmap_to_virtual * m_virtualToWidget);
+  if (m_hqTransformEnabled) {
+    validateTiles();
 
-    QPainterPath clip_path;
-    clip_path.addPolygon(pixmap_to_virtual.inverted().map(m_virtualImageCropArea));
-    painter.setClipPath(clip_path);
+    const int level = currentTileLevel();
+    if (level == m_tileLevel) {
+      requestTiles(level);
+    } else {
+      scheduleHqVersionRebuild(level);
+    }
 
-    PixmapRenderer::drawPixmap(painter, m_pixmap);
+    drawTiles(painter, level);
   }
 
   painter.restore();
@@ -895,77 +924,214 @@ void ImageViewBase::setWidgetFocalPointWithoutMoving(const QPointF new_widget_fp
   m_pixmapFocalPoint = m_virtualToImage.map(m_widgetToVirtual.map(m_widgetFocalPoint));
 }
 
+bool ImageViewBase::TileKey::operator<(const TileKey& other) const {
+  if (level != other.level) {
+    return level < other.level;
+  } else if (row != other.row) {
+    return row < other.row;
+  } else {
+    return col < other.col;
+  }
+}
+
+double ImageViewBase::tileLevelScale(const int level) {
+  return std::pow(2.0, 0.5 * level);
+}
+
+QRect ImageViewBase::tileRect(const TileKey& key) {
+  return QRect(key.col * TILE_SIZE, key.row * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+}
+
 /**
- * Returns true if m_hqPixmap is valid and up to date.
+ * Returns the level whose scale is the closest one to the current zoom
+ * from above, so that tiles are only ever downscaled when drawn,
+ * and by no more than sqrt(2).
  */
-bool ImageViewBase::validateHqPixmap() const {
-  if (!m_hqTransformEnabled) {
-    return false;
-  }
+int ImageViewBase::currentTileLevel() const {
+  const double scale = std::max(std::fabs(m_virtualToWidget.m11()), std::fabs(m_virtualToWidget.m22()));
+
+  // The epsilon keeps the level stable when the scale is exactly that of a level.
+  return static_cast<int>(std::ceil(2.0 * std::log2(scale) - 1e-6));
+}
 
-  if (m_hqPixmap.isNull()) {
-    return false;
+void ImageViewBase::validateTiles() {
+  if ((m_tilesSourceId == m_image.cacheKey()) && (m_tilesImageToVirtual == m_imageToVirtual)) {
+    return;
   }
 
-  if (m_hqSourceId != m_image.cacheKey()) {
-    return false;
+  clearTiles();
+  m_tilesSourceId = m_image.cacheKey();
+  m_tilesImageToVirtual = m_imageToVirtual;
+}
+
+/**
+ * Returns the tiles of the given level that intersect the viewport,
+ * the ones closer to its center first.
+ */
+std::vector<ImageViewBase::TileKey> ImageViewBase::visibleTiles(const int level) const {
+  std::vector<TileKey> tiles;
+
+  const QTransform virtual_to_level(QTransform().scale(tileLevelScale(level), tileLevelScale(level)));
+  QRectF rect((m_widgetToVirtual * virtual_to_level).mapRect(QRectF(viewport()->rect())));
+  rect &= virtual_to_level.mapRect(m_virtualImageCropArea.boundingRect());
+  rect &= (m_imageToVirtual * virtual_to_level).mapRect(QRectF(m_image.rect()));
+  if (rect.isEmpty()) {
+    return tiles;
   }
 
-  if (m_hqXform != m_imageToVirtual * m_virtualToWidget) {
-    return false;
+  const int first_col = static_cast<int>(std::floor(rect.left() / TILE_SIZE));
+  const int last_col = static_cast<int>(std::ceil(rect.right() / TILE_SIZE)) - 1;
+  const int first_row = static_cast<int>(std::floor(rect.top() / TILE_SIZE));
+  const int last_row = static_cast<int>(std::ceil(rect.bottom() / TILE_SIZE)) - 1;
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int col = first_col; col <= last_col; ++col) {
+      tiles.push_back(TileKey{level, col, row});
+    }
   }
 
-  return true;
+  const QPointF center(rect.center());
+  std::sort(tiles.begin(), tiles.end(), [&center](const TileKey& lhs, const TileKey& rhs) {
+    const QPointF lhs_vec(QRectF(tileRect(lhs)).center() - center);
+    const QPointF rhs_vec(QRectF(tileRect(rhs)).center() - center);
+    return QPointF::dotProduct(lhs_vec, lhs_vec) < QPointF::dotProduct(rhs_vec, rhs_vec);
+  });
+
+  return tiles;
+}  // ImageViewBase::visibleTiles
+
+void ImageViewBase::drawTiles(QPainter& painter, const int level) {
+  const double scale = tileLevelScale(level);
+  const QTransform level_to_widget(QTransform().scale(1.0 / scale, 1.0 / scale) * m_virtualToWidget);
+
+  // Tiles are drawn into whole pixel rectangles, so that the edges
+  // of neighbouring tiles meet exactly.  The clip path set
+  // in widget coordinates stays in effect.
+  painter.setWorldTransform(QTransform());
+  // A tile maps one to one to screen pixels when the zoom is exactly that of its level.
+  const bool scaled
+      = (std::fabs(level_to_widget.m11() - 1.0) > 1e-6) || (std::fabs(level_to_widget.m22() - 1.0) > 1e-6);
+  painter.setRenderHint(QPainter::SmoothPixmapTransform, scaled);
+
+  for (const TileKey& key : visibleTiles(level)) {
+    const auto it = m_tiles.find(key);
+    if (it == m_tiles.end()) {
+      continue;
+    }
+
+    Tile& tile = it->second;
+    tile.lastUsed = ++m_tileUseCounter;
+
+    const QRectF widget_rect(level_to_widget.mapRect(QRectF(tile.rect)));
+    const QRect target_rect(QPoint(qRound(widget_rect.left()), qRound(widget_rect.top())),
+                            QPoint(qRound(widget_rect.right()) - 1, qRound(widget_rect.bottom()) - 1));
+    painter.drawPixmap(target_rect, tile.pixmap);
+  }
 }
 
-void ImageViewBase::scheduleHqVersionRebuild() {
-  const QTransform xform(m_imageToVirtual * m_virtualToWidget);
+void ImageViewBase::requestTiles(const int level) {
+  const std::vector<TileKey> tiles(visibleTiles(level));
+  const std::set<TileKey> needed(tiles.begin(), tiles.end());
+
+  // Cancel the tiles that went out of view, or belong to another level.
+  auto pending_it = m_pendingTiles.begin();
+  while (pending_it != m_pendingTiles.end()) {
+    if (needed.find(pending_it->first) == needed.end()) {
+      pending_it->second->cancel();
+      pending_it = m_pendingTiles.erase(pending_it);
+    } else {
+      ++pending_it;
+    }
+  }
+
+  const double scale = tileLevelScale(level);
+  const QTransform image_to_level(m_imageToVirtual * QTransform().scale(scale, scale));
+  const QRect level_image_rect(image_to_level.mapRect(QRectF(m_image.rect())).toAlignedRect());
+
+  for (const TileKey& key : tiles) {
+    if ((m_tiles.find(key) != m_tiles.end()) || (m_pendingTiles.find(key) != m_pendingTiles.end())) {
+      continue;
+    }
 
-  if (!m_timer.isActive() || (m_potentialHqXform != xform)) {
-    if (m_hqTransformTask) {
-      m_hqTransformTask->cancel();
-      m_hqTransformTask.reset();
+    const QRect target_rect(tileRect(key).intersected(level_image_rect));
+    if (target_rect.isEmpty()) {
+      continue;
     }
-    m_potentialHqXform = xform;
+
+    const auto task = make_intrusive<TileTask>(this, m_image, image_to_level, target_rect, key);
+    backgroundExecutor().enqueueTask(task);
+    m_pendingTiles[key] = task;
+  }
+}  // ImageViewBase::requestTiles
+
+/**
+ * Delays requesting the tiles of a new level until the zoom settles.
+ */
+void ImageViewBase::scheduleHqVersionRebuild(const int level) {
+  if (!m_timer.isActive() || (m_potentialTileLevel != level)) {
+    for (const auto& pending : m_pendingTiles) {
+      pending.second->cancel();
+    }
+    m_pendingTiles.clear();
+    m_potentialTileLevel = level;
   }
   m_timer.start();
 }
 
 void ImageViewBase::initiateBuildingHqVersion() {
-  if (validateHqPixmap()) {
+  if (!m_hqTransformEnabled) {
     return;
   }
 
-  m_hqPixmap = QPixmap();
+  validateTiles();
+  m_tileLevel = currentTileLevel();
+  requestTiles(m_tileLevel);
+  update();
+}
 
-  if (m_hqTransformTask) {
-    m_hqTransformTask->cancel();
-    m_hqTransformTask.reset();
+void ImageViewBase::clearTiles() {
+  for (const auto& pending : m_pendingTiles) {
+    pending.second->cancel();
   }
-
-  const QTransform xform(m_imageToVirtual * m_virtualToWidget);
-  const auto task = make_intrusive<HqTransformTask>(this, m_image, xform, viewport()->size());
-
-  backgroundExecutor().enqueueTask(task);
-
-  m_hqTransformTask = task;
-  m_hqXform = xform;
-  m_hqSourceId = m_image.cacheKey();
+  m_pendingTiles.clear();
+  m_tiles.clear();
+  m_tileCacheBytes = 0;
+  m_tileLevel = NO_TILE_LEVEL;
 }
 
 /**
- * Gets called from HqTransformationTask::Result.
+ * Gets called from TileTask::Result.
  */
-void ImageViewBase::hqVersionBuilt(const QPoint& origin, const QImage& image) {
+void ImageViewBase::tileBuilt(const TileKey& key, const QRect& rect, const QImage& image) {
+  const auto pending_it = m_pendingTiles.find(key);
+  if (pending_it == m_pendingTiles.end()) {
+    return;
+  }
+  m_pendingTiles.erase(pending_it);
+
   if (!m_hqTransformEnabled) {
     return;
   }
 
-  m_hqPixmap = QPixmap::fromImage(image);
-  m_hqPixmapPos = origin;
-  m_hqTransformTask.reset();
+  Tile& tile = m_tiles[key];
+  tile.rect = rect;
+  tile.pixmap = QPixmap::fromImage(image);
+  tile.lastUsed = ++m_tileUseCounter;
+  m_tileCacheBytes += qint64(tile.pixmap.width()) * tile.pixmap.height() * 4;
+
+  // Evict the least recently drawn tiles.
+  while ((m_tileCacheBytes > MAX_TILE_CACHE_BYTES) && (m_tiles.size() > 1)) {
+    auto lru_it = m_tiles.begin();
+    for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+      if (it->second.lastUsed < lru_it->second.lastUsed) {
+        lru_it = it;
+      }
+    }
+    m_tileCacheBytes -= qint64(lru_it->second.pixmap.width()) * lru_it->second.pixmap.height() * 4;
+    m_tiles.erase(lru_it);
+  }
+
   update();
-}
+}  // ImageViewBase::tileBuilt
 
 void ImageViewBase::updateStatusTipAndCursor() {
   updateStatusTip();
@@ -1011,24 +1177,22 @@ ImageViewInfoProvider& ImageViewBase::infoProvider() {
   return m_infoProvider;
 }
 
-/*==================== ImageViewBase::HqTransformTask ======================*/
+/*======================= ImageViewBase::TileTask =========================*/
 
-ImageViewBase::HqTransformTask::HqTransformTask(ImageViewBase* image_view,
-                                                const QImage& image,
-                                                const QTransform& xform,
-                                                const QSize& target_size)
-    : m_result(new Result(image_view)), m_image(image), m_xform(xform), m_targetSize(target_size) {}
+ImageViewBase::TileTask::TileTask(ImageViewBase* image_view,
+                                  const QImage& image,
+                                  const QTransform& xform,
+                                  const QRect& target_rect,
+                                  const TileKey& key)
+    : m_result(new Result(image_view, key, target_rect)), m_image(image), m_xform(xform), m_targetRect(target_rect) {}
 
-intrusive_ptr<AbstractCommand<void>> ImageViewBase::HqTransformTask::operator()() {
+intrusive_ptr<AbstractCommand<void>> ImageViewBase::TileTask::operator()() {
   if (isCancelled()) {
     return nullptr;
   }
 
-  const QRect target_rect(
-      m_xform.map(QRectF(m_image.rect())).boundingRect().toRect().intersected(QRect(QPoint(0, 0), m_targetSize)));
-
   QImage hq_image(
-      transform(m_image, m_xform, target_rect, OutsidePixels::assumeWeakColor(Qt::white), QSizeF(0.0, 0.0)));
+      transform(m_image, m_xform, m_targetRect, OutsidePixels::assumeWeakColor(Qt::white), QSizeF(0.0, 0.0)));
 
   // In many cases m_image and therefore hq_image are grayscale with
   // a palette, but given that hq_image will be converted to a QPixmap
@@ -1037,23 +1201,23 @@ intrusive_ptr<AbstractCommand<void>> ImageViewBase::HqTransformTask::operator()(
   hq_image = hq_image.convertToFormat(hq_image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
                                                                  : QImage::Format_RGB32);
 
-  m_result->setData(target_rect.topLeft(), hq_image);
+  m_result->setData(hq_image);
 
   return m_result;
 }
 
-/*================ ImageViewBase::HqTransformTask::Result ================*/
+/*==================== ImageViewBase::TileTask::Result ====================*/
 
-ImageViewBase::HqTransformTask::Result::Result(ImageViewBase* image_view) : m_imageView(image_view) {}
+ImageViewBase::TileTask::Result::Result(ImageViewBase* image_view, const TileKey& key, const QRect& rect)
+    : m_imageView(image_view), m_key(key), m_rect(rect) {}
 
-void ImageViewBase::HqTransformTask::Result::setData(const QPoint& origin, const QImage& hq_image) {
+void ImageViewBase::TileTask::Result::setData(const QImage& hq_image) {
   m_hqImage = hq_image;
-  m_origin = origin;
 }
 
-void ImageViewBase::HqTransformTask::Result::operator()() {
+void ImageViewBase::TileTask::Result::operator()() {
   if (m_imageView && !isCancelled()) {
-    m_imageView->hqVersionBuilt(m_origin, m_hqImage);
+    m_imageView->tileBuilt(m_key, m_rect, m_hqImage);
   }
 }
 
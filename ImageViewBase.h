@@ -24,6 +24,7 @@
 #include <QPixmap>
 #include <QPoint>
 #include <QPointF>
+#include <QRect>
 #include <QRectF>
 #include <QSizeF>
 #include <QString>
@@ -31,6 +32,8 @@
 #include <QTransform>
 #include <QWidget>
 #include <Qt>
+#include <map>
+#include <vector>
 #include "ImagePixmapUnion.h"
 #include "ImageViewInfoProvider.h"
 #include "InteractionHandler.h"
@@ -56,6 +59,13 @@ class ImagePresentation;
  *     pre-transformed m_image the way we want.
  * \li Widget coordinates, where this->rect() is defined.
  *
+ * The high quality version is rendered as a pyramid of tiles.  Each level
+ * of the pyramid is the virtual image scaled by a power of sqrt(2), and is
+ * split into square tiles, built on demand in a background thread.  The tiles
+ * of the level closest to the current zoom from above are drawn over m_pixmap,
+ * so that panning, and zooming within a level, only renders the tiles
+ * getting exposed.
+ *
  * \see m_pixmapToImage, m_imageToVirt, m_virtualToWidget, m_widgetToVirtual.
  */
 class ImageViewBase : public QAbstractScrollArea {
@@ -279,7 +289,7 @@ class ImageViewBase : public QAbstractScrollArea {
   void reactToScrollBars();
 
  private:
-  class HqTransformTask;
+  class TileTask;
   class TempFocalPointAdjuster;
 
   class TransformChangeWatcher;
@@ -300,11 +310,49 @@ class ImageViewBase : public QAbstractScrollArea {
 
   QPointF centeredWidgetFocalPoint() const;
 
-  bool validateHqPixmap() const;
+  /**
+   * \brief Identifies a tile of the high quality version.
+   *
+   * The tile covers the rectangle of TILE_SIZE x TILE_SIZE pixels
+   * at (col, row) * TILE_SIZE in the coordinates of its level.
+   */
+  struct TileKey {
+    int level;
+    int col;
+    int row;
+
+    bool operator<(const TileKey& other) const;
+  };
+
+  struct Tile {
+    /** The area of the tile covered by the image, in level coordinates. */
+    QRect rect;
+    QPixmap pixmap;
+    quint64 lastUsed;
+  };
+
+  static double tileLevelScale(int level);
+
+  static QRect tileRect(const TileKey& key);
+
+  int currentTileLevel() const;
+
+  /**
+   * \brief Drops the tiles if the image or its pre-transformation changed.
+   */
+  void validateTiles();
+
+  std::vector<TileKey> visibleTiles(int level) const;
+
+  void drawTiles(QPainter& painter, int level);
 
-  void scheduleHqVersionRebuild();
+  void requestTiles(int level);
 
-  void hqVersionBuilt(const QPoint& origin, const QImage& image);
+  void scheduleHqVersionRebuild(int level);
+
+  void clearTiles();
+
+  void tileBuilt(const TileKey& key, const QRect& rect, const QImage& image);
 
   void updateStatusTipAndCursor();
 
@@ -326,7 +374,7 @@ class ImageViewBase : public QAbstractScrollArea {
 
   /**
    * This timer is used for delaying the construction of
-   * a high quality image version.
+   * the high quality tiles when zooming.
    */
   QTimer m_timer;
 
@@ -337,37 +385,49 @@ class ImageViewBase : public QAbstractScrollArea {
   QPixmap m_pixmap;
 
   /**
-   * The high quality, pre-transformed version of m_pixmap.
+   * The tiles of the high quality, pre-transformed versions of m_image,
+   * of all zoom levels.
+   */
+  std::map<TileKey, Tile> m_tiles;
+
+  /**
+   * The tiles being built.  Only the ones for the current level
+   * that are still visible are kept, the rest are cancelled.
+   */
+  std::map<TileKey, intrusive_ptr<TileTask>> m_pendingTiles;
+
+  /**
+   * The memory taken by the pixmaps in m_tiles, in bytes.
    */
-  QPixmap m_hqPixmap;
+  qint64 m_tileCacheBytes;
 
   /**
-   * The position, in widget coordinates, where m_hqPixmap is to be drawn.
+   * Incremented every time a tile is drawn, for evicting
+   * the least recently used ones.
    */
-  QPoint m_hqPixmapPos;
+  quint64 m_tileUseCounter;
 
   /**
-   * The transformation used to build m_hqPixmap.
-   * It's used to detect if m_hqPixmap needs to be rebuild.
+   * The level the tiles are requested for.  A level different from
+   * currentTileLevel() means a zoom in progress.
    */
-  QTransform m_hqXform;
+  int m_tileLevel;
 
   /**
-   * Used to check if we need to extend the delay before building m_hqPixmap.
+   * Used to check if we need to extend the delay before requesting the tiles
+   * for a new level.
    */
-  QTransform m_potentialHqXform;
+  int m_potentialTileLevel;
 
   /**
-   * The ID (QImage::cacheKey()) of the image that was used
-   * to build m_hqPixmap.  It's used to detect if m_hqPixmap
-   * needs to be rebuilt.
+   * The m_imageToVirtual the tiles were built for.
    */
-  qint64 m_hqSourceId;
+  QTransform m_tilesImageToVirtual;
 
   /**
-   * The pending (if any) high quality transformation task.
+   * The ID (QImage::cacheKey()) of the image the tiles were built from.
    */
-  intrusive_ptr<HqTransformTask> m_hqTransformTask;
+  qint64 m_tilesSourceId;
 
   /**
    * Transformation from m_pixmap coordinates to m_image coordinates.
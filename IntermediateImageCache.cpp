@@ -0,0 +1,388 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "IntermediateImageCache.h"
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QSettings>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <utility>
+#include <vector>
+#include "AtomicFileOverwriter.h"
+#include "NonCopyable.h"
+
+namespace {
+const quint32 MAGIC = 0x53544932;  // "STI2"
+
+// Each of these holds a full resolution image in memory.
+const int MAX_PENDING_WRITES = 4;
+
+const int SHA1_HEX_LENGTH = 40;
+
+int defaultCacheSizeMb() {
+  return 4096;
+}
+
+class WriterPool : public QThreadPool {
+ public:
+  // A single thread is enough to keep the disk busy.
+  WriterPool() { setMaxThreadCount(1); }
+};
+
+QThreadPool& writerPool() {
+  // Its destructor waits for the pending writes to finish.
+  static WriterPool pool;
+
+  return pool;
+}
+
+QAtomicInt numPendingWrites;
+}  // namespace
+
+/**
+ * \brief Process-wide bookkeeping of the entries in a cache directory,
+ *        for the purpose of removing the least recently used ones.
+ *
+ * The directory is scanned when the first entry is added.  Entries found
+ * that way are ordered by their last access or modification time.
+ */
+class IntermediateImageCache::Index {
+  DECLARE_NON_COPYABLE(Index)
+
+ public:
+  static std::shared_ptr<Index> forDir(const QString& dir);
+
+  void touched(const QString& file_path);
+
+  /**
+   * \brief Records a new entry, then removes the least recently used
+   *        ones to fit into the size limit.
+   */
+  void added(const QString& file_path, qint64 size);
+
+ private:
+  struct Entry {
+    QString filePath;
+    qint64 size;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  explicit Index(const QString& dir);
+
+  /**
+   * Must be called with m_mutex locked, as the rest of the methods below.
+   */
+  void scanIfNecessary();
+
+  void insertFront(const QString& file_path, qint64 size);
+
+  void removeEntry(EntryList::iterator it);
+
+  const QString m_dir;
+  const qint64 m_maxBytes;
+  QMutex m_mutex;
+  EntryList m_entries;  // Most recently used first.
+  QHash<QString, EntryList::iterator> m_entryByPath;
+  qint64 m_totalBytes;
+  bool m_scanned;
+};
+
+
+class IntermediateImageCache::Writer : public QRunnable {
+ public:
+  Writer(std::shared_ptr<Index> index, const QString& file_path, const QImage& image)
+      : m_index(std::move(index)), m_filePath(file_path), m_image(image) {
+    setAutoDelete(true);
+  }
+
+  ~Writer() override { numPendingWrites.deref(); }
+
+  void run() override;
+
+ private:
+  bool write() const;
+
+  std::shared_ptr<Index> m_index;
+  QString m_filePath;
+  QImage m_image;
+};
+
+
+IntermediateImageCache::IntermediateImageCache(const QString& cache_dir)
+    : m_cacheDir(QDir(cache_dir).absolutePath()), m_index(Index::forDir(m_cacheDir)) {}
+
+IntermediateImageCache::~IntermediateImageCache() = default;
+
+bool IntermediateImageCache::isEnabled() {
+  return QSettings().value("settings/intermediate_cache", false).toBool();
+}
+
+QImage IntermediateImageCache::load(const ImageId& image_id, const QByteArray& params) const {
+  const QString file_path(filePathFor(image_id, params));
+  if (file_path.isEmpty()) {
+    return QImage();
+  }
+
+  QFile file(file_path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QImage();
+  }
+
+  QDataStream strm(&file);
+  quint32 magic = 0;
+  qint32 format = 0, width = 0, height = 0, dpm_x = 0, dpm_y = 0;
+  QVector<QRgb> color_table;
+  strm >> magic >> format >> width >> height >> dpm_x >> dpm_y >> color_table;
+  if ((strm.status() != QDataStream::Ok) || (magic != MAGIC) || (format <= QImage::Format_Invalid)
+      || (format >= QImage::NImageFormats) || (width <= 0) || (height <= 0)) {
+    return QImage();
+  }
+
+  QByteArray compressed;
+  strm >> compressed;
+  if (strm.status() != QDataStream::Ok) {
+    return QImage();
+  }
+
+  QImage image(width, height, static_cast<QImage::Format>(format));
+  if (image.isNull()) {
+    return QImage();
+  }
+  image.setColorTable(color_table);
+  image.setDotsPerMeterX(dpm_x);
+  image.setDotsPerMeterY(dpm_y);
+
+  const int line_bytes = (image.depth() * width + 7) / 8;
+  const QByteArray data(qUncompress(compressed));
+  if (data.size() != qint64(line_bytes) * height) {
+    return QImage();
+  }
+  const char* line = data.constData();
+  for (int y = 0; y < height; ++y, line += line_bytes) {
+    std::memcpy(image.scanLine(y), line, static_cast<size_t>(line_bytes));
+  }
+
+  m_index->touched(file_path);
+
+  return image;
+}  // IntermediateImageCache::load
+
+void IntermediateImageCache::store(const ImageId& image_id, const QByteArray& params, const QImage& image) const {
+  if (image.isNull()) {
+    return;
+  }
+
+  const qint64 line_bytes = (image.depth() * image.width() + 7) / 8;
+  if (line_bytes * image.height() > std::numeric_limits<int>::max()) {
+    // Too large for QByteArray.
+    return;
+  }
+
+  const QString file_path(filePathFor(image_id, params));
+  if (file_path.isEmpty()) {
+    return;
+  }
+
+  if (numPendingWrites.fetchAndAddOrdered(1) >= MAX_PENDING_WRITES) {
+    // The disk can't keep up.  Better skip caching than hold
+    // all those images in memory.
+    numPendingWrites.deref();
+    return;
+  }
+  // QImage is implicitly shared, so this doesn't copy the pixels.
+  writerPool().start(new Writer(m_index, file_path, image));
+}
+
+QString IntermediateImageCache::filePathFor(const ImageId& image_id, const QByteArray& params) const {
+  const QFileInfo file_info(image_id.filePath());
+  if (!file_info.exists()) {
+    return QString();
+  }
+
+  QByteArray file_identity;
+  {
+    QDataStream strm(&file_identity, QIODevice::WriteOnly);
+    strm << file_info.absoluteFilePath() << qint32(image_id.page()) << file_info.lastModified()
+         << qint64(file_info.size());
+  }
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(file_identity);
+  hash.addData(params);
+  const QString name(QString::fromLatin1(hash.result().toHex()));
+
+  // Spread entries over subdirectories to keep directory sizes sane.
+  return m_cacheDir + QLatin1Char('/') + name.left(2) + QLatin1Char('/') + name;
+}
+
+/*============================ Writer ================================*/
+
+void IntermediateImageCache::Writer::run() {
+  if (write()) {
+    m_index->added(m_filePath, QFileInfo(m_filePath).size());
+  }
+}
+
+bool IntermediateImageCache::Writer::write() const {
+  if (!QDir().mkpath(QFileInfo(m_filePath).absolutePath())) {
+    return false;
+  }
+
+  const int line_bytes = (m_image.depth() * m_image.width() + 7) / 8;
+  QByteArray data;
+  data.reserve(line_bytes * m_image.height());
+  for (int y = 0; y < m_image.height(); ++y) {
+    data.append(reinterpret_cast<const char*>(m_image.scanLine(y)), line_bytes);
+  }
+  // The lowest compression level is nearly as fast as plain copying,
+  // yet shrinks the mostly flat intermediate images considerably.
+  const QByteArray compressed(qCompress(data, 1));
+  data.clear();
+  if (compressed.isEmpty()) {
+    return false;
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* const device = overwriter.startWriting(m_filePath);
+  if (!device) {
+    return false;
+  }
+
+  QDataStream strm(device);
+  strm << MAGIC << qint32(m_image.format()) << qint32(m_image.width()) << qint32(m_image.height())
+       << qint32(m_image.dotsPerMeterX()) << qint32(m_image.dotsPerMeterY()) << m_image.colorTable() << compressed;
+  if (strm.status() != QDataStream::Ok) {
+    return false;
+  }
+
+  return overwriter.commit();
+}
+
+/*============================ Index ================================*/
+
+std::shared_ptr<IntermediateImageCache::Index> IntermediateImageCache::Index::forDir(const QString& dir) {
+  static QMutex mutex;
+  // Kept alive, as the caches come and go with the tasks using them,
+  // and scanning the directory every time would be a waste.
+  static QHash<QString, std::shared_ptr<Index>> indexes;
+
+  const QMutexLocker locker(&mutex);
+  std::shared_ptr<Index> index(indexes.value(dir));
+  if (!index) {
+    index.reset(new Index(dir));
+    indexes[dir] = index;
+  }
+
+  return index;
+}
+
+IntermediateImageCache::Index::Index(const QString& dir)
+    : m_dir(dir),
+      m_maxBytes(qint64(std::max(0, QSettings().value("settings/intermediate_cache_mb", defaultCacheSizeMb()).toInt()))
+                 * 1024 * 1024),
+      m_totalBytes(0),
+      m_scanned(false) {}
+
+void IntermediateImageCache::Index::touched(const QString& file_path) {
+  const QMutexLocker locker(&m_mutex);
+
+  // Not worth scanning the directory on the critical path.
+  const auto it(m_entryByPath.find(file_path));
+  if (it != m_entryByPath.end()) {
+    m_entries.splice(m_entries.begin(), m_entries, it.value());
+  }
+}
+
+void IntermediateImageCache::Index::added(const QString& file_path, const qint64 size) {
+  const QMutexLocker locker(&m_mutex);
+
+  scanIfNecessary();
+
+  const auto it(m_entryByPath.find(file_path));
+  if (it != m_entryByPath.end()) {
+    removeEntry(it.value());
+  }
+  insertFront(file_path, size);
+
+  while ((m_totalBytes > m_maxBytes) && (m_entries.size() > 1)) {
+    const auto last(std::prev(m_entries.end()));
+    QFile::remove(last->filePath);
+    removeEntry(last);
+  }
+}
+
+void IntermediateImageCache::Index::scanIfNecessary() {
+  if (m_scanned) {
+    return;
+  }
+  m_scanned = true;
+
+  struct FoundEntry {
+    QString filePath;
+    qint64 size;
+    QDateTime lastUsed;
+  };
+  std::vector<FoundEntry> found;
+
+  QDirIterator it(m_dir, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext()) {
+    it.next();
+    const QFileInfo file_info(it.fileInfo());
+    if (file_info.fileName().size() != SHA1_HEX_LENGTH) {
+      // Most likely a leftover temporary file.
+      continue;
+    }
+    found.push_back({file_info.absoluteFilePath(), file_info.size(),
+                     std::max(file_info.lastRead(), file_info.lastModified())});
+  }
+
+  // Most recently used first, as in m_entries.
+  std::sort(found.begin(), found.end(),
+            [](const FoundEntry& lhs, const FoundEntry& rhs) { return lhs.lastUsed > rhs.lastUsed; });
+  for (const FoundEntry& entry : found) {
+    m_entries.push_back({entry.filePath, entry.size});
+    m_entryByPath[entry.filePath] = std::prev(m_entries.end());
+    m_totalBytes += entry.size;
+  }
+}
+
+void IntermediateImageCache::Index::insertFront(const QString& file_path, const qint64 size) {
+  m_entries.push_front({file_path, size});
+  m_entryByPath[file_path] = m_entries.begin();
+  m_totalBytes += size;
+}
+
+void IntermediateImageCache::Index::removeEntry(const EntryList::iterator it) {
+  m_totalBytes -= it->size;
+  m_entryByPath.remove(it->filePath);
+  m_entries.erase(it);
+}
@@ -0,0 +1,76 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INTERMEDIATE_IMAGE_CACHE_H_
+#define INTERMEDIATE_IMAGE_CACHE_H_
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <memory>
+#include "ImageId.h"
+
+/**
+ * \brief A persistent, content-addressed store of intermediate images.
+ *
+ * Entries are addressed by a hash of the source file's identity
+ * (path, page, modification time and size) together with an arbitrary
+ * blob of parameters the intermediate image depends on.  Changing either
+ * the file or any of the parameters naturally produces a different key,
+ * so entries never have to be invalidated explicitly.
+ *
+ * Images are stored with fast zlib compression, as fast re-loading is
+ * the whole point.  Storing happens on a background thread, and is skipped
+ * if too many images are waiting to be written already.  The total size
+ * of the cache directory is bounded by settings/intermediate_cache_mb,
+ * with the least recently used entries removed first.
+ * The cache is disabled unless settings/intermediate_cache is set.
+ *
+ * Instances may be used from multiple threads concurrently.
+ */
+class IntermediateImageCache {
+ public:
+  explicit IntermediateImageCache(const QString& cache_dir);
+
+  ~IntermediateImageCache();
+
+  static bool isEnabled();
+
+  /**
+   * \return The stored image, or a null one if there is no such entry.
+   */
+  QImage load(const ImageId& image_id, const QByteArray& params) const;
+
+  /**
+   * \brief Queues the image for writing and returns immediately.
+   */
+  void store(const ImageId& image_id, const QByteArray& params, const QImage& image) const;
+
+ private:
+  class Index;
+  class Writer;
+
+  QString filePathFor(const ImageId& image_id, const QByteArray& params) const;
+
+  QString m_cacheDir;
+  std::shared_ptr<Index> m_index;
+};
+
+
+#endif  // ifndef INTERMEDIATE_IMAGE_CACHE_H_
@@ -0,0 +1,44 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "JpegOutputOptions.h"
+#include <QSettings>
+#include "CommandLine.h"
+
+JpegOutputOptions::JpegOutputOptions() : m_enabled(false), m_quality(90), m_subsampling(JpegWriter::SUBSAMPLING_420) {}
+
+JpegOutputOptions JpegOutputOptions::fromSettings() {
+  QSettings settings;
+  JpegOutputOptions options;
+  options.setEnabled(settings.value("settings/jpeg_output", options.isEnabled()).toBool());
+  options.setQuality(settings.value("settings/jpeg_quality", options.quality()).toInt());
+  options.setSubsampling(static_cast<JpegWriter::Subsampling>(
+      settings.value("settings/jpeg_subsampling", options.subsampling()).toInt()));
+
+  return options;
+}
+
+JpegOutputOptions JpegOutputOptions::current() {
+  const CommandLine& cli = CommandLine::get();
+  if (cli.hasJpegOutputOptions()) {
+    return cli.getJpegOutputOptions();
+  }
+
+  return fromSettings();
+}
@@ -0,0 +1,66 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef JPEG_OUTPUT_OPTIONS_H_
+#define JPEG_OUTPUT_OPTIONS_H_
+
+#include "JpegWriter.h"
+
+/**
+ * \brief Whether color, grayscale and mixed output pages are written as JPEG
+ *        rather than TIFF, and how.
+ *
+ * Black and white pages, as well as pages split into layers, are always
+ * written as TIFF, as JPEG would only damage them.
+ */
+class JpegOutputOptions {
+ public:
+  JpegOutputOptions();
+
+  /**
+   * \brief The options as set in the settings dialog.
+   */
+  static JpegOutputOptions fromSettings();
+
+  /**
+   * \brief The options given on the command line, if any, or the ones
+   *        from the settings otherwise.
+   */
+  static JpegOutputOptions current();
+
+  bool isEnabled() const { return m_enabled; }
+
+  void setEnabled(bool enabled) { m_enabled = enabled; }
+
+  int quality() const { return m_quality; }
+
+  void setQuality(int quality) { m_quality = quality; }
+
+  JpegWriter::Subsampling subsampling() const { return m_subsampling; }
+
+  void setSubsampling(JpegWriter::Subsampling subsampling) { m_subsampling = subsampling; }
+
+ private:
+  bool m_enabled;
+  int m_quality;
+  JpegWriter::Subsampling m_subsampling;
+};
+
+
+#endif  // ifndef JPEG_OUTPUT_OPTIONS_H_
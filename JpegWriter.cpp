@@ -0,0 +1,270 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "JpegWriter.h"
+#include <QFile>
+#include <QImage>
+#include <QIODevice>
+#include <algorithm>
+#include <csetjmp>
+#include "Dpi.h"
+#include "Dpm.h"
+#include "NonCopyable.h"
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace {
+/*========================= JpegCompressHandle ==========================*/
+
+class JpegCompressHandle {
+  DECLARE_NON_COPYABLE(JpegCompressHandle)
+
+ public:
+  JpegCompressHandle(jpeg_error_mgr* err_mgr, jpeg_destination_mgr* dest_mgr);
+
+  ~JpegCompressHandle();
+
+  jpeg_compress_struct* ptr() { return &m_info; }
+
+  jpeg_compress_struct* operator->() { return &m_info; }
+
+ private:
+  jpeg_compress_struct m_info{};
+};
+
+
+JpegCompressHandle::JpegCompressHandle(jpeg_error_mgr* err_mgr, jpeg_destination_mgr* dest_mgr) {
+  m_info.err = err_mgr;
+  jpeg_create_compress(&m_info);
+  m_info.dest = dest_mgr;
+}
+
+JpegCompressHandle::~JpegCompressHandle() {
+  jpeg_destroy_compress(&m_info);
+}
+
+/*======================== JpegDestinationManager =======================*/
+
+class JpegDestinationManager : public jpeg_destination_mgr {
+  DECLARE_NON_COPYABLE(JpegDestinationManager)
+
+ public:
+  explicit JpegDestinationManager(QIODevice& io_device);
+
+  bool hasFailed() const { return m_failed; }
+
+ private:
+  static void initDestination(j_compress_ptr cinfo);
+
+  static boolean emptyOutputBuffer(j_compress_ptr cinfo);
+
+  boolean emptyOutputBufferImpl();
+
+  static void termDestination(j_compress_ptr cinfo);
+
+  void termDestinationImpl();
+
+  static JpegDestinationManager* object(j_compress_ptr cinfo);
+
+  QIODevice& m_device;
+  bool m_failed;
+  JOCTET m_buf[65536]{};
+};
+
+
+JpegDestinationManager::JpegDestinationManager(QIODevice& io_device)
+    : jpeg_destination_mgr(), m_device(io_device), m_failed(false) {
+  init_destination = &JpegDestinationManager::initDestination;
+  empty_output_buffer = &JpegDestinationManager::emptyOutputBuffer;
+  term_destination = &JpegDestinationManager::termDestination;
+  next_output_byte = m_buf;
+  free_in_buffer = sizeof(m_buf);
+}
+
+void JpegDestinationManager::initDestination(j_compress_ptr cinfo) {
+  // No-op.
+}
+
+boolean JpegDestinationManager::emptyOutputBuffer(j_compress_ptr cinfo) {
+  return object(cinfo)->emptyOutputBufferImpl();
+}
+
+boolean JpegDestinationManager::emptyOutputBufferImpl() {
+  // Note that libjpeg ignores free_in_buffer here and expects
+  // the whole buffer to be written.
+  if (m_device.write((const char*) m_buf, sizeof(m_buf)) != qint64(sizeof(m_buf))) {
+    m_failed = true;
+  }
+  next_output_byte = m_buf;
+  free_in_buffer = sizeof(m_buf);
+
+  return 1;
+}
+
+void JpegDestinationManager::termDestination(j_compress_ptr cinfo) {
+  object(cinfo)->termDestinationImpl();
+}
+
+void JpegDestinationManager::termDestinationImpl() {
+  const qint64 size = qint64(sizeof(m_buf) - free_in_buffer);
+  if ((size > 0) && (m_device.write((const char*) m_buf, size) != size)) {
+    m_failed = true;
+  }
+}
+
+JpegDestinationManager* JpegDestinationManager::object(j_compress_ptr cinfo) {
+  return static_cast<JpegDestinationManager*>(cinfo->dest);
+}
+
+/*============================= JpegErrorManager ===========================*/
+
+class JpegErrorManager : public jpeg_error_mgr {
+  DECLARE_NON_COPYABLE(JpegErrorManager)
+
+ public:
+  JpegErrorManager();
+
+  jmp_buf& jmpBuf() { return m_jmpBuf; }
+
+ private:
+  static void errorExit(j_common_ptr cinfo);
+
+  static JpegErrorManager* object(j_common_ptr cinfo);
+
+  jmp_buf m_jmpBuf{};
+};
+
+
+JpegErrorManager::JpegErrorManager() : jpeg_error_mgr() {
+  jpeg_std_error(this);
+  error_exit = &JpegErrorManager::errorExit;
+}
+
+void JpegErrorManager::errorExit(j_common_ptr cinfo) {
+  longjmp(object(cinfo)->jmpBuf(), 1);
+}
+
+JpegErrorManager* JpegErrorManager::object(j_common_ptr cinfo) {
+  return static_cast<JpegErrorManager*>(cinfo->err);
+}
+
+void setSubsampling(jpeg_compress_struct* cinfo, const JpegWriter::Subsampling subsampling) {
+  // The chroma components are the 2nd and the 3rd ones.
+  // The luma one's sampling factors are relative to them.
+  int h_factor = 1;
+  int v_factor = 1;
+  switch (subsampling) {
+    case JpegWriter::SUBSAMPLING_444:
+      break;
+    case JpegWriter::SUBSAMPLING_422:
+      h_factor = 2;
+      break;
+    case JpegWriter::SUBSAMPLING_420:
+      h_factor = 2;
+      v_factor = 2;
+      break;
+  }
+  cinfo->comp_info[0].h_samp_factor = h_factor;
+  cinfo->comp_info[0].v_samp_factor = v_factor;
+  for (int i = 1; i < cinfo->num_components; ++i) {
+    cinfo->comp_info[i].h_samp_factor = 1;
+    cinfo->comp_info[i].v_samp_factor = 1;
+  }
+}
+}  // namespace
+
+/*================================ JpegWriter ==============================*/
+
+bool JpegWriter::writeImage(const QString& file_path,
+                            const QImage& image,
+                            const int quality,
+                            const Subsampling subsampling) {
+  if (image.isNull()) {
+    return false;
+  }
+
+  QFile file(file_path);
+  if (!file.open(QFile::WriteOnly)) {
+    return false;
+  }
+
+  if (!writeImage(file, image, quality, subsampling)) {
+    file.remove();
+
+    return false;
+  }
+
+  return true;
+}
+
+bool JpegWriter::writeImage(QIODevice& device, const QImage& image, const int quality, const Subsampling subsampling) {
+  if (image.isNull()) {
+    return false;
+  }
+  if (!device.isWritable()) {
+    return false;
+  }
+
+  const bool grayscale = image.allGray();
+  const QImage src(grayscale ? image.convertToFormat(QImage::Format_Grayscale8)
+                             : image.convertToFormat(QImage::Format_RGB888));
+  const Dpm dpm(image);
+
+  // Everything below is subject to longjmp(), so no objects with
+  // non-trivial destructors may be created after setjmp().
+  JpegErrorManager err_mgr;
+  JpegDestinationManager dest_mgr(device);
+  JpegCompressHandle cinfo(&err_mgr, &dest_mgr);
+  if (setjmp(err_mgr.jmpBuf())) {
+    // Returning from longjmp().
+    return false;
+  }
+
+  cinfo->image_width = static_cast<JDIMENSION>(src.width());
+  cinfo->image_height = static_cast<JDIMENSION>(src.height());
+  cinfo->input_components = grayscale ? 1 : 3;
+  cinfo->in_color_space = grayscale ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_set_defaults(cinfo.ptr());
+  jpeg_set_quality(cinfo.ptr(), std::max(1, std::min(quality, 100)), 1);
+  if (!grayscale) {
+    setSubsampling(cinfo.ptr(), subsampling);
+  }
+  cinfo->optimize_coding = 1;
+
+  if (!dpm.isNull()) {
+    // Dots per inch, as centimeters would lose precision at the usual resolutions.
+    const Dpi dpi(dpm);
+    cinfo->write_JFIF_header = 1;
+    cinfo->density_unit = 1;
+    cinfo->X_density = static_cast<UINT16>(std::min(dpi.horizontal(), 0xffff));
+    cinfo->Y_density = static_cast<UINT16>(std::min(dpi.vertical(), 0xffff));
+  }
+
+  jpeg_start_compress(cinfo.ptr(), 1);
+  while (cinfo->next_scanline < cinfo->image_height) {
+    // libjpeg doesn't modify the data, despite taking a non-const pointer.
+    auto* line = const_cast<JSAMPLE*>(src.constScanLine(static_cast<int>(cinfo->next_scanline)));
+    jpeg_write_scanlines(cinfo.ptr(), &line, 1);
+  }
+  jpeg_finish_compress(cinfo.ptr());
+
+  return !dest_mgr.hasFailed();
+}  // JpegWriter::writeImage
@@ -0,0 +1,60 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef JPEG_WRITER_H_
+#define JPEG_WRITER_H_
+
+class QIODevice;
+class QString;
+class QImage;
+
+class JpegWriter {
+ public:
+  /**
+   * \brief The resolution of the chroma components relative to the luma one.
+   */
+  enum Subsampling { SUBSAMPLING_444, SUBSAMPLING_422, SUBSAMPLING_420 };
+
+  /**
+   * \brief Writes a QImage in JPEG format to a file.
+   *
+   * Grayscale images (including indexed ones with a grayscale palette)
+   * are written with a single component, everything else as YCbCr.
+   * Any alpha channel is dropped.
+   *
+   * \param file_path The full path to the file.
+   * \param image The image to write.  Writing a null image will fail.
+   * \param quality The libjpeg quality, 1 to 100.
+   * \param subsampling The chroma subsampling.  Ignored for grayscale images.
+   * \return True on success, false on failure.
+   */
+  static bool writeImage(const QString& file_path, const QImage& image, int quality, Subsampling subsampling);
+
+  /**
+   * \brief Writes a QImage in JPEG format to an IO device.
+   *
+   * \param device The device to write to.  This device must be
+   *        opened for writing.
+   * \see writeImage(const QString&, const QImage&, int, Subsampling)
+   */
+  static bool writeImage(QIODevice& device, const QImage& image, int quality, Subsampling subsampling);
+};
+
+
+#endif  // ifndef JPEG_WRITER_H_
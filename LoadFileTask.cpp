@@ -21,12 +21,14 @@
 #include <QFile>
 #include <QTextDocument>
 #include "AbstractFilter.h"
+#include "DecodedImageCache.h"
 #include "Dpm.h"
 #include "ErrorWidget.h"
 #include "FilterData.h"
 #include "FilterOptionsWidget.h"
 #include "FilterUiInterface.h"
 #include "ImageLoader.h"
+#include "ImagePrefetcher.h"
 #include "ProjectPages.h"
 #include "ThumbnailPixmapCache.h"
 #include "filters/fix_orientation/Task.h"
@@ -52,20 +54,50 @@ LoadFileTask::LoadFileTask(Type type,
                            const PageInfo& page,
                            intrusive_ptr<ThumbnailPixmapCache> thumbnail_cache,
                            intrusive_ptr<ProjectPages> pages,
-                           intrusive_ptr<fix_orientation::Task> next_task)
+                           intrusive_ptr<fix_orientation::Task> next_task,
+                           const QImage& preloaded_image)
     : BackgroundTask(type),
       m_thumbnailCache(std::move(thumbnail_cache)),
       m_imageId(page.imageId()),
       m_imageMetadata(page.metadata()),
       m_pages(std::move(pages)),
-      m_nextTask(std::move(next_task)) {
+      m_nextTask(std::move(next_task)),
+      m_preloadedImage(preloaded_image) {
   assert(m_nextTask);
+
+  // The decoded image is kept as ARGB32 along with its grayscale version,
+  // plus some downscaled copies the analysis filters make.
+  const QSize& size = m_imageMetadata.size();
+  setMemoryFootprint(qint64(size.width()) * size.height() * 6);
 }
 
 LoadFileTask::~LoadFileTask() = default;
 
 FilterResultPtr LoadFileTask::operator()() {
-  QImage image(ImageLoader::load(m_imageId));
+  DecodedImageCache& decoded_cache = DecodedImageCache::instance();
+  if (m_preloadedImage.isNull()) {
+    if (const std::unique_ptr<FilterData> data = decoded_cache.find(m_imageId, m_imageMetadata.dpi())) {
+      // Let the prefetcher move on to the images that are needed.
+      ImagePrefetcher::instance().release(m_imageId);
+      try {
+        throwIfCancelled();
+
+        m_thumbnailCache->ensureThumbnailExists(m_imageId, data->origImage());
+
+        return m_nextTask->process(*this, *data);
+      } catch (const CancelledException&) {
+        return nullptr;
+      }
+    }
+  }
+
+  QImage image(m_preloadedImage);
+  if (image.isNull()) {
+    image = ImagePrefetcher::instance().take(m_imageId);
+  }
+  if (image.isNull()) {
+    image = ImageLoader::load(m_imageId);
+  }
 
   try {
     throwIfCancelled();
@@ -77,7 +109,10 @@ FilterResultPtr LoadFileTask::operator()() {
       overrideDpi(image);
       m_thumbnailCache->ensureThumbnailExists(m_imageId, image);
 
-      return m_nextTask->process(*this, FilterData(image));
+      const FilterData data(image);
+      decoded_cache.insert(m_imageId, m_imageMetadata.dpi(), data);
+
+      return m_nextTask->process(*this, data);
     }
   } catch (const CancelledException&) {
     return nullptr;
@@ -103,8 +138,12 @@ void LoadFileTask::overrideDpi(QImage& image) const {
   // Beware: QImage will have a default DPI when loading
   // an image that doesn't specify one.
   const Dpm dpm(m_imageMetadata.dpi());
-  image.setDotsPerMeterX(dpm.horizontal());
-  image.setDotsPerMeterY(dpm.vertical());
+  // Setting these detaches the image, which means copying the pixels
+  // of a preloaded one, so don't do that unless necessary.
+  if ((image.dotsPerMeterX() != dpm.horizontal()) || (image.dotsPerMeterY() != dpm.vertical())) {
+    image.setDotsPerMeterX(dpm.horizontal());
+    image.setDotsPerMeterY(dpm.vertical());
+  }
 }
 
 /*======================= LoadFileTask::ErrorResult ======================*/
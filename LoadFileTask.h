@@ -19,6 +19,7 @@
 #ifndef LOADFILETASK_H_
 #define LOADFILETASK_H_
 
+#include <QImage>
 #include "BackgroundTask.h"
 #include "FilterResult.h"
 #include "ImageId.h"
@@ -29,7 +30,6 @@
 class ThumbnailPixmapCache;
 class PageInfo;
 class ProjectPages;
-class QImage;
 
 namespace fix_orientation {
 class Task;
@@ -43,7 +43,8 @@ class LoadFileTask : public BackgroundTask {
                const PageInfo& page,
                intrusive_ptr<ThumbnailPixmapCache> thumbnail_cache,
                intrusive_ptr<ProjectPages> pages,
-               intrusive_ptr<fix_orientation::Task> next_task);
+               intrusive_ptr<fix_orientation::Task> next_task,
+               const QImage& preloaded_image = QImage());
 
   ~LoadFileTask() override;
 
@@ -61,6 +62,12 @@ class LoadFileTask : public BackgroundTask {
   ImageMetadata m_imageMetadata;
   const intrusive_ptr<ProjectPages> m_pages;
   const intrusive_ptr<fix_orientation::Task> m_nextTask;
+
+  /**
+   * If not null, this image is used instead of loading it from disk.
+   * That lets callers running several chains over the same image decode it only once.
+   */
+  const QImage m_preloadedImage;
 };
 
 
@@ -25,6 +25,7 @@
 #include <QScrollBar>
 #include <QSortFilterProxyModel>
 #include <QStackedLayout>
+#include <algorithm>
 #include <boost/lambda/lambda.hpp>
 #include "AbstractRelinker.h"
 #include "Application.h"
@@ -39,12 +40,15 @@
 #include "FilterOptionsWidget.h"
 #include "FixDpiDialog.h"
 #include "ImageInfo.h"
+#include "ImageMetadataCache.h"
 #include "ImageMetadataLoader.h"
+#include "ImagePrefetcher.h"
 #include "LoadFileTask.h"
 #include "LoadFilesStatusDialog.h"
 #include "NewOpenProjectPanel.h"
 #include "OutOfMemoryDialog.h"
 #include "OutOfMemoryHandler.h"
+#include "OutputContainer.h"
 #include "PageOrientationPropagator.h"
 #include "PageSelectionAccessor.h"
 #include "PageSequence.h"
@@ -68,6 +72,7 @@
 #include "UnitsProvider.h"
 #include "Utils.h"
 #include "WorkerThreadPool.h"
+#include "filter_dc/OutputUpToDateCollector.h"
 #include "filters/deskew/CacheDrivenTask.h"
 #include "filters/deskew/Task.h"
 #include "filters/fix_orientation/CacheDrivenTask.h"
@@ -335,6 +340,8 @@ void MainWindow::switchToNewProject(const intrusive_ptr<ProjectPages>& pages,
                                     const ProjectReader* project_reader) {
   stopBatchProcessing(CLEAR_MAIN_AREA);
   m_interactiveQueue->cancelAndClear();
+  // The output of the previous project is done with.
+  OutputContainer::compactAllIfWorthIt();
 
   if (!out_dir.isEmpty()) {
     Utils::maybeCreateCacheDir(out_dir);
@@ -1096,14 +1103,26 @@ void MainWindow::startBatchProcessing() {
 
   m_interactiveQueue->cancelAndClear();
 
+  // Pages whose output is up to date are found from the settings and
+  // file stats alone, so that their images don't have to be loaded.
+  m_batchUpToDateCheck.reset();
+  if (m_curFilter == m_stages->outputFilterIdx()) {
+    m_batchUpToDateCheck = createCompositeCacheDrivenTask(m_curFilter);
+  }
+
   m_batchQueue.reset(new ProcessingTaskQueue);
+  std::vector<ImageId> batch_images;
   PageInfo page(m_thumbSequence->selectionLeader());
   for (; !page.isNull(); page = m_thumbSequence->nextPage(page.id())) {
     for (int i = 0; i < m_stages->count(); i++) {
       m_stages->filterAt(i)->loadDefaultSettings(page);
     }
     m_batchQueue->addProcessingTask(page, createCompositeTask(page, m_curFilter, /*batch=*/true, m_debug));
+    batch_images.push_back(page.imageId());
   }
+  // Every processing thread should find its next image decoded.
+  const int num_threads = m_workerThreadPool->numThreads();
+  ImagePrefetcher::instance().setSequence(batch_images, std::max(2, num_threads), num_threads);
 
   focusButton->setChecked(true);
 
@@ -1111,14 +1130,14 @@ void MainWindow::startBatchProcessing() {
   filterList->setBatchProcessingInProgress(true);
   filterList->setEnabled(false);
 
-  BackgroundTaskPtr task(m_batchQueue->takeForProcessing());
+  BackgroundTaskPtr task(takeBatchTaskForProcessing());
   if (task) {
     do {
       m_workerThreadPool->submitTask(task);
       if (!m_workerThreadPool->hasSpareCapacity()) {
         break;
       }
-    } while ((task = m_batchQueue->takeForProcessing()));
+    } while ((task = takeBatchTaskForProcessing()));
   } else {
     stopBatchProcessing();
   }
@@ -1143,6 +1162,8 @@ void MainWindow::stopBatchProcessing(MainAreaAction main_area) {
 
   m_batchQueue->cancelAndClear();
   m_batchQueue.reset();
+  m_batchUpToDateCheck.reset();
+  ImagePrefetcher::instance().clear();
 
   filterList->setBatchProcessingInProgress(false);
   filterList->setEnabled(true);
@@ -1189,6 +1210,16 @@ void MainWindow::filterResult(const BackgroundTaskPtr& task, const FilterResultP
   result->updateUI(this);
 
   if (isBatchProcessingInProgress()) {
+    do {
+      const BackgroundTaskPtr task(takeBatchTaskForProcessing());
+      if (!task) {
+        break;
+      }
+      m_workerThreadPool->submitTask(task);
+    } while (m_workerThreadPool->hasSpareCapacity());
+
+    // Checked after taking more tasks, as the remaining ones may all
+    // have turned out to be up to date.
     if (m_batchQueue->allProcessed()) {
       stopBatchProcessing();
 
@@ -1216,14 +1247,6 @@ void MainWindow::filterResult(const BackgroundTaskPtr& task, const FilterResultP
       return;
     }
 
-    do {
-      const BackgroundTaskPtr task(m_batchQueue->takeForProcessing());
-      if (!task) {
-        break;
-      }
-      m_workerThreadPool->submitTask(task);
-    } while (m_workerThreadPool->hasSpareCapacity());
-
     const PageInfo page(m_batchQueue->selectedPage());
     if (!page.isNull()) {
       m_thumbSequence->setSelection(page.id());
@@ -1231,6 +1254,26 @@ void MainWindow::filterResult(const BackgroundTaskPtr& task, const FilterResultP
   }
 }  // MainWindow::filterResult
 
+BackgroundTaskPtr MainWindow::takeBatchTaskForProcessing() {
+  while (true) {
+    PageInfo page;
+    const BackgroundTaskPtr task(m_batchQueue->takeForProcessing(&page));
+    if (!task || !m_batchUpToDateCheck) {
+      return task;
+    }
+
+    // This is decided as late as possible, as the pages processed
+    // before may have changed the aggregate page size.
+    OutputUpToDateCollector collector;
+    m_batchUpToDateCheck->process(page, &collector);
+    if (!collector.isUpToDate()) {
+      return task;
+    }
+    m_batchQueue->processingFinished(task);
+    ImagePrefetcher::instance().release(page.imageId());
+  }
+}
+
 void MainWindow::debugToggled(const bool enabled) {
   m_debug = enabled;
 }
@@ -1773,8 +1816,8 @@ void MainWindow::showInsertFileDialog(BeforeOrAfter before_or_after, const Image
     const QFileInfo file_info(files[i]);
     ImageFileInfo image_file_info(file_info, std::vector<ImageMetadata>());
 
-    const ImageMetadataLoader::Status status = ImageMetadataLoader::load(
-        files.at(i), [&](const ImageMetadata& metadata) { image_file_info.imageInfo().push_back(metadata); });
+    const ImageMetadataLoader::Status status
+        = ImageMetadataCache::instance().load(file_info, image_file_info.imageInfo());
 
     if (status == ImageMetadataLoader::LOADED) {
       new_files.push_back(image_file_info);
@@ -1784,6 +1827,8 @@ void MainWindow::showInsertFileDialog(BeforeOrAfter before_or_after, const Image
     }
   }
 
+  ImageMetadataCache::instance().save();
+
   if (!failed_files.empty()) {
     std::unique_ptr<LoadFilesStatusDialog> err_dialog(new LoadFilesStatusDialog(this));
     err_dialog->setLoadedFiles(loaded_files);
@@ -1930,7 +1975,9 @@ void MainWindow::eraseOutputFiles(const std::set<PageId>& pages) {
     }
 
     for (PageId::SubPage subpage : erase_variations) {
-      QFile::remove(m_outFileNameGen.filePathFor(PageId(page_id.imageId(), subpage)));
+      OutputContainer::removeFile(m_outFileNameGen.filePathFor(PageId(page_id.imageId(), subpage)));
+      OutputContainer::removeFile(
+          m_outFileNameGen.filePathFor(PageId(page_id.imageId(), subpage), OutputFileNameGenerator::JPEG_FORMAT));
     }
   }
 }
@@ -1976,8 +2023,14 @@ BackgroundTaskPtr MainWindow::createCompositeTask(const PageInfo& page,
   }
   assert(fix_orientation_task);
 
-  return make_intrusive<LoadFileTask>(batch ? BackgroundTask::BATCH : BackgroundTask::INTERACTIVE, page,
-                                      m_thumbnailCache, m_pages, fix_orientation_task);
+  const BackgroundTaskPtr task
+      = make_intrusive<LoadFileTask>(batch ? BackgroundTask::BATCH : BackgroundTask::INTERACTIVE, page,
+                                     m_thumbnailCache, m_pages, fix_orientation_task);
+  if (output_task) {
+    task->setMemoryFootprint(task->memoryFootprint() + output_task->estimateMemoryFootprint(page.metadata()));
+  }
+
+  return task;
 }  // MainWindow::createCompositeTask
 
 intrusive_ptr<CompositeCacheDrivenTask> MainWindow::createCompositeCacheDrivenTask(const int last_filter_idx) {
@@ -287,6 +287,12 @@ class MainWindow : public QMainWindow, private FilterUiInterface, private Ui::Ma
 
   intrusive_ptr<CompositeCacheDrivenTask> createCompositeCacheDrivenTask(int last_filter_idx);
 
+  /**
+   * \brief Takes the next batch task, marking the ones for pages with
+   *        up-to-date output as processed without running them.
+   */
+  BackgroundTaskPtr takeBatchTaskForProcessing();
+
   void createBatchProcessingWidget();
 
   void updateDisambiguationRecords(const PageSequence& pages);
@@ -310,6 +316,7 @@ class MainWindow : public QMainWindow, private FilterUiInterface, private Ui::Ma
   std::unique_ptr<ThumbnailSequence> m_thumbSequence;
   std::unique_ptr<WorkerThreadPool> m_workerThreadPool;
   std::unique_ptr<ProcessingTaskQueue> m_batchQueue;
+  intrusive_ptr<CompositeCacheDrivenTask> m_batchUpToDateCheck;
   std::unique_ptr<ProcessingTaskQueue> m_interactiveQueue;
   QStackedLayout* m_imageFrameLayout;
   QStackedLayout* m_optionsFrameLayout;
@@ -0,0 +1,370 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "OutputContainer.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <algorithm>
+#include "AtomicFileOverwriter.h"
+
+namespace {
+const quint32 FILE_MAGIC = 0x53545043;    // "STPC"
+const quint32 RECORD_MAGIC = 0x53545052;  // "STPR"
+const quint32 VERSION = 1;
+
+// Don't bother rewriting the container for less than that.
+const qint64 MIN_DEAD_BYTES_TO_COMPACT = qint64(64) << 20;
+
+QByteArray fileHeader() {
+  QByteArray header;
+  QDataStream strm(&header, QIODevice::WriteOnly);
+  strm << FILE_MAGIC << VERSION;
+
+  return header;
+}
+
+QByteArray recordHeader(const QString& name, const qint64 modified_time, const qint64 size) {
+  QByteArray header;
+  QDataStream strm(&header, QIODevice::WriteOnly);
+  strm << RECORD_MAGIC << name << modified_time << size;
+
+  return header;
+}
+
+struct Registry {
+  QMutex mutex;
+  QHash<QString, std::shared_ptr<OutputContainer>> containers;
+};
+
+Registry& registry() {
+  static Registry object;
+
+  return object;
+}
+}  // namespace
+
+const char OutputContainer::FILE_NAME[] = "pages.stpack";
+
+std::shared_ptr<OutputContainer> OutputContainer::forDir(const QString& dir) {
+  const QString file_path(QDir(dir).absoluteFilePath(QString::fromLatin1(FILE_NAME)));
+
+  Registry& reg = registry();
+  const QMutexLocker locker(&reg.mutex);
+  std::shared_ptr<OutputContainer>& container = reg.containers[file_path];
+  if (!container) {
+    container.reset(new OutputContainer(file_path));
+  }
+
+  return container;
+}
+
+std::shared_ptr<OutputContainer> OutputContainer::forFile(const QString& file_path) {
+  const QString dir(QFileInfo(file_path).absolutePath());
+  if (!QFile::exists(QDir(dir).absoluteFilePath(QString::fromLatin1(FILE_NAME)))) {
+    return nullptr;
+  }
+
+  return forDir(dir);
+}
+
+QByteArray OutputContainer::readFile(const QString& file_path) {
+  const std::shared_ptr<OutputContainer> container(forFile(file_path));
+  if (!container) {
+    return QByteArray();
+  }
+
+  return container->read(QFileInfo(file_path).fileName());
+}
+
+void OutputContainer::removeFile(const QString& file_path) {
+  QFile::remove(file_path);
+  if (const std::shared_ptr<OutputContainer> container = forFile(file_path)) {
+    container->remove(QFileInfo(file_path).fileName());
+  }
+}
+
+void OutputContainer::compactAllIfWorthIt() {
+  QList<std::shared_ptr<OutputContainer>> containers;
+  {
+    Registry& reg = registry();
+    const QMutexLocker locker(&reg.mutex);
+    containers = reg.containers.values();
+  }
+
+  for (const std::shared_ptr<OutputContainer>& container : containers) {
+    container->compactIfWorthIt();
+  }
+}
+
+OutputContainer::OutputContainer(const QString& file_path)
+    : m_filePath(file_path), m_file(file_path), m_liveBytes(0), m_deadBytes(0) {}
+
+OutputContainer::~OutputContainer() = default;
+
+OutputContainer::Entry OutputContainer::entry(const QString& name) {
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(false)) {
+    return Entry();
+  }
+
+  const auto it = m_index.constFind(name);
+  if (it == m_index.constEnd()) {
+    return Entry();
+  }
+
+  return it->entry;
+}
+
+QByteArray OutputContainer::read(const QString& name) {
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(false)) {
+    return QByteArray();
+  }
+
+  const auto it = m_index.constFind(name);
+  if ((it == m_index.constEnd()) || !m_file.seek(it->offset)) {
+    return QByteArray();
+  }
+
+  QByteArray data(m_file.read(it->entry.size));
+  if (data.size() != it->entry.size) {
+    return QByteArray();
+  }
+
+  return data;
+}
+
+bool OutputContainer::write(const QString& name, const QByteArray& data) {
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(true)) {
+    return false;
+  }
+
+  return append(name, &data);
+}
+
+void OutputContainer::remove(const QString& name) {
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(false) || !m_index.contains(name)) {
+    return;
+  }
+
+  append(name, nullptr);
+}
+
+QStringList OutputContainer::names() {
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(false)) {
+    return QStringList();
+  }
+
+  return m_index.keys();
+}
+
+bool OutputContainer::extractTo(const QString& dir) {
+  const QDir out_dir(dir);
+  bool ok = true;
+  for (const QString& name : names()) {
+    const QByteArray data(read(name));
+    AtomicFileOverwriter overwriter;
+    QIODevice* const out = overwriter.startWriting(out_dir.absoluteFilePath(name));
+    if (data.isNull() || !out || (out->write(data) != data.size())) {
+      overwriter.abort();
+      ok = false;
+      continue;
+    }
+    ok = overwriter.commit() && ok;
+  }
+
+  return ok;
+}
+
+bool OutputContainer::ensureOpen(const bool create) {
+  if (m_file.isOpen()) {
+    return true;
+  }
+
+  if (!m_file.exists()) {
+    if (!create) {
+      return false;
+    }
+    if (!m_file.open(QIODevice::ReadWrite)) {
+      return false;
+    }
+    const QByteArray header(fileHeader());
+    if (m_file.write(header) != header.size()) {
+      m_file.close();
+      m_file.remove();
+
+      return false;
+    }
+
+    return true;
+  }
+
+  if (!m_file.open(QIODevice::ReadWrite)) {
+    return false;
+  }
+
+  QDataStream strm(&m_file);
+  quint32 magic = 0;
+  quint32 version = 0;
+  strm >> magic >> version;
+  if ((strm.status() != QDataStream::Ok) || (magic != FILE_MAGIC) || (version != VERSION)) {
+    // Not ours to overwrite.
+    m_file.close();
+
+    return false;
+  }
+
+  loadIndex();
+
+  return true;
+}
+
+void OutputContainer::loadIndex() {
+  m_index.clear();
+  m_liveBytes = 0;
+  m_deadBytes = 0;
+
+  const qint64 file_size = m_file.size();
+  QDataStream strm(&m_file);
+  while (!m_file.atEnd()) {
+    const qint64 record_offset = m_file.pos();
+
+    quint32 magic = 0;
+    QString name;
+    qint64 modified_time = 0;
+    qint64 size = -1;
+    strm >> magic >> name >> modified_time >> size;
+
+    const qint64 data_offset = m_file.pos();
+    if ((strm.status() != QDataStream::Ok) || (magic != RECORD_MAGIC)
+        || (data_offset + std::max<qint64>(size, 0) > file_size)) {
+      // A record that was being written when we crashed.
+      m_file.resize(record_offset);
+      break;
+    }
+
+    const auto it = m_index.find(name);
+    if (it != m_index.end()) {
+      m_liveBytes -= it->entry.size;
+      m_deadBytes += it->entry.size;
+    }
+    if (size < 0) {
+      if (it != m_index.end()) {
+        m_index.erase(it);
+      }
+    } else {
+      Location& location = m_index[name];
+      location.offset = data_offset;
+      location.entry.size = size;
+      location.entry.modifiedTime = modified_time;
+      m_liveBytes += size;
+    }
+
+    if (!m_file.seek(data_offset + std::max<qint64>(size, 0))) {
+      break;
+    }
+  }
+}  // OutputContainer::loadIndex
+
+bool OutputContainer::append(const QString& name, const QByteArray* data) {
+  const qint64 size = data ? data->size() : -1;
+  const qint64 modified_time = QDateTime::currentDateTimeUtc().toTime_t();
+
+  QByteArray record(recordHeader(name, modified_time, size));
+  const qint64 data_offset = m_file.size() + record.size();
+  if (data) {
+    record += *data;
+  }
+
+  const qint64 record_offset = m_file.size();
+  if (!m_file.seek(record_offset) || (m_file.write(record) != record.size()) || !m_file.flush()) {
+    // Don't leave a partial record behind.
+    m_file.resize(record_offset);
+
+    return false;
+  }
+
+  const auto it = m_index.find(name);
+  if (it != m_index.end()) {
+    m_liveBytes -= it->entry.size;
+    m_deadBytes += it->entry.size;
+  }
+  if (!data) {
+    if (it != m_index.end()) {
+      m_index.erase(it);
+    }
+  } else {
+    Location& location = m_index[name];
+    location.offset = data_offset;
+    location.entry.size = size;
+    location.entry.modifiedTime = modified_time;
+    m_liveBytes += size;
+  }
+
+  return true;
+}  // OutputContainer::append
+
+void OutputContainer::compactIfWorthIt() {
+  {
+    const QMutexLocker locker(&m_mutex);
+    if (!ensureOpen(false) || (m_deadBytes < MIN_DEAD_BYTES_TO_COMPACT) || (m_deadBytes < m_liveBytes)) {
+      return;
+    }
+  }
+
+  compact();
+}
+
+bool OutputContainer::compact() {
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(false)) {
+    return false;
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* const out = overwriter.startWriting(m_filePath);
+  if (!out) {
+    return false;
+  }
+
+  bool ok = (out->write(fileHeader()) >= 0);
+  for (auto it = m_index.constBegin(); ok && (it != m_index.constEnd()); ++it) {
+    const QByteArray data(m_file.seek(it->offset) ? m_file.read(it->entry.size) : QByteArray());
+    QByteArray record(recordHeader(it.key(), it->entry.modifiedTime, it->entry.size));
+    record += data;
+    ok = (data.size() == it->entry.size) && (out->write(record) == record.size());
+  }
+  if (!ok) {
+    overwriter.abort();
+
+    return false;
+  }
+
+  m_file.close();
+  // Should that fail, we just keep using the old file.
+  const bool committed = overwriter.commit();
+
+  return ensureOpen(false) && committed;
+}  // OutputContainer::compact
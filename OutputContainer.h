@@ -0,0 +1,164 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OUTPUT_CONTAINER_H_
+#define OUTPUT_CONTAINER_H_
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include "NonCopyable.h"
+
+/**
+ * \brief A single append-only file holding the output pages of a directory,
+ *        used instead of one file per page when settings/output_container
+ *        is set or --output-container is given.
+ *
+ * Pages are stored under the names their own files would have had, as encoded
+ * by TiffWriter or JpegWriter, and are appended as they complete.  Replacing
+ * a page appends a new record superseding the old one, and removing a page
+ * appends a tombstone.  The index is rebuilt by walking the record headers
+ * when the container is first opened, a trailing record cut short by a crash
+ * being dropped.  The superseded records are only dropped by compacting
+ * the container, which is done once there are no more pages to write.
+ *
+ * Records aren't synced to disk individually, which is the point on network
+ * file systems.  A container may only be written by a single process.
+ * All methods may be called from any thread.
+ */
+class OutputContainer {
+  DECLARE_NON_COPYABLE(OutputContainer)
+
+ public:
+  struct Entry {
+    qint64 size = -1;
+    qint64 modifiedTime = 0;  // Seconds since the epoch.
+
+    bool exists() const { return size >= 0; }
+  };
+
+  static const char FILE_NAME[];
+
+  /**
+   * \brief The container of \p dir, created on the first write if necessary.
+   */
+  static std::shared_ptr<OutputContainer> forDir(const QString& dir);
+
+  /**
+   * \brief The container that would hold \p file_path if it existed,
+   *        or null if there is no container in its directory.
+   */
+  static std::shared_ptr<OutputContainer> forFile(const QString& file_path);
+
+  /**
+   * \return The data of the page stored under the name of \p file_path in the
+   *         container of its directory, or a null array if there is no such page.
+   */
+  static QByteArray readFile(const QString& file_path);
+
+  /**
+   * \brief Removes \p file_path, both as a file and as a page of the container
+   *        of its directory.
+   */
+  static void removeFile(const QString& file_path);
+
+  /**
+   * \brief Calls compactIfWorthIt() on every container returned by forDir()
+   *        so far.
+   */
+  static void compactAllIfWorthIt();
+
+  /**
+   * \brief Opens the container file \p file_path directly.
+   *
+   * Normally, containers are obtained through forDir(), which makes sure
+   * there is a single instance per file in the process.
+   */
+  explicit OutputContainer(const QString& file_path);
+
+  ~OutputContainer();
+
+  Entry entry(const QString& name);
+
+  /**
+   * \return The stored data, or a null array if there is no such page.
+   */
+  QByteArray read(const QString& name);
+
+  bool write(const QString& name, const QByteArray& data);
+
+  void remove(const QString& name);
+
+  /**
+   * \return The names of the pages stored, in no particular order.
+   */
+  QStringList names();
+
+  /**
+   * \brief Writes every page stored into a file of its own in \p dir,
+   *        as if the container had never been used.
+   *
+   * \return true if all the pages were written.
+   */
+  bool extractTo(const QString& dir);
+
+  /**
+   * \brief Compacts the container if the superseded records take more space
+   *        than the live ones, and enough of it to be worth the trouble.
+   *
+   * Compacting rewrites the whole container, so it's to be done when there
+   * are no more pages to write, like once processing is over or when
+   * closing a project, rather than as pages are written.
+   */
+  void compactIfWorthIt();
+
+  /**
+   * \brief Rewrites the container without the superseded records and
+   *        tombstones.
+   *
+   * \return true on success.
+   */
+  bool compact();
+
+ private:
+  struct Location {
+    qint64 offset;  // Of the data.
+    Entry entry;
+  };
+
+  bool ensureOpen(bool create);
+
+  void loadIndex();
+
+  bool append(const QString& name, const QByteArray* data);
+
+  QMutex m_mutex;
+  QString m_filePath;
+  QFile m_file;
+  QHash<QString, Location> m_index;
+  qint64 m_liveBytes;
+  qint64 m_deadBytes;
+};
+
+
+#endif  // ifndef OUTPUT_CONTAINER_H_
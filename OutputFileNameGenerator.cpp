@@ -39,7 +39,7 @@ void OutputFileNameGenerator::performRelinking(const AbstractRelinker& relinker)
   m_outDir = relinker.substitutionPathFor(RelinkablePath(m_outDir, RelinkablePath::Dir));
 }
 
-QString OutputFileNameGenerator::fileNameFor(const PageId& page) const {
+QString OutputFileNameGenerator::fileNameFor(const PageId& page, const FileFormat format) const {
   const bool ltr = (m_layoutDirection == Qt::LeftToRight);
   const PageId::SubPage sub_page = page.subPage();
   const int label = m_disambiguator->getLabel(page.imageId().filePath());
@@ -56,13 +56,13 @@ QString OutputFileNameGenerator::fileNameFor(const PageId& page) const {
     name += QLatin1Char(ltr == (sub_page == PageId::LEFT_PAGE) ? '1' : '2');
     name += QLatin1Char(sub_page == PageId::LEFT_PAGE ? 'L' : 'R');
   }
-  name += QString::fromLatin1(".tif");
+  name += QString::fromLatin1(format == JPEG_FORMAT ? ".jpg" : ".tif");
 
   return name;
 }
 
-QString OutputFileNameGenerator::filePathFor(const PageId& page) const {
-  const QString file_name(fileNameFor(page));
+QString OutputFileNameGenerator::filePathFor(const PageId& page, const FileFormat format) const {
+  const QString file_name(fileNameFor(page, format));
 
   return QDir(m_outDir).absoluteFilePath(file_name);
 }
@@ -30,6 +30,8 @@ class AbstractRelinker;
 class OutputFileNameGenerator {
   // Member-wise copying is OK.
  public:
+  enum FileFormat { TIFF_FORMAT, JPEG_FORMAT };
+
   OutputFileNameGenerator();
 
   OutputFileNameGenerator(intrusive_ptr<FileNameDisambiguator> disambiguator,
@@ -46,9 +48,9 @@ class OutputFileNameGenerator {
 
   const FileNameDisambiguator* disambiguator() const { return m_disambiguator.get(); }
 
-  QString fileNameFor(const PageId& page) const;
+  QString fileNameFor(const PageId& page, FileFormat format = TIFF_FORMAT) const;
 
-  QString filePathFor(const PageId& page) const;
+  QString filePathFor(const PageId& page, FileFormat format = TIFF_FORMAT) const;
 
  private:
   intrusive_ptr<FileNameDisambiguator> m_disambiguator;
@@ -0,0 +1,441 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PdfWriter.h"
+#include <tiff.h>
+#include <QBuffer>
+#include <QIODevice>
+#include <QImage>
+#include <algorithm>
+#include <cstring>
+#include "Dpi.h"
+#include "Dpm.h"
+#include "ImageLoader.h"
+#include "TiffReader.h"
+
+namespace {
+// Images without a resolution are assumed to have this one.
+const int DEFAULT_DPI = 300;
+
+QByteArray number(const int value) {
+  return QByteArray::number(value);
+}
+
+QByteArray real(const double value) {
+  return QByteArray::number(value, 'f', 3);
+}
+
+QByteArray ref(const int id) {
+  return number(id) + " 0 R";
+}
+}  // namespace
+
+struct PdfWriter::Picture {
+  int width = 0;
+  int height = 0;
+  Dpi dpi;
+  int bitsPerComponent = 8;
+  int colors = 1;
+  QByteArray filter;  // Empty for uncompressed data.
+  QByteArray decodeParms;
+  // The samples are to be read inverted, that is 0 stands for white and,
+  // in a stencil mask, 1 is painted.
+  bool inverted = false;
+  QByteArray data;
+
+  bool isBilevel() const { return (bitsPerComponent == 1) && (colors == 1); }
+};
+
+PdfWriter::PdfWriter(QIODevice& device) : m_device(device), m_pos(0), m_ok(true) {
+  m_catalogId = newObject();
+  m_pagesId = newObject();
+  // The comment of high bytes marks the file as binary for transfer programs.
+  write("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+}
+
+PdfWriter::~PdfWriter() = default;
+
+bool PdfWriter::addPage(const QByteArray& image_data) {
+  Picture picture;
+  if (!loadPicture(image_data, picture)) {
+    return false;
+  }
+
+  writePage(picture, nullptr);
+
+  return true;
+}
+
+bool PdfWriter::addMaskedPage(const QByteArray& background_data, const QByteArray& foreground_data) {
+  Picture background;
+  Picture foreground;
+  if (!loadPicture(background_data, background) || !loadPicture(foreground_data, foreground)) {
+    return false;
+  }
+  if (!foreground.isBilevel() || (foreground.width != background.width)
+      || (foreground.height != background.height)) {
+    return false;
+  }
+
+  writePage(background, &foreground);
+
+  return true;
+}
+
+bool PdfWriter::finish() {
+  QByteArray kids;
+  for (const int id : m_pageIds) {
+    if (!kids.isEmpty()) {
+      kids += ' ';
+    }
+    kids += ref(id);
+  }
+
+  beginObject(m_pagesId);
+  write("<< /Type /Pages /Kids [" + kids + "] /Count " + number(int(m_pageIds.size())) + " >>\nendobj\n");
+
+  beginObject(m_catalogId);
+  write("<< /Type /Catalog /Pages " + ref(m_pagesId) + " >>\nendobj\n");
+
+  const qint64 xref_pos = m_pos;
+  const int size = int(m_offsets.size()) + 1;
+  QByteArray xref("xref\n0 " + number(size) + "\n0000000000 65535 f \n");
+  for (const qint64 offset : m_offsets) {
+    xref += QByteArray::number(offset).rightJustified(10, '0') + " 00000 n \n";
+  }
+  write(xref);
+  write("trailer\n<< /Size " + number(size) + " /Root " + ref(m_catalogId) + " >>\nstartxref\n"
+        + QByteArray::number(xref_pos) + "\n%%EOF\n");
+
+  return m_ok;
+}
+
+bool PdfWriter::loadPicture(const QByteArray& data, Picture& picture) {
+  if (!loadJpeg(data, picture) && !loadRawTiff(data, picture) && !loadDecoded(data, picture)) {
+    return false;
+  }
+
+  if (picture.dpi.isNull()) {
+    picture.dpi = Dpi(DEFAULT_DPI, DEFAULT_DPI);
+  }
+
+  return true;
+}
+
+bool PdfWriter::loadJpeg(const QByteArray& data, Picture& picture) {
+  const auto* bytes = reinterpret_cast<const uchar*>(data.constData());
+  const int size = data.size();
+  if ((size < 4) || (bytes[0] != 0xFF) || (bytes[1] != 0xD8)) {
+    return false;
+  }
+
+  int sof_marker = 0;
+  int precision = 0;
+  int width = 0;
+  int height = 0;
+  int components = 0;
+  Dpi dpi;
+
+  // Walk the marker segments up to the first scan.
+  int pos = 2;
+  while (pos + 4 <= size) {
+    if (bytes[pos] != 0xFF) {
+      return false;
+    }
+
+    const int marker = bytes[pos + 1];
+    if (marker == 0xFF) {
+      // A fill byte.
+      ++pos;
+      continue;
+    }
+    if ((marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD8))) {
+      // No segment follows these.
+      pos += 2;
+      continue;
+    }
+    if ((marker == 0xD9) || (marker == 0xDA)) {
+      break;
+    }
+
+    const int length = (bytes[pos + 2] << 8) | bytes[pos + 3];
+    if ((length < 2) || (pos + 2 + length > size)) {
+      return false;
+    }
+    const uchar* payload = bytes + pos + 4;
+    const int payload_size = length - 2;
+
+    if ((marker == 0xE0) && (payload_size >= 12) && (std::memcmp(payload, "JFIF", 5) == 0)) {
+      const int x_density = (payload[8] << 8) | payload[9];
+      const int y_density = (payload[10] << 8) | payload[11];
+      if (payload[7] == 1) {
+        dpi = Dpi(x_density, y_density);
+      } else if (payload[7] == 2) {
+        dpi = Dpm(x_density * 100, y_density * 100);
+      }
+    } else if ((marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC)
+               && (payload_size >= 6)) {
+      sof_marker = marker;
+      precision = payload[0];
+      height = (payload[1] << 8) | payload[2];
+      width = (payload[3] << 8) | payload[4];
+      components = payload[5];
+    }
+
+    pos += 2 + length;
+  }
+
+  // Baseline, extended and progressive Huffman coded 8-bit images are
+  // what every DCTDecode implementation handles.  CMYK ones would need
+  // the Adobe inversion convention to be sorted out, so they get decoded.
+  if ((sof_marker > 0xC2) || (sof_marker == 0) || (precision != 8) || (width <= 0) || (height <= 0)
+      || ((components != 1) && (components != 3))) {
+    return false;
+  }
+
+  picture.width = width;
+  picture.height = height;
+  picture.dpi = dpi;
+  picture.colors = components;
+  picture.filter = "/DCTDecode";
+  picture.data = data;
+
+  return true;
+}  // PdfWriter::loadJpeg
+
+bool PdfWriter::loadRawTiff(const QByteArray& data, Picture& picture) {
+  QBuffer buffer;
+  buffer.setData(data);
+  if (!buffer.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  TiffReader::RawImage raw;
+  if (!TiffReader::readRawImage(buffer, 0, raw)) {
+    return false;
+  }
+
+  const bool gray = (raw.samplesPerPixel == 1) && ((raw.bitsPerSample == 1) || (raw.bitsPerSample == 8))
+                    && ((raw.photometric == PHOTOMETRIC_MINISWHITE) || (raw.photometric == PHOTOMETRIC_MINISBLACK));
+  const bool rgb = (raw.samplesPerPixel == 3) && (raw.bitsPerSample == 8) && (raw.photometric == PHOTOMETRIC_RGB);
+  if (!gray && !rgb) {
+    return false;
+  }
+
+  QByteArray filter;
+  switch (raw.compression) {
+    case COMPRESSION_NONE:
+      break;
+    case COMPRESSION_CCITTFAX4:
+      if (raw.bitsPerSample != 1) {
+        return false;
+      }
+      filter = "/CCITTFaxDecode";
+      break;
+    case COMPRESSION_LZW:
+      // TIFF uses the same code width switching as PDF's default.
+      filter = "/LZWDecode";
+      break;
+    case COMPRESSION_ADOBE_DEFLATE:
+    case COMPRESSION_DEFLATE:
+      filter = "/FlateDecode";
+      break;
+    default:
+      return false;
+  }
+  if ((raw.predictor != PREDICTOR_NONE) && (raw.predictor != PREDICTOR_HORIZONTAL)) {
+    return false;
+  }
+
+  if ((raw.rowsPerStrip <= 0) || (int(raw.strips.size()) != (raw.height + raw.rowsPerStrip - 1) / raw.rowsPerStrip)) {
+    return false;
+  }
+  // Compressed strips would have to be decoded to become a single stream.
+  if ((raw.strips.size() != 1) && (raw.compression != COMPRESSION_NONE)) {
+    return false;
+  }
+
+  picture.width = raw.width;
+  picture.height = raw.height;
+  picture.dpi = raw.dpi;
+  picture.bitsPerComponent = raw.bitsPerSample;
+  picture.colors = raw.samplesPerPixel;
+  picture.filter = filter;
+  picture.data.clear();
+
+  if (raw.compression == COMPRESSION_CCITTFAX4) {
+    // Black runs decode to 0, while in TIFF they are 1 bits.
+    picture.decodeParms = "<< /K -1 /Columns " + number(raw.width) + " /Rows " + number(raw.height) + " >>";
+    picture.inverted = (raw.photometric == PHOTOMETRIC_MINISBLACK);
+  } else {
+    picture.inverted = (raw.photometric == PHOTOMETRIC_MINISWHITE);
+    if (raw.predictor == PREDICTOR_HORIZONTAL) {
+      picture.decodeParms = "<< /Predictor 2 /Colors " + number(raw.samplesPerPixel) + " /BitsPerComponent "
+                            + number(raw.bitsPerSample) + " /Columns " + number(raw.width) + " >>";
+    }
+  }
+
+  if (raw.compression != COMPRESSION_NONE) {
+    picture.data = raw.strips.front();
+
+    return true;
+  }
+
+  // Uncompressed strips may carry padding past their last row.
+  const int bytes_per_line = (raw.width * raw.bitsPerSample * raw.samplesPerPixel + 7) / 8;
+  picture.data.reserve(bytes_per_line * raw.height);
+  for (size_t i = 0; i < raw.strips.size(); ++i) {
+    const int expected_size = bytes_per_line * std::min(raw.rowsPerStrip, raw.height - int(i) * raw.rowsPerStrip);
+    if (raw.strips[i].size() < expected_size) {
+      return false;
+    }
+    picture.data.append(raw.strips[i].constData(), expected_size);
+  }
+
+  return true;
+}  // PdfWriter::loadRawTiff
+
+bool PdfWriter::loadDecoded(const QByteArray& data, Picture& picture) {
+  QBuffer buffer;
+  buffer.setData(data);
+  if (!buffer.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  QImage image(ImageLoader::load(buffer, 0));
+  if (image.isNull()) {
+    return false;
+  }
+
+  picture.filter = "/FlateDecode";
+
+  int bytes_per_line = 0;
+  if (image.depth() == 1) {
+    if (image.format() != QImage::Format_Mono) {
+      image = image.convertToFormat(QImage::Format_Mono);
+    }
+    picture.bitsPerComponent = 1;
+    picture.inverted = (image.colorCount() >= 2) && (qGray(image.color(0)) > qGray(image.color(1)));
+    bytes_per_line = (image.width() + 7) / 8;
+  } else if (image.allGray()) {
+    image = image.convertToFormat(QImage::Format_Grayscale8);
+    bytes_per_line = image.width();
+  } else {
+    image = image.convertToFormat(QImage::Format_RGB888);
+    picture.colors = 3;
+    bytes_per_line = image.width() * 3;
+  }
+
+  QByteArray pixels;
+  pixels.reserve(bytes_per_line * image.height());
+  for (int y = 0; y < image.height(); ++y) {
+    pixels.append(reinterpret_cast<const char*>(image.constScanLine(y)), bytes_per_line);
+  }
+  // Strip the length qCompress() puts in front of the zlib stream.
+  picture.data = qCompress(pixels).mid(4);
+
+  picture.width = image.width();
+  picture.height = image.height();
+  picture.dpi = Dpi(Dpm(image));
+
+  return true;
+}  // PdfWriter::loadDecoded
+
+void PdfWriter::writePage(const Picture& background, const Picture* foreground) {
+  const double x_scale = 72.0 / background.dpi.horizontal();
+  const double y_scale = 72.0 / background.dpi.vertical();
+  const double page_width = background.width * x_scale;
+  const double page_height = background.height * y_scale;
+
+  // Both layers cover the whole page.
+  const QByteArray placement("q " + real(page_width) + " 0 0 " + real(page_height) + " 0 0 cm ");
+
+  QByteArray xobjects(" /Im0 " + ref(writeImage(background, false)));
+  QByteArray content(placement + "/Im0 Do Q\n");
+  if (foreground) {
+    // Stencil masks are painted with the fill colour.
+    xobjects += " /Im1 " + ref(writeImage(*foreground, true));
+    content += "0 g " + placement + "/Im1 Do Q\n";
+  }
+
+  const int content_id = newObject();
+  beginObject(content_id);
+  writeStream(QByteArray(), content);
+
+  const int page_id = newObject();
+  beginObject(page_id);
+  write("<< /Type /Page /Parent " + ref(m_pagesId) + " /MediaBox [0 0 " + real(page_width) + ' '
+        + real(page_height) + "] /Resources << /XObject <<" + xobjects + " >> >> /Contents " + ref(content_id)
+        + " >>\nendobj\n");
+  m_pageIds.push_back(page_id);
+}  // PdfWriter::writePage
+
+int PdfWriter::writeImage(const Picture& picture, const bool stencil) {
+  QByteArray dict("/Type /XObject /Subtype /Image /Width " + number(picture.width) + " /Height "
+                  + number(picture.height));
+  if (stencil) {
+    dict += " /ImageMask true";
+  } else {
+    dict += (picture.colors == 3) ? " /ColorSpace /DeviceRGB" : " /ColorSpace /DeviceGray";
+  }
+  dict += " /BitsPerComponent " + number(picture.bitsPerComponent);
+  if (!picture.filter.isEmpty()) {
+    dict += " /Filter " + picture.filter;
+  }
+  if (!picture.decodeParms.isEmpty()) {
+    dict += " /DecodeParms " + picture.decodeParms;
+  }
+  if (picture.inverted) {
+    dict += " /Decode [1 0]";
+  }
+
+  const int id = newObject();
+  beginObject(id);
+  writeStream(dict, picture.data);
+
+  return id;
+}
+
+int PdfWriter::newObject() {
+  m_offsets.push_back(0);
+
+  return int(m_offsets.size());
+}
+
+void PdfWriter::beginObject(const int id) {
+  m_offsets[id - 1] = m_pos;
+  write(number(id) + " 0 obj\n");
+}
+
+void PdfWriter::writeStream(const QByteArray& dict, const QByteArray& data) {
+  QByteArray header("<<");
+  if (!dict.isEmpty()) {
+    header += ' ' + dict;
+  }
+  header += " /Length " + number(data.size()) + " >>\nstream\n";
+  write(header);
+  write(data);
+  write("\nendstream\nendobj\n");
+}
+
+void PdfWriter::write(const QByteArray& data) {
+  if (m_device.write(data) != data.size()) {
+    m_ok = false;
+  }
+  m_pos += data.size();
+}
@@ -0,0 +1,113 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PDF_WRITER_H_
+#define PDF_WRITER_H_
+
+#include <QByteArray>
+#include <vector>
+#include "NonCopyable.h"
+
+class QIODevice;
+
+/**
+ * \brief Writes output pages into a PDF file, one image per page.
+ *
+ * The compressed data of an image is copied into the PDF as is wherever
+ * PDF has a matching filter, which covers CCITT G4, LZW and Deflate TIFF strips
+ * (with or without the horizontal predictor), uncompressed ones and whole
+ * JPEG files.  Each page is a single image, so a TIFF is only passed through
+ * if it consists of a single strip or isn't compressed, as independently
+ * compressed strips can't be joined into one stream.  Anything else is decoded
+ * and deflated.  The page size follows from the DPI of the image.
+ */
+class PdfWriter {
+  DECLARE_NON_COPYABLE(PdfWriter)
+
+ public:
+  /**
+   * \param device The device to write to.  It must be opened for writing
+   *        and stay alive until finish() is called.
+   */
+  explicit PdfWriter(QIODevice& device);
+
+  ~PdfWriter();
+
+  /**
+   * \brief Adds a page showing an image.
+   *
+   * \param image_data The contents of an image file, as returned by
+   *        OutputContainer::readFile() for example.
+   * \return false if the image couldn't be read, in which case
+   *         nothing is written.
+   */
+  bool addPage(const QByteArray& image_data);
+
+  /**
+   * \brief Adds a page showing a background image with a bi-level foreground
+   *        painted black over it, as split by the output filter.
+   *
+   * The foreground becomes a stencil mask, keeping its own compression.
+   *
+   * \return false if either image couldn't be read, or if the foreground isn't
+   *         bi-level or differs in size from the background.  Nothing is
+   *         written in that case.
+   */
+  bool addMaskedPage(const QByteArray& background_data, const QByteArray& foreground_data);
+
+  /**
+   * \brief Writes the page tree, the cross-reference table and the trailer.
+   *
+   * \return false if writing to the device failed at any point.
+   */
+  bool finish();
+
+ private:
+  struct Picture;
+
+  static bool loadPicture(const QByteArray& data, Picture& picture);
+
+  static bool loadJpeg(const QByteArray& data, Picture& picture);
+
+  static bool loadRawTiff(const QByteArray& data, Picture& picture);
+
+  static bool loadDecoded(const QByteArray& data, Picture& picture);
+
+  void writePage(const Picture& background, const Picture* foreground);
+
+  int writeImage(const Picture& picture, bool stencil);
+
+  int newObject();
+
+  void beginObject(int id);
+
+  void writeStream(const QByteArray& dict, const QByteArray& data);
+
+  void write(const QByteArray& data);
+
+  QIODevice& m_device;
+  qint64 m_pos;
+  bool m_ok;
+  std::vector<qint64> m_offsets;  // Indexed by object number minus one.
+  std::vector<int> m_pageIds;
+  int m_catalogId;
+  int m_pagesId;
+};
+
+
+#endif  // ifndef PDF_WRITER_H_
@@ -28,7 +28,7 @@ void ProcessingTaskQueue::addProcessingTask(const PageInfo& page_info, const Bac
   m_pageToSelectWhenDone = PageInfo();
 }
 
-BackgroundTaskPtr ProcessingTaskQueue::takeForProcessing() {
+BackgroundTaskPtr ProcessingTaskQueue::takeForProcessing(PageInfo* page_info) {
   for (Entry& ent : m_queue) {
     if (!ent.takenForProcessing) {
       ent.takenForProcessing = true;
@@ -39,6 +39,9 @@ BackgroundTaskPtr ProcessingTaskQueue::takeForProcessing() {
         // jumps caused by dynamic ordering.
         m_selectedPage = ent.pageInfo;
       }
+      if (page_info) {
+        *page_info = ent.pageInfo;
+      }
 
       return ent.task;
     }
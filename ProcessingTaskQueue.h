@@ -38,8 +38,10 @@ class ProcessingTaskQueue {
    * The first task among those that haven't been already taken for processing
    * is marked as taken and returned.  A null task will be returned if there
    * are no such tasks.
+   *
+   * \param page_info If provided, the page of the returned task is written there.
    */
-  BackgroundTaskPtr takeForProcessing();
+  BackgroundTaskPtr takeForProcessing(PageInfo* page_info = nullptr);
 
   void processingFinished(const BackgroundTaskPtr& task);
 
@@ -19,9 +19,14 @@
 #include "ProjectFilesDialog.h"
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QMutex>
+#include <QRunnable>
 #include <QSettings>
 #include <QSortFilterProxyModel>
-#include <deque>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include "ImageMetadataCache.h"
 #include "ImageMetadataLoader.h"
 #include "NonCopyable.h"
 #include "SmartFilenameOrdering.h"
@@ -57,7 +62,11 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
   DECLARE_NON_COPYABLE(FileList)
 
  public:
-  enum LoadStatus { LOAD_OK, LOAD_FAILED, NO_MORE_FILES };
+  struct LoadProgress {
+    int loaded = 0;  // Including the failed ones.
+    int failed = 0;
+    bool done = false;
+  };
 
   FileList();
 
@@ -88,11 +97,29 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
 
   void remove(const QItemSelection& selection);
 
-  void prepareForLoadingFiles();
+  /**
+   * \brief Starts loading the metadata of all the files in the background,
+   *        in their visual order.
+   */
+  void startLoadingFiles();
 
-  LoadStatus loadNextFile();
+  /**
+   * \brief Updates the items whose metadata was loaded since the previous call.
+   */
+  LoadProgress collectLoadedFiles();
+
+  /**
+   * \brief Called by MetadataLoadTask from a worker thread.
+   */
+  void fileLoaded(int item_idx, bool ok, std::vector<ImageMetadata>& per_page_metadata);
 
  private:
+  struct LoadedFile {
+    int itemIdx;
+    bool ok;
+    std::vector<ImageMetadata> perPageMetadata;
+  };
+
   int rowCount(const QModelIndex& parent) const override;
 
   QVariant data(const QModelIndex& index, int role) const override;
@@ -100,7 +127,10 @@ class ProjectFilesDialog::FileList : private QAbstractListModel {
   Qt::ItemFlags flags(const QModelIndex& index) const override;
 
   std::vector<Item> m_items;
-  std::deque<int> m_itemsToLoad;
+  int m_filesToLoad;
+  QMutex m_loadedFilesMutex;
+  std::vector<LoadedFile> m_loadedFiles;
+  QThreadPool m_loaderPool;
 };
 
 
@@ -125,6 +155,26 @@ class ProjectFilesDialog::ItemVisualOrdering {
 };
 
 
+class ProjectFilesDialog::MetadataLoadTask : public QRunnable {
+ public:
+  MetadataLoadTask(FileList& owner, int item_idx, const QFileInfo& file_info)
+      : m_owner(owner), m_itemIdx(item_idx), m_fileInfo(file_info) {
+    setAutoDelete(true);
+  }
+
+  void run() override {
+    std::vector<ImageMetadata> per_page_metadata;
+    const ImageMetadataLoader::Status status = ImageMetadataCache::instance().load(m_fileInfo, per_page_metadata);
+    m_owner.fileLoaded(m_itemIdx, status == ImageMetadataLoader::LOADED, per_page_metadata);
+  }
+
+ private:
+  FileList& m_owner;
+  int m_itemIdx;
+  QFileInfo m_fileInfo;
+};
+
+
 template <typename OutFunc>
 void ProjectFilesDialog::FileList::files(OutFunc out) const {
   auto it(m_items.begin());
@@ -440,8 +490,10 @@ void ProjectFilesDialog::startLoadingMetadata() {
   buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
   offProjectList->clearSelection();
   inProjectList->clearSelection();
-  m_loadTimerId = startTimer(0);
   m_metadataLoadFailed = false;
+  m_inProjectFiles->startLoadingFiles();
+  // The results are picked up in batches, so that the list isn't re-sorted for every file.
+  m_loadTimerId = startTimer(50);
 }
 
 void ProjectFilesDialog::timerEvent(QTimerEvent* event) {
@@ -451,21 +503,19 @@ void ProjectFilesDialog::timerEvent(QTimerEvent* event) {
     return;
   }
 
-  switch (m_inProjectFiles->loadNextFile()) {
-    case FileList::NO_MORE_FILES:
-      finishLoadingMetadata();
-      break;
-    case FileList::LOAD_FAILED:
-      m_metadataLoadFailed = true;
-      // Fall through.
-    case FileList::LOAD_OK:
-      progressBar->setValue(progressBar->value() + 1);
-      break;
+  const FileList::LoadProgress progress(m_inProjectFiles->collectLoadedFiles());
+  if (progress.failed > 0) {
+    m_metadataLoadFailed = true;
+  }
+  progressBar->setValue(progressBar->value() + progress.loaded);
+  if (progress.done) {
+    finishLoadingMetadata();
   }
 }
 
 void ProjectFilesDialog::finishLoadingMetadata() {
   killTimer(m_loadTimerId);
+  ImageMetadataCache::instance().save();
 
   inpDirLine->setEnabled(true);
   inpDirBrowseBtn->setEnabled(true);
@@ -494,9 +544,16 @@ void ProjectFilesDialog::finishLoadingMetadata() {
 
 /*====================== ProjectFilesDialog::FileList ====================*/
 
-ProjectFilesDialog::FileList::FileList() = default;
+ProjectFilesDialog::FileList::FileList() : m_filesToLoad(0) {
+  // Reading headers is mostly waiting for the disk, or the network
+  // in case of a share, so more threads than cores pay off.
+  m_loaderPool.setMaxThreadCount(std::max(4, QThread::idealThreadCount() * 2));
+}
 
-ProjectFilesDialog::FileList::~FileList() = default;
+ProjectFilesDialog::FileList::~FileList() {
+  m_loaderPool.clear();
+  m_loaderPool.waitForDone();
+}
 
 void ProjectFilesDialog::FileList::clear() {
   if (m_items.empty()) {
@@ -564,8 +621,8 @@ Qt::ItemFlags ProjectFilesDialog::FileList::flags(const QModelIndex& index) cons
   return m_items[index.row()].flags();
 }
 
-void ProjectFilesDialog::FileList::prepareForLoadingFiles() {
-  std::deque<int> item_indexes;
+void ProjectFilesDialog::FileList::startLoadingFiles() {
+  std::vector<int> item_indexes;
   const auto num_items = static_cast<const int>(m_items.size());
   for (int i = 0; i < num_items; ++i) {
     item_indexes.push_back(i);
@@ -574,38 +631,48 @@ void ProjectFilesDialog::FileList::prepareForLoadingFiles() {
   std::sort(item_indexes.begin(), item_indexes.end(),
             [&](int lhs, int rhs) { return ItemVisualOrdering()(m_items[lhs], m_items[rhs]); });
 
-  m_itemsToLoad.swap(item_indexes);
+  m_filesToLoad = num_items;
+  for (const int item_idx : item_indexes) {
+    m_loaderPool.start(new MetadataLoadTask(*this, item_idx, m_items[item_idx].fileInfo()));
+  }
 }
 
-ProjectFilesDialog::FileList::LoadStatus ProjectFilesDialog::FileList::loadNextFile() {
-  if (m_itemsToLoad.empty()) {
-    return NO_MORE_FILES;
+ProjectFilesDialog::FileList::LoadProgress ProjectFilesDialog::FileList::collectLoadedFiles() {
+  std::vector<LoadedFile> loaded_files;
+  {
+    const QMutexLocker locker(&m_loadedFilesMutex);
+    loaded_files.swap(m_loadedFiles);
   }
 
-  const int item_idx = m_itemsToLoad.front();
-  Item& item = m_items[item_idx];
-  std::vector<ImageMetadata> per_page_metadata;
-  const QString file_path(item.fileInfo().absoluteFilePath());
-  const ImageMetadataLoader::Status st = ImageMetadataLoader::load(
-      file_path, [&](const ImageMetadata& metadata) { per_page_metadata.push_back(metadata); });
+  LoadProgress progress;
+  for (LoadedFile& loaded_file : loaded_files) {
+    Item& item = m_items[loaded_file.itemIdx];
+    if (loaded_file.ok) {
+      item.perPageMetadata().swap(loaded_file.perPageMetadata);
+      item.setStatus(Item::STATUS_LOAD_OK);
+    } else {
+      item.setStatus(Item::STATUS_LOAD_FAILED);
+      ++progress.failed;
+    }
+    const QModelIndex idx(index(loaded_file.itemIdx, 0));
+    emit dataChanged(idx, idx);
+  }
 
-  LoadStatus status;
+  progress.loaded = static_cast<int>(loaded_files.size());
+  m_filesToLoad -= progress.loaded;
+  progress.done = (m_filesToLoad <= 0);
 
-  if (st == ImageMetadataLoader::LOADED) {
-    status = LOAD_OK;
-    item.perPageMetadata().swap(per_page_metadata);
-    item.setStatus(Item::STATUS_LOAD_OK);
-  } else {
-    status = LOAD_FAILED;
-    item.setStatus(Item::STATUS_LOAD_FAILED);
-  }
-  const QModelIndex idx(index(item_idx, 0));
-  emit dataChanged(idx, idx);
+  return progress;
+}
 
-  m_itemsToLoad.pop_front();
+void ProjectFilesDialog::FileList::fileLoaded(const int item_idx,
+                                              const bool ok,
+                                              std::vector<ImageMetadata>& per_page_metadata) {
+  const QMutexLocker locker(&m_loadedFilesMutex);
 
-  return status;
-}  // ProjectFilesDialog::FileList::loadNextFile
+  m_loadedFiles.push_back(LoadedFile{item_idx, ok, std::vector<ImageMetadata>()});
+  m_loadedFiles.back().perPageMetadata.swap(per_page_metadata);
+}
 
 /*================= ProjectFilesDialog::SortedFileList ===================*/
 
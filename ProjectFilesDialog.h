@@ -67,6 +67,7 @@ class ProjectFilesDialog : public QDialog, private Ui::ProjectFilesDialog {
   class FileList;
   class SortedFileList;
   class ItemVisualOrdering;
+  class MetadataLoadTask;
 
   void setInputDir(const QString& dir, bool auto_add_files = true);
 
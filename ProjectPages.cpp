@@ -127,6 +127,27 @@ PageSequence ProjectPages::toPageSequence(const PageView view) const {
   return pages;
 }  // ProjectPages::toPageSequence
 
+std::vector<PageInfo> ProjectPages::pagesOf(const ImageId& image_id) const {
+  std::vector<PageInfo> pages;
+
+  QMutexLocker locker(&m_mutex);
+
+  for (const ImageDesc& image : m_images) {
+    if (image.id != image_id) {
+      continue;
+    }
+
+    assert(image.numLogicalPages >= 1 && image.numLogicalPages <= 2);
+    for (int j = 0; j < image.numLogicalPages; ++j) {
+      const PageId id(image.id, image.logicalPageToSubPage(j, m_subPagesInOrder));
+      pages.emplace_back(id, image.metadata, image.numLogicalPages, image.leftHalfRemoved, image.rightHalfRemoved);
+    }
+    break;
+  }
+
+  return pages;
+}
+
 void ProjectPages::listRelinkablePaths(const VirtualFunction<void, const RelinkablePath&>& sink) const {
   // It's generally a bad idea to do callbacks while holding an internal mutex,
   // so we accumulate results into this vector first.
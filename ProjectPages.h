@@ -65,6 +65,13 @@ class ProjectPages : public QObject, public ref_countable {
 
   PageSequence toPageSequence(PageView view) const;
 
+  /**
+   * \brief Returns the logical pages of a single image, as they appear in PAGE_VIEW.
+   *
+   * An empty vector is returned if there is no such image.
+   */
+  std::vector<PageInfo> pagesOf(const ImageId& image_id) const;
+
   void listRelinkablePaths(const VirtualFunction<void, const RelinkablePath&>& sink) const;
 
   /**
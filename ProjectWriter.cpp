@@ -17,11 +17,11 @@
  */
 
 #include "ProjectWriter.h"
-#include <QFile>
 #include <QFileInfo>
 #include <QTextStream>
 #include <QtXml>
 #include "AbstractFilter.h"
+#include "AtomicFileOverwriter.h"
 #include "FileNameDisambiguator.h"
 #include "ImageId.h"
 #include "ImageMetadata.h"
@@ -78,6 +78,26 @@ ProjectWriter::ProjectWriter(const intrusive_ptr<ProjectPages>& page_sequence,
 ProjectWriter::~ProjectWriter() = default;
 
 bool ProjectWriter::write(const QString& file_path, const std::vector<FilterPtr>& filters) const {
+  return writeDocument(file_path, toDocument(filters));
+}
+
+bool ProjectWriter::writeDocument(const QString& file_path, const QDomDocument& doc) {
+  // Never leave a truncated project behind, should we get killed while writing.
+  AtomicFileOverwriter overwriter;
+  QIODevice* const device = overwriter.startWriting(file_path);
+  if (!device) {
+    return false;
+  }
+
+  {
+    QTextStream strm(device);
+    doc.save(strm, 2);
+  }
+
+  return overwriter.commit();
+}
+
+QDomDocument ProjectWriter::toDocument(const std::vector<FilterPtr>& filters) const {
   QDomDocument doc;
   QDomElement root_el(doc.createElement("project"));
   doc.appendChild(root_el);
@@ -100,15 +120,8 @@ bool ProjectWriter::write(const QString& file_path, const std::vector<FilterPtr>
     filters_el.appendChild((*it)->saveSettings(*this, doc));
   }
 
-  QFile file(file_path);
-  if (file.open(QIODevice::WriteOnly)) {
-    QTextStream strm(&file);
-    doc.save(strm, 2);
-    return true;
-  }
-
-  return false;
-}  // ProjectWriter::write
+  return doc;
+}  // ProjectWriter::toDocument
 
 QDomElement ProjectWriter::processDirectories(QDomDocument& doc) const {
   QDomElement dirs_el(doc.createElement("directories"));
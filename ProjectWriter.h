@@ -56,6 +56,13 @@ class ProjectWriter {
 
   bool write(const QString& file_path, const std::vector<FilterPtr>& filters) const;
 
+  /**
+   * \brief Builds the document write() would save.
+   */
+  QDomDocument toDocument(const std::vector<FilterPtr>& filters) const;
+
+  static bool writeDocument(const QString& file_path, const QDomDocument& doc);
+
   /**
    * \p out will be called like this: out(ImageId, numeric_image_id)
    */
@@ -23,7 +23,11 @@
 #include <QtWidgets/QMessageBox>
 #include <cmath>
 #include "Application.h"
+#include "JpegOutputOptions.h"
 #include "OpenGLSupport.h"
+#include "ThumbnailCodec.h"
+#include "TiffCodecOptions.h"
+#include "WorkerThreadPool.h"
 
 SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
   ui.setupUi(this);
@@ -56,18 +60,42 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
   ui.tiffCompressionBWBox->addItem(tr("None"), COMPRESSION_NONE);
   ui.tiffCompressionBWBox->addItem(tr("LZW"), COMPRESSION_LZW);
   ui.tiffCompressionBWBox->addItem(tr("Deflate"), COMPRESSION_DEFLATE);
+#ifdef COMPRESSION_ZSTD
+  if (TiffCodecOptions::isCodecSupported(COMPRESSION_ZSTD)) {
+    ui.tiffCompressionBWBox->addItem(tr("ZSTD"), COMPRESSION_ZSTD);
+  }
+#endif
   ui.tiffCompressionBWBox->addItem(tr("CCITT G4"), COMPRESSION_CCITTFAX4);
 
-  ui.tiffCompressionBWBox->setCurrentIndex(
-      ui.tiffCompressionBWBox->findData(settings.value("settings/bw_compression", COMPRESSION_CCITTFAX4).toInt()));
-
   ui.tiffCompressionColorBox->addItem(tr("None"), COMPRESSION_NONE);
   ui.tiffCompressionColorBox->addItem(tr("LZW"), COMPRESSION_LZW);
   ui.tiffCompressionColorBox->addItem(tr("Deflate"), COMPRESSION_DEFLATE);
+#ifdef COMPRESSION_ZSTD
+  if (TiffCodecOptions::isCodecSupported(COMPRESSION_ZSTD)) {
+    ui.tiffCompressionColorBox->addItem(tr("ZSTD"), COMPRESSION_ZSTD);
+  }
+#endif
   ui.tiffCompressionColorBox->addItem(tr("JPEG"), COMPRESSION_JPEG);
 
-  ui.tiffCompressionColorBox->setCurrentIndex(
-      ui.tiffCompressionColorBox->findData(settings.value("settings/color_compression", COMPRESSION_LZW).toInt()));
+  applyTiffCodecOptions(TiffCodecOptions::fromSettings());
+  connect(ui.tiffFastProfileBtn, &QPushButton::clicked, [this]() {
+    applyTiffCodecOptions(TiffCodecOptions::fastProfile());
+  });
+
+  ui.jpegSubsamplingBox->addItem(tr("4:4:4 (None)"), JpegWriter::SUBSAMPLING_444);
+  ui.jpegSubsamplingBox->addItem(tr("4:2:2"), JpegWriter::SUBSAMPLING_422);
+  ui.jpegSubsamplingBox->addItem(tr("4:2:0"), JpegWriter::SUBSAMPLING_420);
+
+  const JpegOutputOptions jpeg_options(JpegOutputOptions::fromSettings());
+  ui.jpegOutputCB->setChecked(jpeg_options.isEnabled());
+  ui.jpegQualitySB->setValue(jpeg_options.quality());
+  ui.jpegSubsamplingBox->setCurrentIndex(ui.jpegSubsamplingBox->findData(int(jpeg_options.subsampling())));
+  ui.jpegQualitySB->setEnabled(jpeg_options.isEnabled());
+  ui.jpegSubsamplingBox->setEnabled(jpeg_options.isEnabled());
+  connect(ui.jpegOutputCB, &QCheckBox::toggled, ui.jpegQualitySB, &QWidget::setEnabled);
+  connect(ui.jpegOutputCB, &QCheckBox::toggled, ui.jpegSubsamplingBox, &QWidget::setEnabled);
+
+  ui.outputContainerCB->setChecked(settings.value("settings/output_container", false).toBool());
 
   if (auto* app = dynamic_cast<Application*>(qApp)) {
     for (const QString& locale : app->getLanguagesList()) {
@@ -96,6 +124,7 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
 
   connect(ui.buttonBox, SIGNAL(accepted()), SLOT(commitChanges()));
   ui.autoSaveProjectCB->setChecked(settings.value("settings/auto_save_project").toBool());
+  ui.intermediateCacheCB->setChecked(settings.value("settings/intermediate_cache", false).toBool());
   ui.highlightDeviationCB->setChecked(settings.value("settings/highlight_deviation", true).toBool());
 
   connect(ui.colorSchemeBox, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), [this](int) {
@@ -103,9 +132,16 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
                              tr("ScanTailor need to be restarted to apply the color scheme changes."));
   });
 
+  ui.memoryBudgetSB->setValue(
+      settings.value("settings/processing_memory_budget_mb", WorkerThreadPool::defaultMemoryBudgetMb()).toInt());
+
   ui.thumbnailQualitySB->setValue(settings.value("settings/thumbnail_quality", QSize(200, 200)).toSize().width());
   ui.thumbnailSizeSB->setValue(
       settings.value("settings/max_logical_thumb_size", QSizeF(250, 160)).toSizeF().toSize().width());
+  ui.thumbnailFormatBox->addItem(tr("QOI"), ThumbnailCodec::QOI);
+  ui.thumbnailFormatBox->addItem(tr("PNG"), ThumbnailCodec::PNG);
+  ui.thumbnailFormatBox->setCurrentIndex(
+      ui.thumbnailFormatBox->findData(settings.value("settings/thumbnail_format", ThumbnailCodec::QOI).toInt()));
 }
 
 SettingsDialog::~SettingsDialog() = default;
@@ -114,6 +150,7 @@ void SettingsDialog::commitChanges() {
   QSettings settings;
   settings.setValue("settings/enable_opengl", ui.enableOpenglCb->isChecked());
   settings.setValue("settings/auto_save_project", ui.autoSaveProjectCB->isChecked());
+  settings.setValue("settings/intermediate_cache", ui.intermediateCacheCB->isChecked());
   settings.setValue("settings/highlight_deviation", ui.highlightDeviationCB->isChecked());
   if (ui.colorSchemeBox->currentIndex() == 0) {
     settings.setValue("settings/color_scheme", "dark");
@@ -125,7 +162,18 @@ void SettingsDialog::commitChanges() {
 
   settings.setValue("settings/bw_compression", ui.tiffCompressionBWBox->currentData().toInt());
   settings.setValue("settings/color_compression", ui.tiffCompressionColorBox->currentData().toInt());
+  settings.setValue("settings/tiff_compression_level", ui.tiffCompressionLevelSB->value());
+  settings.setValue("settings/tiff_predictor", ui.tiffPredictorCB->isChecked());
+  settings.setValue("settings/jpeg_output", ui.jpegOutputCB->isChecked());
+  settings.setValue("settings/jpeg_quality", ui.jpegQualitySB->value());
+  settings.setValue("settings/jpeg_subsampling", ui.jpegSubsamplingBox->currentData().toInt());
+  settings.setValue("settings/output_container", ui.outputContainerCB->isChecked());
   settings.setValue("settings/language", ui.languageBox->currentData().toString());
+  // The default depends on the machine, so it's only stored once changed.
+  if (settings.contains("settings/processing_memory_budget_mb")
+      || (ui.memoryBudgetSB->value() != WorkerThreadPool::defaultMemoryBudgetMb())) {
+    settings.setValue("settings/processing_memory_budget_mb", ui.memoryBudgetSB->value());
+  }
 
   settings.setValue("settings/deskewDeviationCoef", ui.deskewDeviationCoefSB->value());
   settings.setValue("settings/deskewDeviationThreshold", ui.deskewDeviationThresholdSB->value());
@@ -146,6 +194,7 @@ void SettingsDialog::commitChanges() {
     const double height = std::round((width * (16.0 / 25.0)) * 100) / 100;
     settings.setValue("settings/max_logical_thumb_size", QSizeF(width, height));
   }
+  settings.setValue("settings/thumbnail_format", ui.thumbnailFormatBox->currentData().toInt());
 
   emit settingsChanged();
 }
@@ -153,3 +202,10 @@ void SettingsDialog::commitChanges() {
 void SettingsDialog::blackOnWhiteDetectionToggled(bool checked) {
   ui.blackOnWhiteDetectionAtOutputCB->setEnabled(checked);
 }
+
+void SettingsDialog::applyTiffCodecOptions(const TiffCodecOptions& options) {
+  ui.tiffCompressionBWBox->setCurrentIndex(ui.tiffCompressionBWBox->findData(int(options.bwCompression())));
+  ui.tiffCompressionColorBox->setCurrentIndex(ui.tiffCompressionColorBox->findData(int(options.colorCompression())));
+  ui.tiffCompressionLevelSB->setValue(options.level());
+  ui.tiffPredictorCB->setChecked(options.predictor());
+}
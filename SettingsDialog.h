@@ -22,6 +22,8 @@
 #include <QDialog>
 #include "ui_SettingsDialog.h"
 
+class TiffCodecOptions;
+
 class SettingsDialog : public QDialog {
   Q_OBJECT
  public:
@@ -38,6 +40,8 @@ class SettingsDialog : public QDialog {
   void blackOnWhiteDetectionToggled(bool checked);
 
  private:
+  void applyTiffCodecOptions(const TiffCodecOptions& options);
+
   Ui::SettingsDialog ui;
 };
 
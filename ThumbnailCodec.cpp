@@ -0,0 +1,293 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ThumbnailCodec.h"
+#include <QBuffer>
+#include <QSettings>
+#include <cstring>
+#include <limits>
+#include "ImageLoader.h"
+
+namespace {
+// The format follows QOI ("Quite OK Image"), except for the header.
+const char QOI_SIGNATURE[] = "STQI";
+const int QOI_SIGNATURE_SIZE = 4;
+const uchar QOI_VERSION = 1;
+const int QOI_HEADER_SIZE = QOI_SIGNATURE_SIZE + 2 + 4 + 4;
+const uchar QOI_END_MARKER[] = {0, 0, 0, 0, 0, 0, 0, 1};
+const int QOI_END_MARKER_SIZE = sizeof(QOI_END_MARKER);
+const int QOI_MAX_DIMENSION = 32767;
+
+const int QOI_OP_INDEX = 0x00;
+const int QOI_OP_DIFF = 0x40;
+const int QOI_OP_LUMA = 0x80;
+const int QOI_OP_RUN = 0xc0;
+const int QOI_OP_RGB = 0xfe;
+const int QOI_OP_RGBA = 0xff;
+const int QOI_OP_MASK = 0xc0;
+const int QOI_MAX_RUN = 62;
+
+inline int qoiHash(const QRgb px) {
+  return (qRed(px) * 3 + qGreen(px) * 5 + qBlue(px) * 7 + qAlpha(px) * 11) % 64;
+}
+
+inline void putUint32(uchar* out, const quint32 value) {
+  out[0] = uchar(value >> 24);
+  out[1] = uchar(value >> 16);
+  out[2] = uchar(value >> 8);
+  out[3] = uchar(value);
+}
+
+inline quint32 getUint32(const uchar* in) {
+  return (quint32(in[0]) << 24) | (quint32(in[1]) << 16) | (quint32(in[2]) << 8) | quint32(in[3]);
+}
+}  // namespace
+
+ThumbnailCodec::Format ThumbnailCodec::currentFormat() {
+  static const Format format = []() {
+    QSettings settings;
+    const int value = settings.value("settings/thumbnail_format", int(QOI)).toInt();
+    return (value == PNG) ? PNG : QOI;
+  }();
+
+  return format;
+}
+
+QByteArray ThumbnailCodec::encode(const QImage& image, const Format format) {
+  if (image.isNull()) {
+    return QByteArray();
+  }
+
+  if (format == QOI) {
+    const QByteArray data(encodeQoi(image));
+    if (!data.isNull()) {
+      return data;
+    }
+    // Too large for QOI, which PNG may still handle.
+  }
+
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::WriteOnly);
+  if (!image.save(&buffer, "PNG")) {
+    return QByteArray();
+  }
+
+  return data;
+}
+
+QImage ThumbnailCodec::decode(const QByteArray& data) {
+  if (data.startsWith(QOI_SIGNATURE)) {
+    return decodeQoi(data);
+  }
+
+  QByteArray png_data(data);
+  QBuffer buffer(&png_data);
+  buffer.open(QIODevice::ReadOnly);
+
+  return ImageLoader::load(buffer, 0);
+}
+
+QByteArray ThumbnailCodec::encodeQoi(const QImage& image) {
+  const bool has_alpha = image.hasAlphaChannel();
+  const QImage argb(image.convertToFormat(has_alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32));
+  const int width = argb.width();
+  const int height = argb.height();
+  if ((width > QOI_MAX_DIMENSION) || (height > QOI_MAX_DIMENSION)) {
+    return QByteArray();
+  }
+
+  // The worst case is every pixel taking an RGBA op.
+  const qint64 max_size = QOI_HEADER_SIZE + qint64(width) * height * 5 + QOI_END_MARKER_SIZE;
+  if (max_size > std::numeric_limits<int>::max()) {
+    return QByteArray();
+  }
+
+  QByteArray data;
+  data.resize(int(max_size));
+  auto* const out = reinterpret_cast<uchar*>(data.data());
+  int pos = 0;
+
+  std::memcpy(out, QOI_SIGNATURE, QOI_SIGNATURE_SIZE);
+  pos += QOI_SIGNATURE_SIZE;
+  out[pos++] = QOI_VERSION;
+  out[pos++] = uchar(has_alpha ? 4 : 3);
+  putUint32(out + pos, quint32(width));
+  pos += 4;
+  putUint32(out + pos, quint32(height));
+  pos += 4;
+
+  QRgb index[64] = {};
+  QRgb prev = qRgba(0, 0, 0, 255);
+  int run = 0;
+
+  for (int y = 0; y < height; ++y) {
+    const auto* line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+    for (int x = 0; x < width; ++x) {
+      const QRgb px = line[x];
+      if (px == prev) {
+        if (++run == QOI_MAX_RUN) {
+          out[pos++] = uchar(QOI_OP_RUN | (run - 1));
+          run = 0;
+        }
+        continue;
+      }
+
+      if (run > 0) {
+        out[pos++] = uchar(QOI_OP_RUN | (run - 1));
+        run = 0;
+      }
+
+      const int hash = qoiHash(px);
+      if (index[hash] == px) {
+        out[pos++] = uchar(QOI_OP_INDEX | hash);
+      } else {
+        index[hash] = px;
+
+        if (qAlpha(px) == qAlpha(prev)) {
+          const auto vr = static_cast<signed char>(qRed(px) - qRed(prev));
+          const auto vg = static_cast<signed char>(qGreen(px) - qGreen(prev));
+          const auto vb = static_cast<signed char>(qBlue(px) - qBlue(prev));
+          const int vg_r = vr - vg;
+          const int vg_b = vb - vg;
+
+          if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+            out[pos++] = uchar(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+          } else if ((vg_r > -9) && (vg_r < 8) && (vg > -33) && (vg < 32) && (vg_b > -9) && (vg_b < 8)) {
+            out[pos++] = uchar(QOI_OP_LUMA | (vg + 32));
+            out[pos++] = uchar(((vg_r + 8) << 4) | (vg_b + 8));
+          } else {
+            out[pos++] = uchar(QOI_OP_RGB);
+            out[pos++] = uchar(qRed(px));
+            out[pos++] = uchar(qGreen(px));
+            out[pos++] = uchar(qBlue(px));
+          }
+        } else {
+          out[pos++] = uchar(QOI_OP_RGBA);
+          out[pos++] = uchar(qRed(px));
+          out[pos++] = uchar(qGreen(px));
+          out[pos++] = uchar(qBlue(px));
+          out[pos++] = uchar(qAlpha(px));
+        }
+      }
+
+      prev = px;
+    }
+  }
+
+  if (run > 0) {
+    out[pos++] = uchar(QOI_OP_RUN | (run - 1));
+  }
+
+  std::memcpy(out + pos, QOI_END_MARKER, QOI_END_MARKER_SIZE);
+  pos += QOI_END_MARKER_SIZE;
+  data.resize(pos);
+
+  return data;
+}  // ThumbnailCodec::encodeQoi
+
+QImage ThumbnailCodec::decodeQoi(const QByteArray& data) {
+  if (data.size() < QOI_HEADER_SIZE + QOI_END_MARKER_SIZE) {
+    return QImage();
+  }
+
+  const auto* const in = reinterpret_cast<const uchar*>(data.constData());
+  int pos = QOI_SIGNATURE_SIZE;
+  if (in[pos++] != QOI_VERSION) {
+    return QImage();
+  }
+  const int channels = in[pos++];
+  const quint32 width = getUint32(in + pos);
+  pos += 4;
+  const quint32 height = getUint32(in + pos);
+  pos += 4;
+  if (((channels != 3) && (channels != 4)) || (width == 0) || (height == 0) || (width > QOI_MAX_DIMENSION)
+      || (height > QOI_MAX_DIMENSION)) {
+    return QImage();
+  }
+
+  QImage image(int(width), int(height), (channels == 4) ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+  if (image.isNull()) {
+    return QImage();
+  }
+  // RGB32 requires the alpha to be opaque, whatever the data says.
+  const QRgb alpha_mask = (channels == 4) ? 0 : qRgba(0, 0, 0, 255);
+
+  const int end = data.size() - QOI_END_MARKER_SIZE;
+  QRgb index[64] = {};
+  QRgb px = qRgba(0, 0, 0, 255);
+  int run = 0;
+
+  for (int y = 0; y < int(height); ++y) {
+    auto* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+    for (int x = 0; x < int(width); ++x) {
+      if (run > 0) {
+        --run;
+        line[x] = px | alpha_mask;
+        continue;
+      }
+      if (pos >= end) {
+        return QImage();
+      }
+
+      const int b1 = in[pos++];
+      if (b1 == QOI_OP_RGB) {
+        if (pos + 3 > end) {
+          return QImage();
+        }
+        px = qRgba(in[pos], in[pos + 1], in[pos + 2], qAlpha(px));
+        pos += 3;
+      } else if (b1 == QOI_OP_RGBA) {
+        if (pos + 4 > end) {
+          return QImage();
+        }
+        px = qRgba(in[pos], in[pos + 1], in[pos + 2], in[pos + 3]);
+        pos += 4;
+      } else {
+        switch (b1 & QOI_OP_MASK) {
+          case QOI_OP_INDEX:
+            px = index[b1];
+            break;
+          case QOI_OP_DIFF:
+            px = qRgba((qRed(px) + ((b1 >> 4) & 0x03) - 2) & 0xff, (qGreen(px) + ((b1 >> 2) & 0x03) - 2) & 0xff,
+                       (qBlue(px) + (b1 & 0x03) - 2) & 0xff, qAlpha(px));
+            break;
+          case QOI_OP_LUMA: {
+            if (pos + 1 > end) {
+              return QImage();
+            }
+            const int b2 = in[pos++];
+            const int vg = (b1 & 0x3f) - 32;
+            px = qRgba((qRed(px) + vg - 8 + ((b2 >> 4) & 0x0f)) & 0xff, (qGreen(px) + vg) & 0xff,
+                       (qBlue(px) + vg - 8 + (b2 & 0x0f)) & 0xff, qAlpha(px));
+            break;
+          }
+          default:  // QOI_OP_RUN
+            run = b1 & 0x3f;
+            break;
+        }
+      }
+
+      index[qoiHash(px)] = px;
+      line[x] = px | alpha_mask;
+    }
+  }
+
+  return image;
+}  // ThumbnailCodec::decodeQoi
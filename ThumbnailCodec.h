@@ -0,0 +1,68 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef THUMBNAIL_CODEC_H_
+#define THUMBNAIL_CODEC_H_
+
+#include <QByteArray>
+#include <QImage>
+
+/**
+ * \brief Encodes and decodes the thumbnails kept in ThumbnailStore.
+ *
+ * Besides PNG, thumbnails may be stored in a QOI-like format, which takes
+ * a single pass over the pixels in both directions and is several times
+ * faster than PNG, at the cost of somewhat larger data.  Its data starts with
+ * a signature and a version number, so decode() accepts whatever format
+ * a thumbnail was written in, and a thumbnail in an unknown version
+ * is simply recreated.
+ */
+class ThumbnailCodec {
+ public:
+  enum Format { PNG, QOI };
+
+  /**
+   * \brief The format as set in the settings dialog.
+   *
+   * The settings are only read once, as thumbnails are written
+   * from worker threads.
+   */
+  static Format currentFormat();
+
+  /**
+   * Images too large for QOI are written as PNG.
+   *
+   * \return The encoded image, or a null array on failure.
+   */
+  static QByteArray encode(const QImage& image, Format format);
+
+  /**
+   * \return The decoded image, or a null image if \p data is corrupted,
+   *         or in a format we don't know.
+   */
+  static QImage decode(const QByteArray& data);
+
+ private:
+  static QByteArray encodeQoi(const QImage& image);
+
+  static QImage decodeQoi(const QByteArray& data);
+};
+
+
+#endif  // ifndef THUMBNAIL_CODEC_H_
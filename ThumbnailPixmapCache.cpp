@@ -17,22 +17,32 @@
  */
 
 #include "ThumbnailPixmapCache.h"
+#include <QBuffer>
 #include <QCoreApplication>
 #include <QCryptographicHash>
 #include <QDebug>
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
+#include <QRect>
+#include <QRunnable>
 #include <QThread>
+#include <QThreadPool>
 #include <boost/foreach.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
-#include "AtomicFileOverwriter.h"
+#include <deque>
 #include "ImageId.h"
 #include "ImageLoader.h"
+#include "ImageMetadata.h"
+#include "ImageMetadataLoader.h"
 #include "OutOfMemoryHandler.h"
+#include "OutputContainer.h"
 #include "RelinkablePath.h"
+#include "ThumbnailCodec.h"
+#include "ThumbnailStore.h"
 #include "imageproc/GrayImage.h"
 #include "imageproc/Scale.h"
 
@@ -44,15 +54,16 @@ class ThumbnailPixmapCache::Item {
  public:
   enum Status {
     /**
-     * The background threaed hasn't touched it yet.
+     * The background threads haven't touched it yet.
      */
     QUEUED,
 
     /**
      * The image is currently being loaded by a background
-     * thread, or it has been loaded, but the main thread
-     * hasn't yet received the loaded image, or it's currently
-     * converting it to a pixmap.
+     * thread, or waits for a decoding one after its thumbnail
+     * wasn't found on disk, or it has been loaded, but the main
+     * thread hasn't yet received the loaded image, or it's
+     * currently converting it to a pixmap.
      */
     IN_PROGRESS,
 
@@ -95,7 +106,14 @@ class ThumbnailPixmapCache::Item {
 };
 
 
-class ThumbnailPixmapCache::Impl : public QThread {
+/**
+ * Requests are served by two sets of worker threads.  The disk lane takes
+ * QUEUED items, newest first, and loads their thumbnails from disk.  Those
+ * not found there are passed to the decode lane, which makes them out of
+ * the full size images.  As the lanes have their own threads, a thumbnail
+ * found on disk never waits behind decoding and scaling an image.
+ */
+class ThumbnailPixmapCache::Impl : public QObject {
  public:
   Impl(const QString& thumb_dir, const QSize& max_thumb_size, int max_cached_pixmaps, int expiration_threshold);
 
@@ -117,12 +135,13 @@ class ThumbnailPixmapCache::Impl : public QThread {
   void recreateThumbnail(const ImageId& image_id, const QImage& image);
 
  protected:
-  void run() override;
-
   void customEvent(QEvent* e) override;
 
  private:
+  enum Lane { DISK_LANE, DECODE_LANE };
+
   class LoadResultEvent;
+  class Worker;
   class ItemsByKeyTag;
   class LoadQueueTag;
   class RemoveQueueTag;
@@ -138,24 +157,61 @@ class ThumbnailPixmapCache::Impl : public QThread {
   typedef Container::index<LoadQueueTag>::type LoadQueue;
   typedef Container::index<RemoveQueueTag>::type RemoveQueue;
 
-  class BackgroundLoader : public QObject {
-   public:
-    explicit BackgroundLoader(Impl& owner);
+  /**
+   * \brief Starts another worker for \p lane, unless it has as many
+   *        as its pool has threads.  Must be called with m_mutex locked.
+   */
+  void startWorkerLocked(Lane lane);
 
-   protected:
-    void customEvent(QEvent* e) override;
+  /**
+   * \brief Serves the requests of \p lane until there are none left.
+   *        Called from a worker thread.
+   */
+  void processLane(Lane lane);
 
-   private:
-    Impl& m_owner;
-  };
+  /**
+   * \brief Takes the next item of \p lane, marking QUEUED items
+   *        as IN_PROGRESS.  Must be called with m_mutex locked.
+   *
+   * \return false if there is nothing to take.
+   */
+  bool takeNextItemLocked(Lane lane, LoadQueue::iterator& lq_it);
 
+  /**
+   * \brief Loads a thumbnail from the store.
+   *
+   * \param legacy_dir If not empty, a thumbnail missing from the store is
+   *        looked up as an individual file there, and moved into the store
+   *        if found.
+   */
+  static QImage loadThumbnail(const ImageId& image_id,
+                              ThumbnailStore& store,
+                              const QString& legacy_dir,
+                              const QSize& max_thumb_size);
 
-  void backgroundProcessing();
+  static QImage createThumbnail(const ImageId& image_id, ThumbnailStore& store, const QSize& max_thumb_size);
 
-  static QImage loadSaveThumbnail(const ImageId& image_id, const QString& thumb_dir, const QSize& max_thumb_size);
+  static QImage loadSaveThumbnail(const ImageId& image_id,
+                                  ThumbnailStore& store,
+                                  const QString& legacy_dir,
+                                  const QSize& max_thumb_size);
 
+  static bool storeThumbnail(const ImageId& image_id,
+                             ThumbnailStore& store,
+                             const QSize& max_thumb_size,
+                             const QImage& thumbnail);
+
+  /**
+   * \return Where the thumbnail used to be stored before ThumbnailStore.
+   */
   static QString getThumbFilePath(const ImageId& image_id, const QString& thumb_dir, const QSize& max_thumb_size);
 
+  /**
+   * \return The directory to look for thumbnails stored as individual files
+   *         in, or an empty string if there are none in \p thumb_dir.
+   */
+  static QString legacyThumbDir(const QString& thumb_dir);
+
   static QImage makeThumbnail(const QImage& image, const QSize& max_thumb_size);
 
   void queuedToInProgress(const LoadQueue::iterator& lq_it);
@@ -175,7 +231,6 @@ class ThumbnailPixmapCache::Impl : public QThread {
   void cachePixmapLocked(const ImageId& image_id, const QPixmap& pixmap);
 
   mutable QMutex m_mutex;
-  BackgroundLoader m_backgroundLoader;
   Container m_items;
   ItemsByKey& m_itemsByKey; /**< ImageId => Item mapping */
 
@@ -203,7 +258,20 @@ class ThumbnailPixmapCache::Impl : public QThread {
    */
   RemoveQueue::iterator m_endOfLoadedItems;
 
+  /**
+   * IN_PROGRESS items whose thumbnails weren't found on disk, the most
+   * recently requested first.
+   */
+  std::deque<LoadQueue::iterator> m_decodeQueue;
+
+  QThreadPool m_diskPool;
+  QThreadPool m_decodePool;
+  int m_numDiskWorkers;
+  int m_numDecodeWorkers;
+
   QString m_thumbDir;
+  std::shared_ptr<ThumbnailStore> m_store;
+  QString m_legacyThumbDir;
   QSize m_maxThumbSize;
   int m_maxCachedPixmaps;
 
@@ -221,11 +289,22 @@ class ThumbnailPixmapCache::Impl : public QThread {
    */
   int m_totalLoadAttempts;
 
-  bool m_threadStarted;
   bool m_shuttingDown;
 };
 
 
+class ThumbnailPixmapCache::Impl::Worker : public QRunnable {
+ public:
+  Worker(Impl& owner, Lane lane) : m_owner(owner), m_lane(lane) { setAutoDelete(true); }
+
+  void run() override { m_owner.processLane(m_lane); }
+
+ private:
+  Impl& m_owner;
+  Lane m_lane;
+};
+
+
 class ThumbnailPixmapCache::Impl::LoadResultEvent : public QEvent {
  public:
   LoadResultEvent(const Impl::LoadQueue::iterator& lq_it, const QImage& image, ThumbnailLoadResult::Status status);
@@ -299,12 +378,13 @@ ThumbnailPixmapCache::Impl::Impl(const QString& thumb_dir,
                                  const QSize& max_thumb_size,
                                  const int max_cached_pixmaps,
                                  const int expiration_threshold)
-    : m_backgroundLoader(*this),
-      m_items(),
+    : m_items(),
       m_itemsByKey(m_items.get<ItemsByKeyTag>()),
       m_loadQueue(m_items.get<LoadQueueTag>()),
       m_removeQueue(m_items.get<RemoveQueueTag>()),
       m_endOfLoadedItems(m_removeQueue.end()),
+      m_numDiskWorkers(0),
+      m_numDecodeWorkers(0),
       m_thumbDir(thumb_dir),
       m_maxThumbSize(max_thumb_size),
       m_maxCachedPixmaps(max_cached_pixmaps),
@@ -312,30 +392,31 @@ ThumbnailPixmapCache::Impl::Impl(const QString& thumb_dir,
       m_numQueuedItems(0),
       m_numLoadedItems(0),
       m_totalLoadAttempts(0),
-      m_threadStarted(false),
       m_shuttingDown(false) {
   // Note that QDir::mkdir() will fail if the parent directory,
   // that is $OUT/cache doesn't exist. We want that behaviour,
   // as otherwise when loading a project from a different machine,
   // a whole bunch of bogus directories would be created.
   QDir().mkdir(m_thumbDir);
+  m_store = ThumbnailStore::forDir(m_thumbDir);
+  m_legacyThumbDir = legacyThumbDir(m_thumbDir);
 
-  m_backgroundLoader.moveToThread(this);
+  // Loading small files from disk is mostly waiting for I/O.
+  m_diskPool.setMaxThreadCount(2);
+  // Leave a core to the GUI thread.
+  m_decodePool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
 }
 
 ThumbnailPixmapCache::Impl::~Impl() {
   {
     const QMutexLocker locker(&m_mutex);
-
-    if (!m_threadStarted) {
-      return;
-    }
-
     m_shuttingDown = true;
+    m_decodeQueue.clear();
   }
 
-  quit();
-  wait();
+  // Workers stop after the image they are working on.
+  m_diskPool.waitForDone();
+  m_decodePool.waitForDone();
 }
 
 void ThumbnailPixmapCache::Impl::setThumbDir(const QString& thumb_dir) {
@@ -346,6 +427,8 @@ void ThumbnailPixmapCache::Impl::setThumbDir(const QString& thumb_dir) {
   }
 
   m_thumbDir = thumb_dir;
+  m_store = ThumbnailStore::forDir(m_thumbDir);
+  m_legacyThumbDir = legacyThumbDir(m_thumbDir);
 
   for (const Item& item : m_loadQueue) {
     // This trick will make all queued tasks to expire.
@@ -384,12 +467,13 @@ ThumbnailPixmapCache::Status ThumbnailPixmapCache::Impl::request(
   }
 
   if (load_now) {
-    const QString thumb_dir(m_thumbDir);
+    const std::shared_ptr<ThumbnailStore> store(m_store);
+    const QString legacy_dir(m_legacyThumbDir);
     const QSize max_thumb_size(m_maxThumbSize);
 
     locker.unlock();
 
-    pixmap = QPixmap::fromImage(loadSaveThumbnail(image_id, thumb_dir, max_thumb_size));
+    pixmap = QPixmap::fromImage(loadSaveThumbnail(image_id, *store, legacy_dir, max_thumb_size));
     if (pixmap.isNull()) {
       return LOAD_FAILED;
     }
@@ -433,16 +517,8 @@ ThumbnailPixmapCache::Status ThumbnailPixmapCache::Impl::request(
   }
   lq_it->completionHandlers.push_back(*completion_handler);
 
-  if (m_numQueuedItems++ == 0) {
-    if (m_threadStarted) {
-      // Wake the background thread up.
-      QCoreApplication::postEvent(&m_backgroundLoader, new QEvent(QEvent::User));
-    } else {
-      // Start the background thread.
-      start();
-      m_threadStarted = true;
-    }
-  }
+  ++m_numQueuedItems;
+  startWorkerLocked(DISK_LANE);
 
   return QUEUED;
 }  // ThumbnailPixmapCache::Impl::request
@@ -457,22 +533,15 @@ void ThumbnailPixmapCache::Impl::ensureThumbnailExists(const ImageId& image_id,
   }
 
   QMutexLocker locker(&m_mutex);
-  const QString thumb_dir(m_thumbDir);
+  const std::shared_ptr<ThumbnailStore> store(m_store);
   const QSize max_thumb_size(m_maxThumbSize);
   locker.unlock();
 
-  const QString thumb_file_path(getThumbFilePath(image_id, thumb_dir, m_maxThumbSize));
-  if (QFile::exists(thumb_file_path)) {
+  if (store->contains(image_id, max_thumb_size)) {
     return;
   }
 
-  const QImage thumbnail(makeThumbnail(image, max_thumb_size));
-
-  AtomicFileOverwriter overwriter;
-  QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-  if (iodev && thumbnail.save(iodev, "PNG")) {
-    overwriter.commit();
-  }
+  storeThumbnail(image_id, *store, max_thumb_size, makeThumbnail(image, max_thumb_size));
 }
 
 void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& image_id, const QImage& image) {
@@ -485,24 +554,12 @@ void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& image_id, cons
   }
 
   QMutexLocker locker(&m_mutex);
-  const QString thumb_dir(m_thumbDir);
+  const std::shared_ptr<ThumbnailStore> store(m_store);
   const QSize max_thumb_size(m_maxThumbSize);
   locker.unlock();
 
-  const QString thumb_file_path(getThumbFilePath(image_id, thumb_dir, m_maxThumbSize));
-  const QImage thumbnail(makeThumbnail(image, max_thumb_size));
-  bool thumb_written = false;
-
   // Note that we may be called from multiple threads at the same time.
-  AtomicFileOverwriter overwriter;
-  QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-  if (iodev && thumbnail.save(iodev, "PNG")) {
-    thumb_written = overwriter.commit();
-  } else {
-    overwriter.abort();
-  }
-
-  if (!thumb_written) {
+  if (!storeThumbnail(image_id, *store, max_thumb_size, makeThumbnail(image, max_thumb_size))) {
     return;
   }
 
@@ -531,16 +588,22 @@ void ThumbnailPixmapCache::Impl::recreateThumbnail(const ImageId& image_id, cons
   }
 }  // ThumbnailPixmapCache::Impl::recreateThumbnail
 
-void ThumbnailPixmapCache::Impl::run() {
-  backgroundProcessing();
-  exec();  // Wait for further processing requests (via custom events).
-}
-
 void ThumbnailPixmapCache::Impl::customEvent(QEvent* e) {
   processLoadResult(dynamic_cast<LoadResultEvent*>(e));
 }
 
-void ThumbnailPixmapCache::Impl::backgroundProcessing() {
+void ThumbnailPixmapCache::Impl::startWorkerLocked(const Lane lane) {
+  QThreadPool& pool = (lane == DISK_LANE) ? m_diskPool : m_decodePool;
+  int& num_workers = (lane == DISK_LANE) ? m_numDiskWorkers : m_numDecodeWorkers;
+  if (m_shuttingDown || (num_workers >= pool.maxThreadCount())) {
+    return;
+  }
+
+  ++num_workers;
+  pool.start(new Worker(*this, lane));
+}
+
+void ThumbnailPixmapCache::Impl::processLane(const Lane lane) {
   // This method is called from a background thread.
   assert(QCoreApplication::instance()->thread() != QThread::currentThread());
 
@@ -549,32 +612,24 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
       // We are going to initialize these while holding the mutex.
       LoadQueue::iterator lq_it;
       ImageId image_id;
-      QString thumb_dir;
+      std::shared_ptr<ThumbnailStore> store;
+      QString legacy_dir;
       QSize max_thumb_size;
 
       {
         const QMutexLocker locker(&m_mutex);
 
-        if (m_shuttingDown || m_items.empty()) {
+        if (!takeNextItemLocked(lane, lq_it)) {
+          // Deciding to stop and taking an item happen under the same lock
+          // as adding an item and starting a worker, so nothing is left behind.
+          if (lane == DISK_LANE) {
+            --m_numDiskWorkers;
+          } else {
+            --m_numDecodeWorkers;
+          }
           break;
         }
 
-        lq_it = m_loadQueue.begin();
-        image_id = lq_it->imageId;
-
-        if (lq_it->status != Item::QUEUED) {
-          // All QUEUED items precede any other items
-          // in the load queue, so it means there are no
-          // QUEUED items at all.
-          assert(m_numQueuedItems == 0);
-          break;
-        }
-
-        // By marking the item as IN_PROGRESS, we prevent it
-        // from being processed again before the GUI thread
-        // receives our LoadResultEvent.
-        queuedToInProgress(lq_it);
-
         if (m_totalLoadAttempts - lq_it->precedingLoadAttempts > m_expirationThreshold) {
           // Expire this request.  The reasoning behind
           // request expiration is described in
@@ -585,14 +640,35 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
           continue;
         }
 
-        // Expired requests don't count as load attempts.
-        ++m_totalLoadAttempts;
+        if (lane == DISK_LANE) {
+          // Expired requests don't count as load attempts.
+          // Nor does passing a request to the decode lane.
+          ++m_totalLoadAttempts;
+        }
 
         // Copy those while holding the mutex.
-        thumb_dir = m_thumbDir;
+        image_id = lq_it->imageId;
+        store = m_store;
+        legacy_dir = m_legacyThumbDir;
         max_thumb_size = m_maxThumbSize;
       }  // mutex scope
-      const QImage image(loadSaveThumbnail(image_id, thumb_dir, max_thumb_size));
+
+      if (lane == DISK_LANE) {
+        const QImage image(loadThumbnail(image_id, *store, legacy_dir, max_thumb_size));
+        if (!image.isNull()) {
+          postLoadResult(lq_it, image, ThumbnailLoadResult::LOADED);
+          continue;
+        }
+
+        const QMutexLocker locker(&m_mutex);
+        if (!m_shuttingDown) {
+          m_decodeQueue.push_front(lq_it);
+          startWorkerLocked(DECODE_LANE);
+        }
+        continue;
+      }
+
+      const QImage image(createThumbnail(image_id, *store, max_thumb_size));
 
       const ThumbnailLoadResult::Status status
           = image.isNull() ? ThumbnailLoadResult::LOAD_FAILED : ThumbnailLoadResult::LOADED;
@@ -601,29 +677,132 @@ void ThumbnailPixmapCache::Impl::backgroundProcessing() {
       OutOfMemoryHandler::instance().handleOutOfMemorySituation();
     }
   }
-}  // ThumbnailPixmapCache::Impl::backgroundProcessing
+}  // ThumbnailPixmapCache::Impl::processLane
 
-QImage ThumbnailPixmapCache::Impl::loadSaveThumbnail(const ImageId& image_id,
-                                                     const QString& thumb_dir,
-                                                     const QSize& max_thumb_size) {
-  const QString thumb_file_path(getThumbFilePath(image_id, thumb_dir, max_thumb_size));
+bool ThumbnailPixmapCache::Impl::takeNextItemLocked(const Lane lane, LoadQueue::iterator& lq_it) {
+  if (m_shuttingDown) {
+    return false;
+  }
 
-  QImage image(ImageLoader::load(thumb_file_path, 0));
-  if (!image.isNull()) {
-    return image;
+  if (lane == DECODE_LANE) {
+    if (m_decodeQueue.empty()) {
+      return false;
+    }
+    lq_it = m_decodeQueue.front();
+    m_decodeQueue.pop_front();
+
+    return true;
+  }
+
+  if (m_items.empty()) {
+    return false;
+  }
+
+  lq_it = m_loadQueue.begin();
+  if (lq_it->status != Item::QUEUED) {
+    // All QUEUED items precede any other items
+    // in the load queue, so it means there are no
+    // QUEUED items at all.
+    assert(m_numQueuedItems == 0);
+
+    return false;
   }
 
-  image = ImageLoader::load(image_id);
+  // By marking the item as IN_PROGRESS, we prevent it
+  // from being processed again before the GUI thread
+  // receives our LoadResultEvent.
+  queuedToInProgress(lq_it);
+
+  return true;
+}
+
+QImage ThumbnailPixmapCache::Impl::loadThumbnail(const ImageId& image_id,
+                                                 ThumbnailStore& store,
+                                                 const QString& legacy_dir,
+                                                 const QSize& max_thumb_size) {
+  QByteArray data(store.read(image_id, max_thumb_size));
+  if (data.isNull() && !legacy_dir.isEmpty()) {
+    const QString legacy_file_path(getThumbFilePath(image_id, legacy_dir, max_thumb_size));
+    QFile file(legacy_file_path);
+    if (file.open(QIODevice::ReadOnly)) {
+      data = file.readAll();
+      file.close();
+      if (!data.isEmpty() && store.write(image_id, max_thumb_size, data)) {
+        QFile::remove(legacy_file_path);
+      }
+    }
+  }
+  if (data.isEmpty()) {
+    return QImage();
+  }
+
+  return ThumbnailCodec::decode(data);
+}
+
+QImage ThumbnailPixmapCache::Impl::createThumbnail(const ImageId& image_id,
+                                                   ThumbnailStore& store,
+                                                   const QSize& max_thumb_size) {
+  // Decode no more pixels than necessary, as long as there is still
+  // enough of them for makeThumbnail() to downscale smoothly.
+  QSize image_size;
+  int page = 0;
+  ImageMetadataLoader::load(image_id.filePath(), [&](const ImageMetadata& metadata) {
+    if (page++ == image_id.zeroBasedPage()) {
+      image_size = metadata.size();
+    }
+  });
+  int scale_denom = 1;
+  while ((image_size.width() / (scale_denom * 2) >= max_thumb_size.width())
+         && (image_size.height() / (scale_denom * 2) >= max_thumb_size.height())) {
+    scale_denom *= 2;
+  }
+
+  QImage image;
+  if (QFile::exists(image_id.filePath())) {
+    image = ImageLoader::load(image_id, QRect(), scale_denom);
+  } else {
+    // Output pages may be stored in a container rather than in files of their own.
+    QByteArray data(OutputContainer::readFile(image_id.filePath()));
+    if (!data.isNull()) {
+      QBuffer buffer(&data);
+      buffer.open(QIODevice::ReadOnly);
+      image = ImageLoader::load(buffer, image_id.zeroBasedPage(), QRect(), scale_denom);
+    }
+  }
   if (image.isNull()) {
     return QImage();
   }
 
   const QImage thumbnail(makeThumbnail(image, max_thumb_size));
-  thumbnail.save(thumb_file_path, "PNG");
+  storeThumbnail(image_id, store, max_thumb_size, thumbnail);
 
   return thumbnail;
 }
 
+QImage ThumbnailPixmapCache::Impl::loadSaveThumbnail(const ImageId& image_id,
+                                                     ThumbnailStore& store,
+                                                     const QString& legacy_dir,
+                                                     const QSize& max_thumb_size) {
+  const QImage image(loadThumbnail(image_id, store, legacy_dir, max_thumb_size));
+  if (!image.isNull()) {
+    return image;
+  }
+
+  return createThumbnail(image_id, store, max_thumb_size);
+}
+
+bool ThumbnailPixmapCache::Impl::storeThumbnail(const ImageId& image_id,
+                                                ThumbnailStore& store,
+                                                const QSize& max_thumb_size,
+                                                const QImage& thumbnail) {
+  const QByteArray data(ThumbnailCodec::encode(thumbnail, ThumbnailCodec::currentFormat()));
+  if (data.isNull()) {
+    return false;
+  }
+
+  return store.write(image_id, max_thumb_size, data);
+}
+
 QString ThumbnailPixmapCache::Impl::getThumbFilePath(const ImageId& image_id,
                                                      const QString& thumb_dir,
                                                      const QSize& max_thumb_size) {
@@ -650,6 +829,13 @@ QString ThumbnailPixmapCache::Impl::getThumbFilePath(const ImageId& image_id,
   return thumb_file_path;
 }
 
+QString ThumbnailPixmapCache::Impl::legacyThumbDir(const QString& thumb_dir) {
+  // One directory listing beats looking for every thumbnail in vain.
+  const QStringList legacy_files(QDir(thumb_dir).entryList(QStringList("*.png"), QDir::Files));
+
+  return legacy_files.isEmpty() ? QString() : thumb_dir;
+}
+
 QImage ThumbnailPixmapCache::Impl::makeThumbnail(const QImage& image, const QSize& max_thumb_size) {
   if ((image.width() < max_thumb_size.width()) && (image.height() < max_thumb_size.height())) {
     return image;
@@ -905,11 +1091,3 @@ ThumbnailPixmapCache::Impl::LoadResultEvent::LoadResultEvent(const Impl::LoadQue
     : QEvent(QEvent::User), m_lqIter(lq_it), m_image(image), m_status(status) {}
 
 ThumbnailPixmapCache::Impl::LoadResultEvent::~LoadResultEvent() = default;
-
-/*================== ThumbnailPixmapCache::BackgroundLoader =================*/
-
-ThumbnailPixmapCache::Impl::BackgroundLoader::BackgroundLoader(Impl& owner) : m_owner(owner) {}
-
-void ThumbnailPixmapCache::Impl::BackgroundLoader::customEvent(QEvent*) {
-  m_owner.backgroundProcessing();
-}
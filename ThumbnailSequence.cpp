@@ -22,7 +22,11 @@
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
 #include <QGraphicsView>
+#include <QHash>
+#include <QScrollBar>
 #include <QStyleOptionGraphicsItem>
+#include <QTextLayout>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include <boost/function.hpp>
 #include <boost/lambda/bind.hpp>
@@ -31,6 +35,7 @@
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
+#include <unordered_set>
 #include "ColorSchemeManager.h"
 #include "IncompleteThumbnail.h"
 #include "PageSequence.h"
@@ -39,13 +44,28 @@
 using namespace ::boost::multi_index;
 using namespace ::boost::lambda;
 
+namespace {
+const int THUMB_LABEL_SPACING = 1;
+const int LABEL_PIXMAP_SPACING = 5;
+
+/**
+ * The bounding rect of a composite item, given the bounding rect
+ * of its thumbnail and label.
+ */
+QRectF compositeRect(const QRectF& children_rect) {
+  return children_rect.adjusted(-10, -5, 10, 3);
+}
+}  // namespace
+
 
 class ThumbnailSequence::Item {
  public:
-  Item(const PageInfo& page_info, CompositeItem* comp_item);
+  explicit Item(const PageInfo& page_info);
 
   const PageId& pageId() const { return pageInfo.id(); }
 
+  QRectF sceneRect() const { return boundingRect.translated(pos); }
+
   bool isSelected() const { return m_isSelected; }
 
   bool isSelectionLeader() const { return m_isSelectionLeader; }
@@ -55,9 +75,26 @@ class ThumbnailSequence::Item {
   void setSelectionLeader(bool selection_leader) const;
 
   PageInfo pageInfo;
+
+  /**
+   * Only the items within or near the visible area have their composite
+   * item instantiated.  For the rest, this one is null.
+   */
   mutable CompositeItem* composite;
   mutable bool incompleteThumbnail;
 
+  /** The bounding rectangle of the composite item, in its own coordinates. */
+  mutable QRectF boundingRect;
+
+  /** The part of the composite item that counts towards the scene rect, in its own coordinates. */
+  mutable QRectF sceneRectPart;
+
+  /** The position of the composite item in the scene. */
+  mutable QPointF pos;
+
+  /** The index of the item in Impl::m_layout. */
+  mutable int layoutIndex;
+
  private:
   mutable bool m_isSelected;
   mutable bool m_isSelectionLeader;
@@ -160,8 +197,63 @@ class ThumbnailSequence::Impl {
   typedef Container::index<ItemsInOrderTag>::type ItemsInOrder;
   typedef Container::index<SelectedThenUnselectedTag>::type SelectedThenUnselected;
 
+  /**
+   * A row of items, as laid out by layoutItemsFrom().
+   * The items are m_layout[begin] to m_layout[end - 1].
+   */
+  struct LayoutRow {
+    int begin;
+    int end;
+    double y;      // The vertical position of the items.
+    double nextY;  // The vertical position of the items in the next row.
+    QRectF rect;   // The union of the scene rect parts of the items.
+  };
+
   void invalidateThumbnailImpl(ItemsById::iterator id_it);
 
+  /**
+   * \brief Takes the measurements of \p item, without building its composite item.
+   *
+   * The thumbnail still comes from the factory, as it's the filter that knows
+   * its size and whether it's incomplete, but it never enters the scene.
+   * The label is measured the way QGraphicsSimpleTextItem would lay it out.
+   */
+  void measureItem(const Item& item);
+
+  QRectF thumbnailRect(const PageInfo& page_info, bool* incomplete);
+
+  QRectF labelRect(const PageInfo& page_info);
+
+  static QString labelText(const PageInfo& page_info);
+
+  static const char* labelPixmapResource(const PageId& page_id);
+
+  /**
+   * \brief Lays out the items, starting from the row that contains the item
+   *        at \p first_changed in m_layout.
+   *
+   * The items before \p first_changed must be the same ones, in the same order
+   * and with the same measurements, as when they were laid out last time.
+   */
+  void layoutItemsFrom(int first_changed);
+
+  /** The index in m_layout the items at and after \p ord_it start from. */
+  int layoutIndexOf(ItemsInOrder::iterator ord_it) const;
+
+  /**
+   * \brief Instantiates the composite items within or near the visible area,
+   *        and deletes the rest.
+   *
+   * The visible range is found by a binary search over m_rows.
+   */
+  void updateVisibleItems();
+
+  QRectF visibleSceneRect() const;
+
+  void releaseComposite(const Item& item);
+
+  void releaseAllComposites();
+
   void sceneContextMenuEvent(QGraphicsSceneContextMenuEvent* evt);
 
   void selectItemNoModifiers(const ItemsById::iterator& it);
@@ -227,6 +319,19 @@ class ThumbnailSequence::Impl {
   SelectedThenUnselected& m_selectedThenUnselected;
 
   const Item* m_selectionLeader;
+
+  /** All the items in order, as laid out by updateSceneItemsPos(). */
+  std::vector<const Item*> m_layout;
+
+  /** The rows of m_layout, top to bottom. */
+  std::vector<LayoutRow> m_rows;
+
+  /** The items having their composite item instantiated. */
+  std::unordered_set<const Item*> m_itemsWithComposite;
+
+  /** The sizes of the page pixmaps in labels, by resource name. */
+  QHash<QString, QSizeF> m_labelPixmapSizes;
+
   intrusive_ptr<ThumbnailFactory> m_factory;
   intrusive_ptr<const PageOrderProvider> m_orderProvider;
   GraphicsScene m_graphicsScene;
@@ -274,8 +379,6 @@ class ThumbnailSequence::CompositeItem : public QGraphicsItemGroup {
 
   bool incompleteThumbnail() const;
 
-  void updateSceneRect(QRectF& scene_rect);
-
   void updateAppearence(bool selected, bool selection_leader);
 
   virtual QRectF boundingRect() const;
@@ -396,10 +499,9 @@ std::vector<PageRange> ThumbnailSequence::selectedRanges() const {
 }
 
 void ThumbnailSequence::emitNewSelectionLeader(const PageInfo& page_info,
-                                               const CompositeItem* composite,
+                                               const Item* item,
                                                const SelectionFlags flags) {
-  const QRectF thumb_rect(composite->mapToScene(composite->boundingRect()).boundingRect());
-  emit newSelectionLeader(page_info, thumb_rect, flags);
+  emit newSelectionLeader(page_info, item->sceneRect(), flags);
 }
 
 const QSizeF& ThumbnailSequence::getMaxLogicalThumbSize() const {
@@ -436,6 +538,7 @@ void ThumbnailSequence::Impl::setThumbnailFactory(intrusive_ptr<ThumbnailFactory
 
 void ThumbnailSequence::Impl::attachView(QGraphicsView* const view) {
   view->setScene(&m_graphicsScene);
+  QObject::connect(view->verticalScrollBar(), &QScrollBar::valueChanged, &m_owner, [this]() { updateVisibleItems(); });
 }
 
 void ThumbnailSequence::Impl::reset(const PageSequence& pages,
@@ -461,10 +564,9 @@ void ThumbnailSequence::Impl::reset(const PageSequence& pages,
 
   const Item* some_selected_item = nullptr;
   for (const PageInfo& page_info : pages) {
-    std::unique_ptr<CompositeItem> composite(getCompositeItem(0, page_info));
-    m_itemsInOrder.push_back(Item(page_info, composite.release()));
+    // The items are measured by invalidateAllThumbnails() below.
+    m_itemsInOrder.push_back(Item(page_info));
     const Item* item = &m_itemsInOrder.back();
-    item->composite->setItem(item);
 
     const ImageId& image_id = page_info.id().imageId();
 
@@ -502,7 +604,7 @@ void ThumbnailSequence::Impl::reset(const PageSequence& pages,
   }
   if (m_selectionLeader) {
     m_selectionLeader->setSelectionLeader(true);
-    m_owner.emitNewSelectionLeader(selection_leader, m_selectionLeader->composite, DEFAULT_SELECTION_FLAGS);
+    m_owner.emitNewSelectionLeader(selection_leader, m_selectionLeader, DEFAULT_SELECTION_FLAGS);
   }
 }  // ThumbnailSequence::Impl::reset
 
@@ -559,14 +661,33 @@ void ThumbnailSequence::Impl::orderItems() {
 }
 
 void ThumbnailSequence::Impl::updateSceneItemsPos() {
-  m_sceneRect = QRectF(0.0, 0.0, 0.0, 0.0);
+  layoutItemsFrom(0);
+}
 
-  const int view_width = getGraphicsViewWidth();
-  assert(view_width > 0);
-  double y_offset = SPACING;
+void ThumbnailSequence::Impl::layoutItemsFrom(const int first_changed) {
+  // A row is only kept if the item that didn't fit into it is unchanged as well.
+  const auto first_row = std::lower_bound(m_rows.begin(), m_rows.end(), first_changed,
+                                          [](const LayoutRow& row, int idx) { return row.end < idx; });
+  m_rows.erase(first_row, m_rows.end());
+
+  m_sceneRect = QRectF(0.0, 0.0, 0.0, 0.0);
+  for (const LayoutRow& row : m_rows) {
+    m_sceneRect |= row.rect;
+  }
 
   ItemsInOrder::iterator ord_it = m_itemsInOrder.begin();
   const ItemsInOrder::iterator ord_end(m_itemsInOrder.end());
+  double y_offset = SPACING;
+  if (!m_rows.empty()) {
+    const LayoutRow& last_row = m_rows.back();
+    ord_it = ++m_itemsInOrder.iterator_to(*m_layout[last_row.end - 1]);
+    y_offset = last_row.nextY;
+  }
+  m_layout.resize(m_rows.empty() ? 0 : m_rows.back().end);
+  m_layout.reserve(m_itemsInOrder.size());
+
+  const int view_width = getGraphicsViewWidth();
+  assert(view_width > 0);
 
   while (ord_it != ord_end) {
     int items_in_row = 0;
@@ -575,7 +696,7 @@ void ThumbnailSequence::Impl::updateSceneItemsPos() {
 
     // Determine how many items can fit into the current row.
     for (ItemsInOrder::iterator row_it = ord_it; row_it != ord_end; ++row_it) {
-      const double item_width = row_it->composite->boundingRect().width();
+      const double item_width = row_it->boundingRect.width();
       x_offset += item_width + SPACING;
       if (x_offset > view_width) {
         if (items_in_row == 0) {
@@ -593,71 +714,204 @@ void ThumbnailSequence::Impl::updateSceneItemsPos() {
     const double adj_spacing = std::floor((view_width - sum_item_widths) / (items_in_row + 1));
     x_offset = adj_spacing;
     double next_y_offset = 0;
+    LayoutRow row{int(m_layout.size()), 0, y_offset, y_offset, QRectF()};
     for (; items_in_row > 0; --items_in_row, ++ord_it) {
-      CompositeItem* composite = ord_it->composite;
-      composite->setPos(x_offset, y_offset);
-      composite->updateSceneRect(m_sceneRect);
-      x_offset += composite->boundingRect().width() + adj_spacing;
-      next_y_offset = std::max(composite->boundingRect().height() + SPACING, next_y_offset);
+      const Item& item = *ord_it;
+      item.pos = QPointF(x_offset, y_offset);
+      item.layoutIndex = int(m_layout.size());
+      m_layout.push_back(&item);
+      row.rect |= item.sceneRectPart.translated(item.pos);
+
+      x_offset += item.boundingRect.width() + adj_spacing;
+      next_y_offset = std::max(item.boundingRect.height() + SPACING, next_y_offset);
     }
+    row.end = int(m_layout.size());
+    row.nextY = y_offset + next_y_offset;
+    m_sceneRect |= row.rect;
+    m_rows.push_back(row);
 
-    if (ord_it != ord_end) {
-      y_offset += next_y_offset;
-    }
+    y_offset = row.nextY;
   }
 
   commitSceneRect();
+  updateVisibleItems();
+}  // ThumbnailSequence::Impl::layoutItemsFrom
+
+int ThumbnailSequence::Impl::layoutIndexOf(const ItemsInOrder::iterator ord_it) const {
+  if (ord_it == m_itemsInOrder.end()) {
+    return int(m_layout.size());
+  }
+
+  // An item that wasn't laid out yet invalidates the whole layout.
+  return std::max(0, ord_it->layoutIndex);
 }
 
-void ThumbnailSequence::Impl::invalidateThumbnailImpl(const ItemsById::iterator id_it) {
-  CompositeItem* const new_composite = getCompositeItem(&*id_it, id_it->pageInfo).release();
-  CompositeItem* const old_composite = id_it->composite;
-  const QSizeF old_size(old_composite->boundingRect().size());
-  const QSizeF new_size(new_composite->boundingRect().size());
-  const QPointF old_pos(new_composite->pos());
+void ThumbnailSequence::Impl::updateVisibleItems() {
+  int begin = 0;
+  int end = 0;
+
+  const QRectF visible_rect(visibleSceneRect());
+  if (!visible_rect.isNull()) {
+    // Both the tops and the bottoms of the rows are in ascending order.
+    const auto first_row = std::lower_bound(m_rows.begin(), m_rows.end(), visible_rect.top(),
+                                            [](const LayoutRow& row, double y) { return row.rect.bottom() < y; });
+    const auto last_row = std::upper_bound(first_row, m_rows.end(), visible_rect.bottom(),
+                                           [](double y, const LayoutRow& row) { return y < row.rect.top(); });
+    if (first_row != last_row) {
+      begin = first_row->begin;
+      end = (last_row - 1)->end;
+    }
+  }
+
+  auto it = m_itemsWithComposite.begin();
+  while (it != m_itemsWithComposite.end()) {
+    const Item* item = *it;
+    if ((item->layoutIndex < begin) || (item->layoutIndex >= end)) {
+      delete item->composite;
+      item->composite = nullptr;
+      it = m_itemsWithComposite.erase(it);
+    } else {
+      ++it;
+    }
+  }
 
-  id_it->composite = new_composite;
-  id_it->incompleteThumbnail = new_composite->incompleteThumbnail();
-  delete old_composite;
+  for (int i = begin; i < end; ++i) {
+    const Item& item = *m_layout[i];
+    if (!item.composite) {
+      item.composite = getCompositeItem(&item, item.pageInfo).release();
+      item.composite->updateAppearence(item.isSelected(), item.isSelectionLeader());
+      m_graphicsScene.addItem(item.composite);
+      m_itemsWithComposite.insert(&item);
+    }
+    if (item.composite->pos() != item.pos) {
+      item.composite->setPos(item.pos);
+    }
+  }
+}  // ThumbnailSequence::Impl::updateVisibleItems
+
+QRectF ThumbnailSequence::Impl::visibleSceneRect() const {
+  if (m_graphicsScene.views().isEmpty()) {
+    return QRectF();
+  }
 
-  new_composite->updateAppearence(id_it->isSelected(), id_it->isSelectionLeader());
-  m_graphicsScene.addItem(new_composite);
+  const QGraphicsView* view = m_graphicsScene.views().first();
+  QRectF rect(view->mapToScene(view->viewport()->rect()).boundingRect());
+  // Keep a screenful of items above and below, so that scrolling
+  // by small steps doesn't keep creating and deleting them.
+  rect.adjust(0.0, -rect.height(), 0.0, rect.height());
+
+  return rect;
+}
+
+void ThumbnailSequence::Impl::measureItem(const Item& item) {
+  bool incomplete = false;
+  const QRectF thumb_rect(thumbnailRect(item.pageInfo, &incomplete));
+  const QRectF label_rect(labelRect(item.pageInfo));
+
+  // The same arrangement as CompositeItem makes.
+  const QPointF label_pos(0.5 * (thumb_rect.width() - label_rect.width()), thumb_rect.height() + THUMB_LABEL_SPACING);
+  const QRectF bounding_rect(compositeRect(thumb_rect | label_rect.translated(label_pos)));
+
+  item.incompleteThumbnail = incomplete;
+  item.boundingRect = bounding_rect;
+  item.sceneRectPart = QRectF(thumb_rect.left(), bounding_rect.top(), thumb_rect.width(), bounding_rect.height());
+}
+
+QRectF ThumbnailSequence::Impl::thumbnailRect(const PageInfo& page_info, bool* incomplete) {
+  const std::unique_ptr<QGraphicsItem> thumb(getThumbnail(page_info));
+  *incomplete = (dynamic_cast<IncompleteThumbnail*>(thumb.get()) != nullptr);
+
+  return thumb->boundingRect();
+}
+
+QRectF ThumbnailSequence::Impl::labelRect(const PageInfo& page_info) {
+  // This follows the layout QGraphicsSimpleTextItem does for its bounding rect.
+  QTextLayout layout(labelText(page_info), QFont());
+  layout.setCacheEnabled(true);
+  layout.beginLayout();
+  while (layout.createLine().isValid()) {
+    // A single unbounded line per paragraph.
+  }
+  layout.endLayout();
+
+  double text_width = 0;
+  double text_height = 0;
+  for (int i = 0; i < layout.lineCount(); ++i) {
+    const QTextLine line(layout.lineAt(i));
+    text_width = std::max(text_width, line.naturalTextWidth());
+    text_height += line.height();
+  }
+  const QRectF text_rect(0.0, 0.0, text_width, text_height);
+
+  const char* pixmap_resource = labelPixmapResource(page_info.id());
+  if (!pixmap_resource) {
+    return text_rect;
+  }
+
+  auto size_it = m_labelPixmapSizes.find(pixmap_resource);
+  if (size_it == m_labelPixmapSizes.end()) {
+    const QPixmap pixmap(pixmap_resource);
+    size_it = m_labelPixmapSizes.insert(pixmap_resource, QSizeF(pixmap.size()) / pixmap.devicePixelRatio());
+  }
+
+  QRectF pixmap_rect(QPointF(0.0, 0.0), *size_it);
+  pixmap_rect.moveCenter(text_rect.center());
+  pixmap_rect.moveLeft(text_rect.right() + LABEL_PIXMAP_SPACING);
+
+  return text_rect | pixmap_rect;
+}  // ThumbnailSequence::Impl::labelRect
+
+void ThumbnailSequence::Impl::releaseComposite(const Item& item) {
+  if (item.composite) {
+    delete item.composite;
+    item.composite = nullptr;
+    m_itemsWithComposite.erase(&item);
+  }
+}
+
+void ThumbnailSequence::Impl::releaseAllComposites() {
+  for (const Item* item : m_itemsWithComposite) {
+    delete item->composite;
+    item->composite = nullptr;
+  }
+  m_itemsWithComposite.clear();
+}
+
+void ThumbnailSequence::Impl::invalidateThumbnailImpl(const ItemsById::iterator id_it) {
+  const QRectF old_rect(id_it->sceneRect());
+  // The composite item is recreated with the new thumbnail, if it's still visible.
+  releaseComposite(*id_it);
+  measureItem(*id_it);
 
   ItemsInOrder::iterator after_old(m_items.project<ItemsInOrderTag>(id_it));
+  const int old_layout_index = layoutIndexOf(after_old);
   // Notice after_old++ below.
   // Move our item to the beginning of m_itemsInOrder, to make it out of range
   // we are going to pass to itemInsertPosition().
   m_itemsInOrder.relocate(m_itemsInOrder.begin(), after_old++);
   const ItemsInOrder::iterator after_new(itemInsertPosition(
       ++m_itemsInOrder.begin(), m_itemsInOrder.end(), id_it->pageInfo.id(), id_it->incompleteThumbnail, after_old));
+  const int new_layout_index = layoutIndexOf(after_new);
   // Move our item to its intended position.
   m_itemsInOrder.relocate(after_new, m_itemsInOrder.begin());
 
-  updateSceneItemsPos();
+  layoutItemsFrom(std::min(old_layout_index, new_layout_index));
 
   // Possibly emit the newSelectionLeader() signal.
   if (m_selectionLeader == &*id_it) {
-    if ((old_size != new_size) || (old_pos != id_it->composite->pos())) {
-      m_owner.emitNewSelectionLeader(id_it->pageInfo, id_it->composite, REDUNDANT_SELECTION);
+    if (old_rect != id_it->sceneRect()) {
+      m_owner.emitNewSelectionLeader(id_it->pageInfo, &*id_it, REDUNDANT_SELECTION);
     }
   }
 }  // ThumbnailSequence::Impl::invalidateThumbnailImpl
 
 void ThumbnailSequence::Impl::invalidateAllThumbnails() {
-  // Recreate thumbnails now, whether a thumbnail is incomplete
-  // is taken into account when sorting.
-  ItemsInOrder::iterator ord_it(m_itemsInOrder.begin());
-  const ItemsInOrder::iterator ord_end(m_itemsInOrder.end());
-  for (; ord_it != ord_end; ++ord_it) {
-    CompositeItem* const old_composite = ord_it->composite;
-    CompositeItem* const new_composite = getCompositeItem(&*ord_it, ord_it->pageInfo).release();
-
-    ord_it->composite = new_composite;
-    ord_it->incompleteThumbnail = new_composite->incompleteThumbnail();
-    delete old_composite;
-
-    new_composite->updateAppearence(ord_it->isSelected(), ord_it->isSelectionLeader());
-    m_graphicsScene.addItem(new_composite);
+  // Re-measure thumbnails now, whether a thumbnail is incomplete
+  // is taken into account when sorting.  Composite items are only
+  // recreated for the ones near the visible area.
+  releaseAllComposites();
+  for (const Item& item : m_itemsInOrder) {
+    measureItem(item);
   }
 
   orderItems();
@@ -712,7 +966,7 @@ bool ThumbnailSequence::Impl::setSelection(const PageId& page_id, const Selectio
     flags |= REDUNDANT_SELECTION;
   }
 
-  m_owner.emitNewSelectionLeader(id_it->pageInfo, id_it->composite, flags);
+  m_owner.emitNewSelectionLeader(id_it->pageInfo, &*id_it, flags);
 
   return true;
 }  // ThumbnailSequence::Impl::setSelection
@@ -860,64 +1114,38 @@ void ThumbnailSequence::Impl::insert(const PageInfo& page_info, BeforeOrAfter be
   ord_it = itemInsertPosition(m_itemsInOrder.begin(), m_itemsInOrder.end(), page_info.id(),
                               /*page_incomplete=*/true, ord_it);
 
-  double offset = 0.0;
-  if (!m_items.empty()) {
-    if (ord_it != m_itemsInOrder.end()) {
-      offset = ord_it->composite->pos().y();
-    } else {
-      ItemsInOrder::iterator it(ord_it);
-      --it;
-      offset = it->composite->y() + it->composite->boundingRect().height() + SPACING;
-    }
-  }
-  std::unique_ptr<CompositeItem> composite(getCompositeItem(0, page_info));
-  composite->setPos(0.0, offset);
-  composite->updateSceneRect(m_sceneRect);
-
-  const QPointF pos_delta(0.0, composite->boundingRect().height() + SPACING);
-
-  const Item item(page_info, composite.get());
-  const std::pair<ItemsInOrder::iterator, bool> ins(m_itemsInOrder.insert(ord_it, item));
-  composite->setItem(&*ins.first);
-  m_graphicsScene.addItem(composite.release());
-
-  const ItemsInOrder::iterator ord_end(m_itemsInOrder.end());
-  for (; ord_it != ord_end; ++ord_it) {
-    ord_it->composite->setPos(ord_it->composite->pos() + pos_delta);
-    ord_it->composite->updateSceneRect(m_sceneRect);
+  const int first_changed = layoutIndexOf(ord_it);
+  const std::pair<ItemsInOrder::iterator, bool> ins(m_itemsInOrder.insert(ord_it, Item(page_info)));
+  if (!ins.second) {
+    return;
   }
+  measureItem(*ins.first);
 
-  commitSceneRect();
+  layoutItemsFrom(first_changed);
 }  // ThumbnailSequence::Impl::insert
 
 void ThumbnailSequence::Impl::removePages(const std::set<PageId>& to_remove) {
-  m_sceneRect = QRectF(0, 0, 0, 0);
-
   const std::set<PageId>::const_iterator to_remove_end(to_remove.end());
-  QPointF pos_delta(0, 0);
+  int first_changed = int(m_layout.size());
 
   ItemsInOrder::iterator ord_it(m_itemsInOrder.begin());
   const ItemsInOrder::iterator ord_end(m_itemsInOrder.end());
   while (ord_it != ord_end) {
     if (to_remove.find(ord_it->pageInfo.id()) == to_remove_end) {
       // Keeping this page.
-      if (pos_delta != QPointF(0, 0)) {
-        ord_it->composite->setPos(ord_it->composite->pos() + pos_delta);
-      }
-      ord_it->composite->updateSceneRect(m_sceneRect);
       ++ord_it;
     } else {
       // Removing this page.
       if (m_selectionLeader == &*ord_it) {
         m_selectionLeader = nullptr;
       }
-      pos_delta.ry() -= ord_it->composite->boundingRect().height() + SPACING;
-      delete ord_it->composite;
+      first_changed = std::min(first_changed, layoutIndexOf(ord_it));
+      releaseComposite(*ord_it);
       m_itemsInOrder.erase(ord_it++);
     }
   }
 
-  commitSceneRect();
+  layoutItemsFrom(first_changed);
 }
 
 bool ThumbnailSequence::Impl::multipleItemsSelected() const {
@@ -945,7 +1173,7 @@ QRectF ThumbnailSequence::Impl::selectionLeaderSceneRect() const {
     return QRectF();
   }
 
-  return m_selectionLeader->composite->mapToScene(m_selectionLeader->composite->boundingRect()).boundingRect();
+  return m_selectionLeader->sceneRect();
 }
 
 std::set<PageId> ThumbnailSequence::Impl::selectedItems() const {
@@ -989,8 +1217,7 @@ void ThumbnailSequence::Impl::contextMenuRequested(const PageInfo& page_info, co
 
 void ThumbnailSequence::Impl::sceneContextMenuEvent(QGraphicsSceneContextMenuEvent* evt) {
   if (!m_itemsInOrder.empty()) {
-    CompositeItem* composite = m_itemsInOrder.back().composite;
-    const QRectF last_thumb_rect(composite->mapToScene(composite->boundingRect()).boundingRect());
+    const QRectF last_thumb_rect(m_itemsInOrder.back().sceneRect());
     if (evt->scenePos().y() <= last_thumb_rect.bottom()) {
       return;
     }
@@ -1022,7 +1249,7 @@ void ThumbnailSequence::Impl::selectItemWithControl(const ItemsById::iterator& i
     m_selectionLeader->setSelectionLeader(true);
     moveToSelected(m_selectionLeader);
 
-    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader->composite, flags);
+    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader, flags);
 
     return;
   }
@@ -1030,7 +1257,7 @@ void ThumbnailSequence::Impl::selectItemWithControl(const ItemsById::iterator& i
   if (!multipleItemsSelected()) {
     // Clicked on the only selected item.
     flags |= REDUNDANT_SELECTION;
-    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader->composite, flags);
+    m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader, flags);
 
     return;
   }
@@ -1071,7 +1298,7 @@ void ThumbnailSequence::Impl::selectItemWithControl(const ItemsById::iterator& i
   m_selectionLeader->setSelectionLeader(true);
   // No need to moveToSelected() as it was and remains selected.
 
-  m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader->composite, flags);
+  m_owner.emitNewSelectionLeader(m_selectionLeader->pageInfo, m_selectionLeader, flags);
 }  // ThumbnailSequence::Impl::selectItemWithControl
 
 void ThumbnailSequence::Impl::selectItemWithShift(const ItemsById::iterator& id_it) {
@@ -1129,7 +1356,7 @@ void ThumbnailSequence::Impl::selectItemWithShift(const ItemsById::iterator& id_
   m_selectionLeader = &*id_it;
   m_selectionLeader->setSelectionLeader(true);
 
-  m_owner.emitNewSelectionLeader(id_it->pageInfo, id_it->composite, flags);
+  m_owner.emitNewSelectionLeader(id_it->pageInfo, &*id_it, flags);
 }  // ThumbnailSequence::Impl::selectItemWithShift
 
 void ThumbnailSequence::Impl::selectItemNoModifiers(const ItemsById::iterator& id_it) {
@@ -1144,16 +1371,18 @@ void ThumbnailSequence::Impl::selectItemNoModifiers(const ItemsById::iterator& i
   m_selectionLeader->setSelectionLeader(true);
   moveToSelected(m_selectionLeader);
 
-  m_owner.emitNewSelectionLeader(id_it->pageInfo, id_it->composite, flags);
+  m_owner.emitNewSelectionLeader(id_it->pageInfo, &*id_it, flags);
 }
 
 void ThumbnailSequence::Impl::clear() {
   m_selectionLeader = nullptr;
+  m_layout.clear();
+  m_rows.clear();
 
   ItemsInOrder::iterator it(m_itemsInOrder.begin());
   const ItemsInOrder::iterator end(m_itemsInOrder.end());
   while (it != end) {
-    delete it->composite;
+    releaseComposite(*it);
     m_itemsInOrder.erase(it++);
   }
 
@@ -1243,7 +1472,7 @@ std::unique_ptr<QGraphicsItem> ThumbnailSequence::Impl::getThumbnail(const PageI
   return thumb;
 }
 
-std::unique_ptr<ThumbnailSequence::LabelGroup> ThumbnailSequence::Impl::getLabelGroup(const PageInfo& page_info) {
+QString ThumbnailSequence::Impl::labelText(const PageInfo& page_info) {
   const PageId& page_id = page_info.id();
   const QFileInfo file_info(page_id.imageId().filePath());
   const QString file_name(file_info.completeBaseName());
@@ -1258,6 +1487,23 @@ std::unique_ptr<ThumbnailSequence::LabelGroup> ThumbnailSequence::Impl::getLabel
     text = ThumbnailSequence::tr("%1 (page %2)").arg(text).arg(page_id.imageId().page());
   }
 
+  return text;
+}
+
+const char* ThumbnailSequence::Impl::labelPixmapResource(const PageId& page_id) {
+  switch (page_id.subPage()) {
+    case PageId::LEFT_PAGE:
+      return ":/icons/left_page_thumb.png";
+    case PageId::RIGHT_PAGE:
+      return ":/icons/right_page_thumb.png";
+    default:
+      return nullptr;
+  }
+}
+
+std::unique_ptr<ThumbnailSequence::LabelGroup> ThumbnailSequence::Impl::getLabelGroup(const PageInfo& page_info) {
+  const QString text(labelText(page_info));
+
   std::unique_ptr<QGraphicsSimpleTextItem> normal_text_item(new QGraphicsSimpleTextItem);
   normal_text_item->setText(text);
 
@@ -1277,27 +1523,18 @@ std::unique_ptr<ThumbnailSequence::LabelGroup> ThumbnailSequence::Impl::getLabel
   normal_text_item->setPos(normal_text_box.topLeft());
   bold_text_item->setPos(bold_text_box.topLeft());
 
-  const char* pixmap_resource = 0;
-  switch (page_id.subPage()) {
-    case PageId::LEFT_PAGE:
-      pixmap_resource = ":/icons/left_page_thumb.png";
-      break;
-    case PageId::RIGHT_PAGE:
-      pixmap_resource = ":/icons/right_page_thumb.png";
-      break;
-    default:
-      return std::unique_ptr<LabelGroup>(new LabelGroup(std::move(normal_text_item), std::move(bold_text_item)));
+  const char* pixmap_resource = labelPixmapResource(page_info.id());
+  if (!pixmap_resource) {
+    return std::unique_ptr<LabelGroup>(new LabelGroup(std::move(normal_text_item), std::move(bold_text_item)));
   }
 
   const QPixmap pixmap(pixmap_resource);
   std::unique_ptr<QGraphicsPixmapItem> pixmap_item(new QGraphicsPixmapItem);
   pixmap_item->setPixmap(pixmap);
 
-  const int label_pixmap_spacing = 5;
-
   QRectF pixmap_box(pixmap_item->boundingRect());
   pixmap_box.moveCenter(bold_text_box.center());
-  pixmap_box.moveLeft(bold_text_box.right() + label_pixmap_spacing);
+  pixmap_box.moveLeft(bold_text_box.right() + LABEL_PIXMAP_SPACING);
   pixmap_item->setPos(pixmap_box.topLeft());
 
   return std::unique_ptr<LabelGroup>(
@@ -1333,10 +1570,11 @@ void ThumbnailSequence::Impl::setMaxLogicalThumbSize(const QSizeF& size) {
 
 /*==================== ThumbnailSequence::Item ======================*/
 
-ThumbnailSequence::Item::Item(const PageInfo& page_info, CompositeItem* comp_item)
+ThumbnailSequence::Item::Item(const PageInfo& page_info)
     : pageInfo(page_info),
-      composite(comp_item),
-      incompleteThumbnail(comp_item->incompleteThumbnail()),
+      composite(nullptr),
+      incompleteThumbnail(false),
+      layoutIndex(-1),
       m_isSelected(false),
       m_isSelectionLeader(false) {}
 
@@ -1346,7 +1584,7 @@ void ThumbnailSequence::Item::setSelected(bool selected) const {
   m_isSelected = selected;
   m_isSelectionLeader = m_isSelectionLeader && selected;
 
-  if ((was_selected != m_isSelected) || (was_selection_leader != m_isSelectionLeader)) {
+  if (composite && ((was_selected != m_isSelected) || (was_selection_leader != m_isSelectionLeader))) {
     composite->updateAppearence(m_isSelected, m_isSelectionLeader);
     composite->update();
   }
@@ -1358,7 +1596,7 @@ void ThumbnailSequence::Item::setSelectionLeader(bool selection_leader) const {
   m_isSelected = m_isSelected || selection_leader;
   m_isSelectionLeader = selection_leader;
 
-  if ((was_selected != m_isSelected) || (was_selection_leader != m_isSelectionLeader)) {
+  if (composite && ((was_selected != m_isSelected) || (was_selection_leader != m_isSelectionLeader))) {
     composite->updateAppearence(m_isSelected, m_isSelectionLeader);
     composite->update();
   }
@@ -1425,10 +1663,9 @@ ThumbnailSequence::CompositeItem::CompositeItem(ThumbnailSequence::Impl& owner,
   const QSizeF thumb_size(thumbnail->boundingRect().size());
   const QSizeF label_size(label_group->boundingRect().size());
 
-  const int thumb_label_spacing = 1;
   thumbnail->setPos(0.0, 0.0);
   label_group->setPos(thumbnail->pos().x() + 0.5 * (thumb_size.width() - label_size.width()),
-                      thumb_size.height() + thumb_label_spacing);
+                      thumb_size.height() + THUMB_LABEL_SPACING);
 
   addToGroup(thumbnail.release());
   addToGroup(label_group.release());
@@ -1441,28 +1678,12 @@ bool ThumbnailSequence::CompositeItem::incompleteThumbnail() const {
   return dynamic_cast<IncompleteThumbnail*>(m_thumb) != 0;
 }
 
-void ThumbnailSequence::CompositeItem::updateSceneRect(QRectF& scene_rect) {
-  QRectF rect(m_thumb->boundingRect());
-  rect.translate(m_thumb->pos());
-  rect.translate(pos());
-
-  QRectF bounding_rect(boundingRect());
-  bounding_rect.translate(pos());
-
-  rect.setTop(bounding_rect.top());
-  rect.setBottom(bounding_rect.bottom());
-
-  scene_rect |= rect;
-}
-
 void ThumbnailSequence::CompositeItem::updateAppearence(bool selected, bool selection_leader) {
   m_labelGroup->updateAppearence(selected, selection_leader);
 }
 
 QRectF ThumbnailSequence::CompositeItem::boundingRect() const {
-  QRectF rect(QGraphicsItemGroup::boundingRect());
-  rect.adjust(-10, -5, 10, 3);
-  return rect;
+  return compositeRect(QGraphicsItemGroup::boundingRect());
 }
 
 void ThumbnailSequence::CompositeItem::paint(QPainter* painter,
@@ -102,6 +102,9 @@ class ThumbnailSequence : public QObject {
   /**
    * \brief Updates position of all the thumbnails in the view.
    *
+   * Only the thumbnails within or near the visible area are kept
+   * in the scene.  The rest are instantiated as they are scrolled to.
+   *
    * \note This function doesn't update thumbnails appearance.
    */
   void updateSceneItemsPos();
@@ -258,7 +261,7 @@ class ThumbnailSequence : public QObject {
   class LabelGroup;
   class CompositeItem;
 
-  void emitNewSelectionLeader(const PageInfo& page_info, const CompositeItem* composite, SelectionFlags flags);
+  void emitNewSelectionLeader(const PageInfo& page_info, const Item* item, SelectionFlags flags);
 
   std::unique_ptr<Impl> m_impl;
 };
@@ -0,0 +1,402 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ThumbnailStore.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSize>
+#include <cstring>
+#include "AtomicFileOverwriter.h"
+#include "ImageId.h"
+
+namespace {
+const quint32 FILE_MAGIC = 0x53545450;    // "STTP"
+const quint32 RECORD_MAGIC = 0x53545452;  // "STTR"
+const quint32 INDEX_MAGIC = 0x53545449;   // "STTI"
+const quint32 VERSION = 1;
+
+// Don't bother rewriting the pack for less than that.
+const qint64 MIN_DEAD_BYTES_TO_COMPACT = qint64(16) << 20;
+
+QByteArray fileHeader() {
+  QByteArray header;
+  QDataStream strm(&header, QIODevice::WriteOnly);
+  strm << FILE_MAGIC << VERSION;
+
+  return header;
+}
+
+QByteArray recordHeader(const QString& key, const qint64 image_modified_time, const qint32 size) {
+  QByteArray header;
+  QDataStream strm(&header, QIODevice::WriteOnly);
+  strm << RECORD_MAGIC << key << image_modified_time << size;
+
+  return header;
+}
+}  // namespace
+
+const char ThumbnailStore::PACK_FILE_NAME[] = "thumbs.pack";
+const char ThumbnailStore::INDEX_FILE_NAME[] = "thumbs.index";
+
+std::shared_ptr<ThumbnailStore> ThumbnailStore::forDir(const QString& dir) {
+  static QMutex mutex;
+  static QHash<QString, std::weak_ptr<ThumbnailStore>> stores;
+
+  const QString abs_dir(QDir(dir).absolutePath());
+
+  const QMutexLocker locker(&mutex);
+  std::shared_ptr<ThumbnailStore> store(stores.value(abs_dir).lock());
+  if (!store) {
+    store.reset(new ThumbnailStore(abs_dir));
+    stores[abs_dir] = store;
+  }
+
+  return store;
+}
+
+ThumbnailStore::ThumbnailStore(const QString& dir)
+    : m_packFilePath(QDir(dir).absoluteFilePath(QString::fromLatin1(PACK_FILE_NAME))),
+      m_indexFilePath(QDir(dir).absoluteFilePath(QString::fromLatin1(INDEX_FILE_NAME))),
+      m_file(m_packFilePath),
+      m_map(nullptr),
+      m_mapSize(0),
+      m_liveBytes(0),
+      m_deadBytes(0),
+      m_indexModified(false) {}
+
+ThumbnailStore::~ThumbnailStore() {
+  close();
+}
+
+QByteArray ThumbnailStore::read(const ImageId& image_id, const QSize& max_thumb_size) {
+  const QString key(keyFor(image_id, max_thumb_size));
+  const qint64 modified_time = imageModifiedTime(image_id);
+
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(false)) {
+    return QByteArray();
+  }
+
+  const auto it = m_index.constFind(key);
+  if ((it == m_index.constEnd()) || (it->imageModifiedTime != modified_time)) {
+    return QByteArray();
+  }
+
+  return readData(*it);
+}
+
+bool ThumbnailStore::contains(const ImageId& image_id, const QSize& max_thumb_size) {
+  const QString key(keyFor(image_id, max_thumb_size));
+  const qint64 modified_time = imageModifiedTime(image_id);
+
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(false)) {
+    return false;
+  }
+
+  const auto it = m_index.constFind(key);
+
+  return (it != m_index.constEnd()) && (it->imageModifiedTime == modified_time);
+}
+
+bool ThumbnailStore::write(const ImageId& image_id, const QSize& max_thumb_size, const QByteArray& data) {
+  const QString key(keyFor(image_id, max_thumb_size));
+  const qint64 modified_time = imageModifiedTime(image_id);
+
+  const QMutexLocker locker(&m_mutex);
+  if (!ensureOpen(true)) {
+    return false;
+  }
+
+  return append(key, modified_time, data);
+}
+
+QString ThumbnailStore::keyFor(const ImageId& image_id, const QSize& max_thumb_size) {
+  return image_id.filePath() + QLatin1Char('|') + QString::number(image_id.zeroBasedPage()) + QLatin1String("|q")
+         + QString::number(max_thumb_size.width());
+}
+
+qint64 ThumbnailStore::imageModifiedTime(const ImageId& image_id) {
+  return QFileInfo(image_id.filePath()).lastModified().toMSecsSinceEpoch();
+}
+
+bool ThumbnailStore::ensureOpen(const bool create) {
+  if (m_file.isOpen()) {
+    return true;
+  }
+
+  if (!m_file.exists()) {
+    if (!create) {
+      return false;
+    }
+    // An index left from an earlier pack would be wrong.
+    QFile::remove(m_indexFilePath);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+      return false;
+    }
+    const QByteArray header(fileHeader());
+    if (m_file.write(header) != header.size()) {
+      m_file.close();
+      m_file.remove();
+
+      return false;
+    }
+    m_index.clear();
+    m_liveBytes = 0;
+    m_deadBytes = 0;
+
+    return true;
+  }
+
+  if (!m_file.open(QIODevice::ReadWrite)) {
+    return false;
+  }
+
+  QDataStream strm(&m_file);
+  quint32 magic = 0;
+  quint32 version = 0;
+  strm >> magic >> version;
+  if ((strm.status() != QDataStream::Ok) || (magic != FILE_MAGIC) || (version != VERSION)) {
+    // Not ours to overwrite.
+    m_file.close();
+
+    return false;
+  }
+
+  const qint64 indexed_size = loadIndexFile();
+  scanRecords((indexed_size > 0) ? indexed_size : m_file.pos());
+  map();
+
+  return true;
+}  // ThumbnailStore::ensureOpen
+
+qint64 ThumbnailStore::loadIndexFile() {
+  m_index.clear();
+  m_liveBytes = 0;
+  m_deadBytes = 0;
+
+  QFile file(m_indexFilePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return 0;
+  }
+
+  QDataStream strm(&file);
+  quint32 magic = 0;
+  quint32 version = 0;
+  qint64 indexed_size = 0;
+  quint32 num_entries = 0;
+  strm >> magic >> version >> indexed_size >> m_deadBytes >> num_entries;
+  if ((strm.status() != QDataStream::Ok) || (magic != INDEX_MAGIC) || (version != VERSION)
+      || (indexed_size > m_file.size())) {
+    m_deadBytes = 0;
+
+    return 0;
+  }
+
+  for (quint32 i = 0; i < num_entries; ++i) {
+    QString key;
+    Location location;
+    strm >> key >> location.offset >> location.size >> location.imageModifiedTime;
+    if ((strm.status() != QDataStream::Ok) || (location.offset + location.size > indexed_size)) {
+      m_index.clear();
+      m_liveBytes = 0;
+      m_deadBytes = 0;
+
+      return 0;
+    }
+    m_index.insert(key, location);
+    m_liveBytes += location.size;
+  }
+
+  return indexed_size;
+}  // ThumbnailStore::loadIndexFile
+
+void ThumbnailStore::saveIndexFile() {
+  if (!m_indexModified || !m_file.isOpen()) {
+    return;
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* const device = overwriter.startWriting(m_indexFilePath);
+  if (!device) {
+    return;
+  }
+
+  QDataStream strm(device);
+  strm << INDEX_MAGIC << VERSION << m_file.size() << m_deadBytes << quint32(m_index.size());
+  for (auto it = m_index.constBegin(); it != m_index.constEnd(); ++it) {
+    strm << it.key() << it->offset << it->size << it->imageModifiedTime;
+  }
+
+  if ((strm.status() == QDataStream::Ok) && overwriter.commit()) {
+    m_indexModified = false;
+  }
+}
+
+void ThumbnailStore::scanRecords(const qint64 offset) {
+  const qint64 file_size = m_file.size();
+  if (!m_file.seek(offset)) {
+    return;
+  }
+
+  QDataStream strm(&m_file);
+  while (!m_file.atEnd()) {
+    const qint64 record_offset = m_file.pos();
+
+    quint32 magic = 0;
+    QString key;
+    qint64 modified_time = 0;
+    qint32 size = -1;
+    strm >> magic >> key >> modified_time >> size;
+
+    const qint64 data_offset = m_file.pos();
+    if ((strm.status() != QDataStream::Ok) || (magic != RECORD_MAGIC) || (size < 0)
+        || (data_offset + size > file_size)) {
+      // A record that was being written when we crashed.
+      m_file.resize(record_offset);
+      break;
+    }
+
+    const auto it = m_index.find(key);
+    if (it != m_index.end()) {
+      m_liveBytes -= it->size;
+      m_deadBytes += it->size;
+    }
+    m_index[key] = Location{data_offset, size, modified_time};
+    m_liveBytes += size;
+    m_indexModified = true;
+
+    if (!m_file.seek(data_offset + size)) {
+      break;
+    }
+  }
+}  // ThumbnailStore::scanRecords
+
+void ThumbnailStore::map() {
+  unmap();
+  m_mapSize = m_file.size();
+  m_map = m_file.map(0, m_mapSize);
+  if (!m_map) {
+    m_mapSize = 0;
+  }
+}
+
+void ThumbnailStore::unmap() {
+  if (m_map) {
+    m_file.unmap(m_map);
+    m_map = nullptr;
+    m_mapSize = 0;
+  }
+}
+
+QByteArray ThumbnailStore::readData(const Location& location) {
+  if (location.offset + location.size > m_mapSize) {
+    // Appended since the file was mapped.
+    map();
+  }
+
+  if (m_map && (location.offset + location.size <= m_mapSize)) {
+    QByteArray data(location.size, Qt::Uninitialized);
+    std::memcpy(data.data(), m_map + location.offset, size_t(location.size));
+
+    return data;
+  }
+
+  // Mapping isn't supported everywhere.
+  if (!m_file.seek(location.offset)) {
+    return QByteArray();
+  }
+  QByteArray data(m_file.read(location.size));
+  if (data.size() != location.size) {
+    return QByteArray();
+  }
+
+  return data;
+}
+
+bool ThumbnailStore::append(const QString& key, const qint64 image_modified_time, const QByteArray& data) {
+  QByteArray record(recordHeader(key, image_modified_time, data.size()));
+  const qint64 record_offset = m_file.size();
+  const qint64 data_offset = record_offset + record.size();
+  record += data;
+
+  if (!m_file.seek(record_offset) || (m_file.write(record) != record.size()) || !m_file.flush()) {
+    // Don't leave a partial record behind.
+    m_file.resize(record_offset);
+
+    return false;
+  }
+
+  const auto it = m_index.find(key);
+  if (it != m_index.end()) {
+    m_liveBytes -= it->size;
+    m_deadBytes += it->size;
+  }
+  m_index[key] = Location{data_offset, data.size(), image_modified_time};
+  m_liveBytes += data.size();
+  m_indexModified = true;
+
+  return true;
+}
+
+void ThumbnailStore::compactIfWorthIt() {
+  if ((m_deadBytes < MIN_DEAD_BYTES_TO_COMPACT) || (m_deadBytes < m_liveBytes)) {
+    return;
+  }
+
+  AtomicFileOverwriter overwriter;
+  QIODevice* const out = overwriter.startWriting(m_packFilePath);
+  if (!out) {
+    return;
+  }
+
+  bool ok = (out->write(fileHeader()) >= 0);
+  for (auto it = m_index.constBegin(); ok && (it != m_index.constEnd()); ++it) {
+    const QByteArray data(readData(*it));
+    QByteArray record(recordHeader(it.key(), it->imageModifiedTime, it->size));
+    record += data;
+    ok = (data.size() == it->size) && (out->write(record) == record.size());
+  }
+  if (!ok) {
+    overwriter.abort();
+
+    return;
+  }
+
+  unmap();
+  m_file.close();
+  // Should that fail, we just keep using the old file.
+  if (overwriter.commit()) {
+    QFile::remove(m_indexFilePath);
+  }
+  if (ensureOpen(false)) {
+    saveIndexFile();
+  }
+}  // ThumbnailStore::compactIfWorthIt
+
+void ThumbnailStore::close() {
+  const QMutexLocker locker(&m_mutex);
+
+  compactIfWorthIt();
+  saveIndexFile();
+  unmap();
+  m_file.close();
+}
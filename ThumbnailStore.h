@@ -0,0 +1,137 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAIL_STORE_H_
+#define THUMBNAIL_STORE_H_
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <memory>
+#include "NonCopyable.h"
+
+class ImageId;
+class QSize;
+
+/**
+ * \brief The thumbnails of a project, packed into a single file.
+ *
+ * Thumbnails are appended to the pack file as they are written.  They are
+ * looked up by image path, page and thumbnail size, and are only returned
+ * while the modification time of the image stays the same as when they were
+ * written.  Replacing a thumbnail appends a new record superseding the old one.
+ * Once the superseded records take more space than the live ones, the pack
+ * is rewritten without them when the store is destroyed, rather than holding
+ * up the writes.
+ *
+ * The index is saved to a separate file when the store is destroyed.
+ * When the store is opened, the records appended after the index was saved,
+ * like when the program crashed, are found by walking their headers.  A record
+ * cut short is dropped.  The pack is memory-mapped for reading, so reading
+ * a thumbnail makes no system calls, apart from checking the image's
+ * modification time.
+ *
+ * A store may only be written by a single process.  All methods may be called
+ * from any thread.
+ */
+class ThumbnailStore {
+  DECLARE_NON_COPYABLE(ThumbnailStore)
+
+ public:
+  static const char PACK_FILE_NAME[];
+  static const char INDEX_FILE_NAME[];
+
+  /**
+   * \brief The store in \p dir, shared by all its users within the process.
+   *
+   * The files are created on the first write, as long as \p dir exists.
+   */
+  static std::shared_ptr<ThumbnailStore> forDir(const QString& dir);
+
+  /**
+   * \brief Compacts the pack if it's worth it and saves the index.
+   */
+  ~ThumbnailStore();
+
+  /**
+   * \return The stored data, or a null array if there is no such thumbnail,
+   *         or the image was modified after it was written.
+   */
+  QByteArray read(const ImageId& image_id, const QSize& max_thumb_size);
+
+  bool contains(const ImageId& image_id, const QSize& max_thumb_size);
+
+  bool write(const ImageId& image_id, const QSize& max_thumb_size, const QByteArray& data);
+
+ private:
+  struct Location {
+    qint64 offset;  // Of the data.
+    qint32 size;
+    qint64 imageModifiedTime;  // Milliseconds since the epoch.
+  };
+
+  explicit ThumbnailStore(const QString& dir);
+
+  static QString keyFor(const ImageId& image_id, const QSize& max_thumb_size);
+
+  static qint64 imageModifiedTime(const ImageId& image_id);
+
+  bool ensureOpen(bool create);
+
+  /**
+   * \brief Reads the index file, if it's there and matches the pack.
+   *
+   * \return The size of the pack covered by the index, or 0 on failure.
+   */
+  qint64 loadIndexFile();
+
+  void saveIndexFile();
+
+  /**
+   * \brief Indexes the records from \p offset to the end of the pack.
+   */
+  void scanRecords(qint64 offset);
+
+  void map();
+
+  void unmap();
+
+  QByteArray readData(const Location& location);
+
+  bool append(const QString& key, qint64 image_modified_time, const QByteArray& data);
+
+  void compactIfWorthIt();
+
+  void close();
+
+  QMutex m_mutex;
+  QString m_packFilePath;
+  QString m_indexFilePath;
+  QFile m_file;
+  uchar* m_map;
+  qint64 m_mapSize;
+  QHash<QString, Location> m_index;
+  qint64 m_liveBytes;
+  qint64 m_deadBytes;
+  bool m_indexModified;
+};
+
+
+#endif  // ifndef THUMBNAIL_STORE_H_
@@ -0,0 +1,168 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "TiffCodecBenchmark.h"
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include "ImageLoader.h"
+#include "TiffCodecOptions.h"
+#include "TiffWriter.h"
+
+namespace {
+struct Candidate {
+  const char* name;
+  uint16 compression;
+  int level;
+  bool predictor;
+};
+
+struct Totals {
+  qint64 nsecs = 0;
+  qint64 bytes = 0;
+};
+
+const Candidate BW_CANDIDATES[] = {{"none", COMPRESSION_NONE, 0, false},
+                                   {"lzw", COMPRESSION_LZW, 0, false},
+                                   {"deflate-1", COMPRESSION_DEFLATE, 1, false},
+                                   {"deflate-6", COMPRESSION_DEFLATE, 6, false},
+                                   {"deflate-9", COMPRESSION_DEFLATE, 9, false},
+#ifdef COMPRESSION_ZSTD
+                                   {"zstd-1", COMPRESSION_ZSTD, 1, false},
+                                   {"zstd-9", COMPRESSION_ZSTD, 9, false},
+                                   {"zstd-19", COMPRESSION_ZSTD, 19, false},
+#endif
+                                   {"g4", COMPRESSION_CCITTFAX4, 0, false}};
+
+const Candidate COLOR_CANDIDATES[] = {{"none", COMPRESSION_NONE, 0, false},
+                                      {"lzw", COMPRESSION_LZW, 0, false},
+                                      {"lzw+pred", COMPRESSION_LZW, 0, true},
+                                      {"deflate-6", COMPRESSION_DEFLATE, 6, false},
+                                      {"deflate-1+pred", COMPRESSION_DEFLATE, 1, true},
+                                      {"deflate-6+pred", COMPRESSION_DEFLATE, 6, true},
+                                      {"deflate-9+pred", COMPRESSION_DEFLATE, 9, true},
+#ifdef COMPRESSION_ZSTD
+                                      {"zstd-1+pred", COMPRESSION_ZSTD, 1, true},
+                                      {"zstd-9+pred", COMPRESSION_ZSTD, 9, true},
+                                      {"zstd-19+pred", COMPRESSION_ZSTD, 19, true},
+#endif
+                                      {"jpeg", COMPRESSION_JPEG, 0, false}};
+
+const int RUNS = 3;
+
+/**
+ * \return The best of a few runs, in nanoseconds, or -1 on failure.
+ */
+qint64 encode(const QImage& image, const TiffCodecOptions& options, qint64& size) {
+  qint64 best = -1;
+  for (int run = 0; run < RUNS; ++run) {
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!TiffWriter::writeImage(buffer, image, options)) {
+      return -1;
+    }
+    const qint64 elapsed = timer.nsecsElapsed();
+
+    size = buffer.data().size();
+    if ((best < 0) || (elapsed < best)) {
+      best = elapsed;
+    }
+  }
+
+  return best;
+}
+
+void printRow(std::ostream& out, const char* name, const qint64 nsecs, const qint64 bytes, const qint64 raw_bytes) {
+  out << "  " << std::left << std::setw(16) << name << std::right << std::setw(10) << std::fixed
+      << std::setprecision(1) << (nsecs / 1e6) << " ms" << std::setw(12) << (bytes / 1024) << " KiB" << std::setw(9)
+      << std::setprecision(1) << (100.0 * bytes / std::max<qint64>(raw_bytes, 1)) << " %" << std::endl;
+}
+}  // namespace
+
+void TiffCodecBenchmark::run(const QStringList& file_paths, std::ostream& out) {
+  std::vector<Totals> bw_totals(std::size(BW_CANDIDATES));
+  std::vector<Totals> color_totals(std::size(COLOR_CANDIDATES));
+  qint64 bw_raw_bytes = 0;
+  qint64 color_raw_bytes = 0;
+
+  for (const QString& file_path : file_paths) {
+    const QImage image(ImageLoader::load(file_path));
+    if (image.isNull()) {
+      continue;
+    }
+
+    const bool bw = (image.depth() == 1);
+    const Candidate* const candidates = bw ? BW_CANDIDATES : COLOR_CANDIDATES;
+    const size_t num_candidates = bw ? std::size(BW_CANDIDATES) : std::size(COLOR_CANDIDATES);
+    std::vector<Totals>& totals = bw ? bw_totals : color_totals;
+    const qint64 raw_bytes = qint64(image.bytesPerLine()) * image.height();
+    (bw ? bw_raw_bytes : color_raw_bytes) += raw_bytes;
+
+    out << QFileInfo(file_path).fileName().toStdString() << " (" << image.width() << "x" << image.height() << ", "
+        << image.depth() << " bpp)" << std::endl;
+    for (size_t i = 0; i < num_candidates; ++i) {
+      const Candidate& candidate = candidates[i];
+      if (!TiffCodecOptions::isCodecSupported(candidate.compression)) {
+        continue;
+      }
+
+      TiffCodecOptions options;
+      options.setBwCompression(candidate.compression);
+      options.setColorCompression(candidate.compression);
+      options.setLevel(candidate.level);
+      options.setPredictor(candidate.predictor);
+
+      qint64 bytes = 0;
+      const qint64 nsecs = encode(image, options, bytes);
+      if (nsecs < 0) {
+        out << "  " << candidate.name << ": failed" << std::endl;
+        continue;
+      }
+      totals[i].nsecs += nsecs;
+      totals[i].bytes += bytes;
+      printRow(out, candidate.name, nsecs, bytes, raw_bytes);
+    }
+  }
+
+  if (bw_raw_bytes > 0) {
+    out << "Total, black and white:" << std::endl;
+    for (size_t i = 0; i < bw_totals.size(); ++i) {
+      if (bw_totals[i].bytes > 0) {
+        printRow(out, BW_CANDIDATES[i].name, bw_totals[i].nsecs, bw_totals[i].bytes, bw_raw_bytes);
+      }
+    }
+  }
+  if (color_raw_bytes > 0) {
+    out << "Total, color and grayscale:" << std::endl;
+    for (size_t i = 0; i < color_totals.size(); ++i) {
+      if (color_totals[i].bytes > 0) {
+        printRow(out, COLOR_CANDIDATES[i].name, color_totals[i].nsecs, color_totals[i].bytes, color_raw_bytes);
+      }
+    }
+  }
+}  // TiffCodecBenchmark::run
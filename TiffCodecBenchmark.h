@@ -0,0 +1,41 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TIFF_CODEC_BENCHMARK_H_
+#define TIFF_CODEC_BENCHMARK_H_
+
+#include <QStringList>
+#include <iosfwd>
+
+/**
+ * \brief Reports how long each TIFF codec takes to encode the given
+ *        images and how large the results are.
+ *
+ * Black and white images are tried with the codecs offered for them,
+ * the rest with the color ones, with and without the predictor.
+ * Nothing is written to disk.  Output pages make the most representative
+ * samples, as those are what TiffWriter actually deals with.
+ */
+class TiffCodecBenchmark {
+ public:
+  static void run(const QStringList& file_paths, std::ostream& out);
+};
+
+
+#endif  // ifndef TIFF_CODEC_BENCHMARK_H_
@@ -0,0 +1,59 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "TiffCodecOptions.h"
+#include <tiffio.h>
+#include <QSettings>
+
+TiffCodecOptions::TiffCodecOptions()
+    : m_bwCompression(COMPRESSION_CCITTFAX4), m_colorCompression(COMPRESSION_LZW), m_level(0), m_predictor(true) {}
+
+TiffCodecOptions TiffCodecOptions::fromSettings() {
+  QSettings settings;
+  TiffCodecOptions options;
+  options.setBwCompression(uint16(settings.value("settings/bw_compression", options.bwCompression()).toInt()));
+  options.setColorCompression(uint16(settings.value("settings/color_compression", options.colorCompression()).toInt()));
+  options.setLevel(settings.value("settings/tiff_compression_level", options.level()).toInt());
+  options.setPredictor(settings.value("settings/tiff_predictor", options.predictor()).toBool());
+
+  return options;
+}
+
+TiffCodecOptions TiffCodecOptions::fastProfile() {
+  TiffCodecOptions options;
+  // G4 is both the fastest and the most compact choice for black and white.
+  options.setBwCompression(COMPRESSION_CCITTFAX4);
+#ifdef COMPRESSION_ZSTD
+  if (isCodecSupported(COMPRESSION_ZSTD)) {
+    options.setColorCompression(COMPRESSION_ZSTD);
+  } else {
+    options.setColorCompression(COMPRESSION_DEFLATE);
+  }
+#else
+  options.setColorCompression(COMPRESSION_DEFLATE);
+#endif
+  options.setLevel(1);
+  options.setPredictor(true);
+
+  return options;
+}
+
+bool TiffCodecOptions::isCodecSupported(const uint16 compression) {
+  return TIFFIsCODECConfigured(compression) != 0;
+}
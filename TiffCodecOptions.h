@@ -0,0 +1,78 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TIFF_CODEC_OPTIONS_H_
+#define TIFF_CODEC_OPTIONS_H_
+
+#include <tiff.h>
+
+/**
+ * \brief How TiffWriter compresses the images it writes.
+ *
+ * Black and white images and the rest (color, grayscale and palette ones)
+ * have their own codecs.  The level applies to the codecs having one, that is
+ * Deflate (1...9) and ZSTD (1...22), and is clamped to the codec's range.
+ * A zero level means the codec's default.  The predictor (horizontal
+ * differencing) applies to 8-bit grayscale and RGB images compressed
+ * with LZW, Deflate or ZSTD.
+ */
+class TiffCodecOptions {
+ public:
+  TiffCodecOptions();
+
+  /**
+   * \brief The options as set in the settings dialog.
+   */
+  static TiffCodecOptions fromSettings();
+
+  /**
+   * \brief Trades some compression ratio for the encoding speed.
+   */
+  static TiffCodecOptions fastProfile();
+
+  /**
+   * \return Whether the libtiff we are linked against can encode \p compression.
+   */
+  static bool isCodecSupported(uint16 compression);
+
+  uint16 bwCompression() const { return m_bwCompression; }
+
+  void setBwCompression(uint16 compression) { m_bwCompression = compression; }
+
+  uint16 colorCompression() const { return m_colorCompression; }
+
+  void setColorCompression(uint16 compression) { m_colorCompression = compression; }
+
+  int level() const { return m_level; }
+
+  void setLevel(int level) { m_level = level; }
+
+  bool predictor() const { return m_predictor; }
+
+  void setPredictor(bool predictor) { m_predictor = predictor; }
+
+ private:
+  uint16 m_bwCompression;
+  uint16 m_colorCompression;
+  int m_level;
+  bool m_predictor;
+};
+
+
+#endif  // ifndef TIFF_CODEC_OPTIONS_H_
@@ -19,12 +19,24 @@
 #include "TiffReader.h"
 #include <tiff.h>
 #include <tiffio.h>
+#include <QDateTime>
 #include <QDebug>
+#include <QFileDevice>
+#include <QFileInfo>
 #include <QIODevice>
 #include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <QRgba64>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <vector>
 #include "Dpm.h"
+#include "Hashes.h"
 #include "ImageMetadata.h"
 #include "NonCopyable.h"
 
@@ -92,6 +104,81 @@ class TiffReader::TiffBuffer {
 };
 
 
+/**
+ * \brief Remembers where the directories (pages) of TIFF files start.
+ *
+ * Without that, getting to page N means walking the chain of directories
+ * from the first one, which makes loading all pages of a multi-page file
+ * quadratic in the number of pages.
+ *
+ * The least recently used files are forgotten once there are too many.
+ */
+class TiffReader::DirectoryIndex {
+  DECLARE_NON_COPYABLE(DirectoryIndex)
+
+ public:
+  static DirectoryIndex& instance() {
+    static DirectoryIndex object;
+
+    return object;
+  }
+
+  /**
+   * \return The offset of the page's directory, or 0 if not known.
+   */
+  toff_t find(const QString& key, const int page_num) {
+    const QMutexLocker locker(&m_mutex);
+
+    const auto map_it(m_entryByFile.find(key));
+    if (map_it == m_entryByFile.end()) {
+      return 0;
+    }
+
+    const EntryList::iterator it(map_it->second);
+    m_entries.splice(m_entries.begin(), m_entries, it);
+    if ((page_num < 0) || (page_num >= int(it->offsets.size()))) {
+      return 0;
+    }
+
+    return it->offsets[page_num];
+  }
+
+  void store(const QString& key, std::vector<toff_t> offsets) {
+    const QMutexLocker locker(&m_mutex);
+
+    const auto map_it(m_entryByFile.find(key));
+    if (map_it != m_entryByFile.end()) {
+      m_entries.erase(map_it->second);
+      m_entryByFile.erase(map_it);
+    }
+
+    m_entries.push_front(Entry{key, std::move(offsets)});
+    m_entryByFile[key] = m_entries.begin();
+
+    while (m_entries.size() > MAX_FILES) {
+      m_entryByFile.erase(m_entries.back().key);
+      m_entries.pop_back();
+    }
+  }
+
+ private:
+  struct Entry {
+    QString key;
+    std::vector<toff_t> offsets;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  static const size_t MAX_FILES = 1024;
+
+  DirectoryIndex() = default;
+
+  QMutex m_mutex;
+  EntryList m_entries;  // Most recently used first.
+  std::unordered_map<QString, EntryList::iterator, hashes::hash<QString>> m_entryByFile;
+};
+
+
 struct TiffReader::TiffInfo {
   int width;
   int height;
@@ -99,12 +186,21 @@ struct TiffReader::TiffInfo {
   uint16 samples_per_pixel;
   uint16 sample_format;
   uint16 photometric;
+  uint16 planar_config;
+  uint16 orientation;
+  bool tiled;
   bool host_big_endian;
   bool file_big_endian;
 
   TiffInfo(const TiffHandle& tif, const TiffHeader& header);
 
   bool mapsToBinaryOrIndexed8() const;
+
+  /**
+   * \return true for interleaved RGB or 16-bit grayscale images that can be
+   *         read scanline by scanline without libtiff's RGBA machinery.
+   */
+  bool mapsToRgbOrGray() const;
 };
 
 
@@ -115,6 +211,9 @@ TiffReader::TiffInfo::TiffInfo(const TiffHandle& tif, const TiffHeader& header)
       samples_per_pixel(1),
       sample_format(SAMPLEFORMAT_UINT),
       photometric(PHOTOMETRIC_MINISBLACK),
+      planar_config(PLANARCONFIG_CONTIG),
+      orientation(ORIENTATION_TOPLEFT),
+      tiled(TIFFIsTiled(tif.handle()) != 0),
       host_big_endian(QSysInfo::ByteOrder == QSysInfo::BigEndian),
       file_big_endian(header.signature() == TiffHeader::TIFF_BIG_ENDIAN) {
   uint16 compression = 1;
@@ -136,6 +235,8 @@ TiffReader::TiffInfo::TiffInfo(const TiffHandle& tif, const TiffHeader& header)
   TIFFGetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
   TIFFGetField(tif.handle(), TIFFTAG_SAMPLEFORMAT, &sample_format);
   TIFFGetField(tif.handle(), TIFFTAG_PHOTOMETRIC, &photometric);
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_PLANARCONFIG, &planar_config);
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ORIENTATION, &orientation);
 }
 
 bool TiffReader::TiffInfo::mapsToBinaryOrIndexed8() const {
@@ -155,6 +256,22 @@ bool TiffReader::TiffInfo::mapsToBinaryOrIndexed8() const {
   return false;
 }
 
+bool TiffReader::TiffInfo::mapsToRgbOrGray() const {
+  if (tiled || (planar_config != PLANARCONFIG_CONTIG) || (orientation != ORIENTATION_TOPLEFT)
+      || (sample_format != SAMPLEFORMAT_UINT)) {
+    return false;
+  }
+
+  if ((samples_per_pixel == 3) && (photometric == PHOTOMETRIC_RGB)) {
+    return (bits_per_sample == 8) || (bits_per_sample == 16);
+  }
+  if ((samples_per_pixel == 1) && (bits_per_sample == 16)) {
+    return (photometric == PHOTOMETRIC_MINISBLACK) || (photometric == PHOTOMETRIC_MINISWHITE);
+  }
+
+  return false;
+}
+
 static tsize_t deviceRead(thandle_t context, tdata_t data, tsize_t size) {
   auto* dev = (QIODevice*) context;
 
@@ -199,13 +316,31 @@ static toff_t deviceSize(thandle_t context) {
   return dev->size();
 }
 
-static int deviceMap(thandle_t, tdata_t*, toff_t*) {
-  // Not implemented.
-  return 0;
+static int deviceMap(thandle_t context, tdata_t* base, toff_t* size) {
+  // Only files can be mapped.  For anything else, libtiff falls back
+  // to reading through deviceRead().  The same happens if mapping fails,
+  // which is likely for huge files on 32-bit systems.
+  auto* file = qobject_cast<QFileDevice*>((QIODevice*) context);
+  if (!file || file->isSequential()) {
+    return 0;
+  }
+
+  const qint64 file_size = file->size();
+  uchar* const data = file->map(0, file_size);
+  if (!data) {
+    return 0;
+  }
+
+  *base = data;
+  *size = (toff_t) file_size;
+
+  return 1;
 }
 
-static void deviceUnmap(thandle_t, tdata_t, toff_t) {
-  // Not implemented.
+static void deviceUnmap(thandle_t context, tdata_t base, toff_t) {
+  if (auto* file = qobject_cast<QFileDevice*>((QIODevice*) context)) {
+    file->unmap(static_cast<uchar*>(base));
+  }
 }
 
 bool TiffReader::canRead(QIODevice& device) {
@@ -242,10 +377,18 @@ ImageMetadataLoader::Status TiffReader::readMetadata(QIODevice& device,
     return ImageMetadataLoader::GENERIC_ERROR;
   }
 
+  // We walk all the directories anyway, so we may as well index them.
+  std::vector<toff_t> offsets;
   do {
+    offsets.push_back(TIFFCurrentDirOffset(tif.handle()));
     out(currentPageMetadata(tif));
   } while (TIFFReadDirectory(tif.handle()));
 
+  const QString index_key(directoryIndexKey(device));
+  if (!index_key.isEmpty()) {
+    DirectoryIndex::instance().store(index_key, std::move(offsets));
+  }
+
   return ImageMetadataLoader::LOADED;
 }
 
@@ -261,6 +404,10 @@ static void convertAbgrToArgb(const uint32* src, uint32* dst, int count) {
 }
 
 QImage TiffReader::readImage(QIODevice& device, const int page_num) {
+  return readImage(device, page_num, QRect());
+}
+
+QImage TiffReader::readImage(QIODevice& device, const int page_num, const QRect& roi) {
   if (!device.isReadable()) {
     return QImage();
   }
@@ -274,13 +421,15 @@ QImage TiffReader::readImage(QIODevice& device, const int page_num) {
     return QImage();
   }
 
-  TiffHandle tif(TIFFClientOpen("file", "rBm", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
+  // Unlike readMetadata(), we let libtiff map the file, so that strips
+  // are decoded straight from the page cache rather than copied first.
+  TiffHandle tif(TIFFClientOpen("file", "rB", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
                                 &deviceSize, &deviceMap, &deviceUnmap));
   if (!tif.handle()) {
     return QImage();
   }
 
-  if (!TIFFSetDirectory(tif.handle(), (uint16) page_num)) {
+  if (!setDirectory(tif, page_num, directoryIndexKey(device))) {
     return QImage();
   }
 
@@ -288,11 +437,20 @@ QImage TiffReader::readImage(QIODevice& device, const int page_num) {
 
   const ImageMetadata metadata(currentPageMetadata(tif));
 
+  const QRect page_rect(0, 0, info.width, info.height);
+  const QRect rect(roi.isNull() ? page_rect : roi.intersected(page_rect));
+  if (rect.isEmpty()) {
+    return QImage();
+  }
+
   QImage image;
 
   if (info.mapsToBinaryOrIndexed8()) {
     // Common case optimization.
-    image = extractBinaryOrIndexed8Image(tif, info);
+    image = extractBinaryOrIndexed8Image(tif, info, rect);
+  } else if (info.mapsToRgbOrGray()) {
+    // Most colour scans.
+    image = extractRgbOrGrayImage(tif, info, rect);
   } else {
     // General case.
     image = QImage(info.width, info.height, info.samples_per_pixel == 3 ? QImage::Format_RGB32 : QImage::Format_ARGB32);
@@ -328,6 +486,10 @@ QImage TiffReader::readImage(QIODevice& device, const int page_num) {
       src_line += info.width;
       dst_line += dst_stride;
     }
+
+    if (rect != page_rect) {
+      image = image.copy(rect);
+    }
   }
 
   if (!metadata.dpi().isNull()) {
@@ -339,6 +501,84 @@ QImage TiffReader::readImage(QIODevice& device, const int page_num) {
   return image;
 }  // TiffReader::readImage
 
+bool TiffReader::readRawImage(QIODevice& device, const int page_num, RawImage& image) {
+  if (!device.isReadable() || device.isSequential()) {
+    return false;
+  }
+
+  TiffHeader header(readHeader(device));
+  if (!checkHeader(header)) {
+    return false;
+  }
+
+  TiffHandle tif(TIFFClientOpen("file", "rB", &device, &deviceRead, &deviceWrite, &deviceSeek, &deviceClose,
+                                &deviceSize, &deviceMap, &deviceUnmap));
+  if (!tif.handle()) {
+    return false;
+  }
+
+  if (!setDirectory(tif, page_num, directoryIndexKey(device))) {
+    return false;
+  }
+
+  const TiffInfo info(tif, header);
+  if (info.tiled || (info.planar_config != PLANARCONFIG_CONTIG) || (info.orientation != ORIENTATION_TOPLEFT)
+      || (info.sample_format != SAMPLEFORMAT_UINT)) {
+    return false;
+  }
+
+  uint16 fill_order = FILLORDER_MSB2LSB;
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_FILLORDER, &fill_order);
+  if (fill_order != FILLORDER_MSB2LSB) {
+    return false;
+  }
+
+  uint16 compression = COMPRESSION_NONE;
+  TIFFGetField(tif.handle(), TIFFTAG_COMPRESSION, &compression);
+
+  // The predictor tag is only known to the codecs using it.
+  uint16 predictor = PREDICTOR_NONE;
+  switch (compression) {
+    case COMPRESSION_LZW:
+    case COMPRESSION_ADOBE_DEFLATE:
+    case COMPRESSION_DEFLATE:
+      TIFFGetField(tif.handle(), TIFFTAG_PREDICTOR, &predictor);
+      break;
+    default:
+      break;
+  }
+
+  uint32 rows_per_strip = uint32(info.height);
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+
+  image.width = info.width;
+  image.height = info.height;
+  image.bitsPerSample = info.bits_per_sample;
+  image.samplesPerPixel = info.samples_per_pixel;
+  image.compression = compression;
+  image.photometric = info.photometric;
+  image.predictor = predictor;
+  image.rowsPerStrip = int(std::min<uint32>(rows_per_strip, uint32(info.height)));
+  image.dpi = currentPageMetadata(tif).dpi();
+  image.strips.clear();
+
+  const tstrip_t num_strips = TIFFNumberOfStrips(tif.handle());
+  image.strips.reserve(num_strips);
+  for (tstrip_t strip = 0; strip < num_strips; ++strip) {
+    const tmsize_t size = TIFFRawStripSize(tif.handle(), strip);
+    if (size < 0) {
+      return false;
+    }
+    QByteArray data(int(size), Qt::Uninitialized);
+    if (TIFFReadRawStrip(tif.handle(), strip, data.data(), size) != size) {
+      return false;
+    }
+    image.strips.push_back(data);
+  }
+
+  return true;
+}  // TiffReader::readRawImage
+
 TiffReader::TiffHeader TiffReader::readHeader(QIODevice& device) {
   unsigned char data[4];
   if (device.peek((char*) data, sizeof(data)) != sizeof(data)) {
@@ -385,6 +625,47 @@ ImageMetadata TiffReader::currentPageMetadata(const TiffHandle& tif) {
   return ImageMetadata(QSize(width, height), getDpi(xres, yres, res_unit));
 }
 
+QString TiffReader::directoryIndexKey(QIODevice& device) {
+  auto* file = qobject_cast<QFileDevice*>(&device);
+  if (!file || file->fileName().isEmpty()) {
+    return QString();
+  }
+
+  const QFileInfo file_info(file->fileName());
+
+  return file_info.absoluteFilePath() + QLatin1Char('|') + QString::number(file_info.size()) + QLatin1Char('|')
+         + QString::number(file_info.lastModified().toMSecsSinceEpoch());
+}
+
+bool TiffReader::setDirectory(const TiffHandle& tif, const int page_num, const QString& index_key) {
+  if (page_num < 0) {
+    return false;
+  }
+  if (index_key.isEmpty()) {
+    return TIFFSetDirectory(tif.handle(), (uint16) page_num) != 0;
+  }
+
+  const toff_t offset = DirectoryIndex::instance().find(index_key, page_num);
+  if (offset != 0) {
+    return TIFFSetSubDirectory(tif.handle(), offset) != 0;
+  }
+
+  // Index the whole file, so that subsequent pages are found straight away.
+  std::vector<toff_t> offsets;
+  do {
+    offsets.push_back(TIFFCurrentDirOffset(tif.handle()));
+  } while (TIFFReadDirectory(tif.handle()));
+
+  if (page_num >= int(offsets.size())) {
+    return false;
+  }
+
+  const toff_t page_offset = offsets[page_num];
+  DirectoryIndex::instance().store(index_key, std::move(offsets));
+
+  return TIFFSetSubDirectory(tif.handle(), page_offset) != 0;
+}
+
 Dpi TiffReader::getDpi(float xres, float yres, unsigned res_unit) {
   switch (res_unit) {
     case RESUNIT_INCH:  // inch
@@ -398,7 +679,7 @@ Dpi TiffReader::getDpi(float xres, float yres, unsigned res_unit) {
   return Dpi();
 }
 
-QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info) {
+QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info, const QRect& rect) {
   QImage::Format format = QImage::Format_Indexed8;
   if (info.bits_per_sample == 1) {
     // Because we specify B option when opening, we can
@@ -406,7 +687,7 @@ QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const Tif
     format = QImage::Format_Mono;
   }
 
-  QImage image(info.width, info.height, format);
+  QImage image(rect.size(), format);
   if (image.isNull()) {
     throw std::bad_alloc();
   }
@@ -453,31 +734,166 @@ QImage TiffReader::extractBinaryOrIndexed8Image(const TiffHandle& tif, const Tif
   }
 
   if ((info.bits_per_sample == 1) || (info.bits_per_sample == 8)) {
-    readLines(tif, image);
+    readLines(tif, info, rect, image);
   } else {
-    readAndUnpackLines(tif, info, image);
+    readAndUnpackLines(tif, info, rect, image);
   }
 
   return image;
 }  // TiffReader::extractBinaryOrIndexed8Image
 
-void TiffReader::readLines(const TiffHandle& tif, QImage& image) {
-  const int height = image.height();
+QImage TiffReader::extractRgbOrGrayImage(const TiffHandle& tif, const TiffInfo& info, const QRect& rect) {
+  const bool gray = (info.samples_per_pixel == 1);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+  const bool deep = (info.bits_per_sample == 16);
+#else
+  const bool deep = false;
+#endif
+
+  QImage::Format format = gray ? QImage::Format_Indexed8 : QImage::Format_RGB32;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+  if (deep) {
+    format = gray ? QImage::Format_Grayscale16 : QImage::Format_RGBX64;
+  }
+#endif
+  QImage image(rect.size(), format);
+  if (image.isNull()) {
+    throw std::bad_alloc();
+  }
+
+  if (gray && !deep) {
+    image.setColorCount(256);
+    for (int i = 0; i < 256; ++i) {
+      const int gray_level = (info.photometric == PHOTOMETRIC_MINISWHITE) ? 255 - i : i;
+      image.setColor(i, qRgb(gray_level, gray_level, gray_level));
+    }
+  }
+
+  // libtiff hands us 16-bit samples in host byte order.  Where they can't
+  // be kept, only the most significant byte is, like TIFFReadRGBAImage() does.
+  TiffBuffer<uint8> buf(TIFFScanlineSize(tif.handle()));
+  if (!skipToRow(tif, rect.top(), buf.data())) {
+    return QImage();
+  }
+
+  const int left = rect.left();
+  const int width = rect.width();
+  const int height = rect.height();
+  const uint16 gray16_xor = (info.photometric == PHOTOMETRIC_MINISWHITE) ? 0xFFFF : 0;
+
   for (int y = 0; y < height; ++y) {
-    TIFFReadScanline(tif.handle(), image.scanLine(y), y);
+    if (TIFFReadScanline(tif.handle(), buf.data(), rect.top() + y) < 0) {
+      return QImage();
+    }
+
+    if (gray && deep) {
+      const auto* src = reinterpret_cast<const uint16*>(buf.data()) + left;
+      auto* dst = reinterpret_cast<uint16*>(image.scanLine(y));
+      for (int x = 0; x < width; ++x) {
+        dst[x] = src[x] ^ gray16_xor;
+      }
+    } else if (gray) {
+      const auto* src = reinterpret_cast<const uint16*>(buf.data()) + left;
+      uint8* dst = image.scanLine(y);
+      for (int x = 0; x < width; ++x) {
+        dst[x] = static_cast<uint8>(src[x] >> 8);
+      }
+    } else if (info.bits_per_sample == 8) {
+      const uint8* src = buf.data() + left * 3;
+      auto* dst = reinterpret_cast<uint32*>(image.scanLine(y));
+      for (int x = 0; x < width; ++x, src += 3) {
+        dst[x] = 0xFF000000 | (uint32(src[0]) << 16) | (uint32(src[1]) << 8) | uint32(src[2]);
+      }
+    } else if (deep) {
+      const uint16* src = reinterpret_cast<const uint16*>(buf.data()) + left * 3;
+      auto* dst = reinterpret_cast<QRgba64*>(image.scanLine(y));
+      for (int x = 0; x < width; ++x, src += 3) {
+        dst[x] = QRgba64::fromRgba64(src[0], src[1], src[2], 0xFFFF);
+      }
+    } else {
+      const uint16* src = reinterpret_cast<const uint16*>(buf.data()) + left * 3;
+      auto* dst = reinterpret_cast<uint32*>(image.scanLine(y));
+      for (int x = 0; x < width; ++x, src += 3) {
+        dst[x] = 0xFF000000 | (uint32(src[0] >> 8) << 16) | (uint32(src[1] >> 8) << 8) | uint32(src[2] >> 8);
+      }
+    }
+  }
+
+  return image;
+}  // TiffReader::extractRgbOrGrayImage
+
+bool TiffReader::skipToRow(const TiffHandle& tif, const int row, void* buf) {
+  uint32 rows_per_strip = 0;
+  TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+  if (rows_per_strip == 0) {
+    return false;
+  }
+
+  // Whole strips before the one containing the row aren't decoded at all.
+  const auto first_row = static_cast<int>((uint32(row) / rows_per_strip) * rows_per_strip);
+  for (int skipped_row = first_row; skipped_row < row; ++skipped_row) {
+    if (TIFFReadScanline(tif.handle(), buf, uint32(skipped_row)) < 0) {
+      return false;
+    }
   }
+
+  return true;
 }
 
-void TiffReader::readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image) {
+void TiffReader::readLines(const TiffHandle& tif, const TiffInfo& info, const QRect& rect, QImage& image) {
+  TiffBuffer<uint8> buf(TIFFScanlineSize(tif.handle()));
+  if (!skipToRow(tif, rect.top(), buf.data())) {
+    return;
+  }
+
+  const int height = rect.height();
+  if (rect.width() == info.width) {
+    for (int y = 0; y < height; ++y) {
+      TIFFReadScanline(tif.handle(), image.scanLine(y), rect.top() + y);
+    }
+
+    return;
+  }
+
+  const int left = rect.left();
+  const int width = rect.width();
+
+  for (int y = 0; y < height; ++y) {
+    TIFFReadScanline(tif.handle(), buf.data(), rect.top() + y);
+
+    const uint8* const src = buf.data();
+    uint8* const dst = image.scanLine(y);
+    if (info.bits_per_sample == 8) {
+      memcpy(dst, src + left, static_cast<size_t>(width));
+    } else {
+      memset(dst, 0, static_cast<size_t>(image.bytesPerLine()));
+      for (int x = 0; x < width; ++x) {
+        const int src_x = left + x;
+        if (src[src_x >> 3] & (0x80 >> (src_x & 7))) {
+          dst[x >> 3] |= static_cast<uint8>(0x80 >> (x & 7));
+        }
+      }
+    }
+  }
+}  // TiffReader::readLines
+
+void TiffReader::readAndUnpackLines(const TiffHandle& tif,
+                                    const TiffInfo& info,
+                                    const QRect& rect,
+                                    QImage& image) {
   TiffBuffer<uint8> buf(TIFFScanlineSize(tif.handle()));
+  if (!skipToRow(tif, rect.top(), buf.data())) {
+    return;
+  }
 
-  const int width = image.width();
-  const int height = image.height();
+  const int left = rect.left();
+  const int right = rect.left() + rect.width();
+  const int height = rect.height();
   const int bits_per_sample = info.bits_per_sample;
   const unsigned dst_mask = (1 << bits_per_sample) - 1;
 
   for (int y = 0; y < height; ++y) {
-    TIFFReadScanline(tif.handle(), buf.data(), y);
+    TIFFReadScanline(tif.handle(), buf.data(), rect.top() + y);
 
     unsigned accum = 0;
     int bits_in_accum = 0;
@@ -485,7 +901,7 @@ void TiffReader::readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info,
     const uint8* src = buf.data();
     auto* dst = image.scanLine(y);
 
-    for (int i = width; i > 0; --i, ++dst) {
+    for (int x = 0; x < right; ++x) {
       while (bits_in_accum < bits_per_sample) {
         accum <<= 8;
         accum |= *src;
@@ -493,7 +909,10 @@ void TiffReader::readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info,
         ++src;
       }
       bits_in_accum -= bits_per_sample;
-      *dst = static_cast<uint8>((accum >> bits_in_accum) & dst_mask);
+      if (x >= left) {
+        *dst = static_cast<uint8>((accum >> bits_in_accum) & dst_mask);
+        ++dst;
+      }
     }
   }
-}
+}  // TiffReader::readAndUnpackLines
@@ -19,16 +19,39 @@
 #ifndef TIFFREADER_H_
 #define TIFFREADER_H_
 
+#include <QByteArray>
+#include <vector>
+#include "Dpi.h"
 #include "ImageMetadataLoader.h"
 #include "VirtualFunction.h"
 
 class QIODevice;
 class QImage;
+class QRect;
+class QString;
 class ImageMetadata;
-class Dpi;
 
 class TiffReader {
  public:
+  /**
+   * \brief A page as stored in the file, its strips still compressed.
+   *
+   * The compression, photometric and predictor fields hold the values
+   * of the corresponding TIFF tags.
+   */
+  struct RawImage {
+    int width = 0;
+    int height = 0;
+    int bitsPerSample = 1;
+    int samplesPerPixel = 1;
+    int compression = 1;
+    int photometric = 0;
+    int predictor = 1;
+    int rowsPerStrip = 0;
+    Dpi dpi;
+    std::vector<QByteArray> strips;
+  };
+
   static bool canRead(QIODevice& device);
 
   static ImageMetadataLoader::Status readMetadata(QIODevice& device,
@@ -45,12 +68,37 @@ class TiffReader {
    */
   static QImage readImage(QIODevice& device, int page_num = 0);
 
+  /**
+   * \brief Same as above, but only reads the given area of the page.
+   *
+   * For images read line by line, which is the case for all bi-level,
+   * grayscale and palette ones, as well as for interleaved RGB ones,
+   * the strips above and below \p roi aren't decoded at all.
+   *
+   * \param roi The area to read.  A null rectangle stands for the whole
+   *        page.  It's clipped to the page rectangle.
+   */
+  static QImage readImage(QIODevice& device, int page_num, const QRect& roi);
+
+  /**
+   * \brief Reads the strips of a page without decoding them, so that
+   *        they can be passed on as they are.
+   *
+   * Only pages made of top-down, interleaved, unsigned integer samples
+   * in the most significant bit first order are supported.
+   *
+   * \return true on success.
+   */
+  static bool readRawImage(QIODevice& device, int page_num, RawImage& image);
+
  private:
   class TiffHeader;
   class TiffHandle;
 
   struct TiffInfo;
 
+  class DirectoryIndex;
+
   template <typename T>
   class TiffBuffer;
 
@@ -60,13 +108,43 @@ class TiffReader {
 
   static ImageMetadata currentPageMetadata(const TiffHandle& tif);
 
+  /**
+   * \return A key identifying the current version of the file behind
+   *         \p device in DirectoryIndex, or an empty string if it's not a file.
+   */
+  static QString directoryIndexKey(QIODevice& device);
+
+  /**
+   * \brief Makes the given page current, jumping straight to it
+   *        if its offset is in DirectoryIndex.
+   */
+  static bool setDirectory(const TiffHandle& tif, int page_num, const QString& index_key);
+
   static Dpi getDpi(float xres, float yres, unsigned res_unit);
 
-  static QImage extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info);
+  static QImage extractBinaryOrIndexed8Image(const TiffHandle& tif, const TiffInfo& info, const QRect& rect);
+
+  /**
+   * 16-bit samples are kept as they are, in Format_Grayscale16 or Format_RGBX64
+   * images, where Qt supports them.  Otherwise, they are reduced to 8 bits.
+   */
+  static QImage extractRgbOrGrayImage(const TiffHandle& tif, const TiffInfo& info, const QRect& rect);
+
+  /**
+   * \brief Reads and discards the rows preceding \p row within its strip.
+   *
+   * libtiff can't seek within a compressed strip, so TIFFReadScanline()
+   * fails unless the rows of a strip are read in order, starting from its
+   * first one.  This makes it possible to start reading at \p row.
+   *
+   * \param buf A buffer for a single scanline.
+   * \return true on success.
+   */
+  static bool skipToRow(const TiffHandle& tif, int row, void* buf);
 
-  static void readLines(const TiffHandle& tif, QImage& image);
+  static void readLines(const TiffHandle& tif, const TiffInfo& info, const QRect& rect, QImage& image);
 
-  static void readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, QImage& image);
+  static void readAndUnpackLines(const TiffHandle& tif, const TiffInfo& info, const QRect& rect, QImage& image);
 };
 
 
@@ -18,12 +18,20 @@
 
 #include "TiffWriter.h"
 #include <tiffio.h>
+#include <QBuffer>
 #include <QDebug>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 #include <QtCore/QFile>
-#include <QtCore/QSettings>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <vector>
 #include "Dpm.h"
+#include "TiffCodecOptions.h"
 #include "imageproc/Constants.h"
 #include "imageproc/Grayscale.h"
 
@@ -117,7 +125,7 @@ static void deviceUnmap(thandle_t, tdata_t, toff_t) {
   // Not implemented.
 }
 
-bool TiffWriter::writeImage(const QString& file_path, const QImage& image) {
+bool TiffWriter::writeImage(const QString& file_path, const QImage& image, const TiffCodecOptions& options) {
   if (image.isNull()) {
     return false;
   }
@@ -127,7 +135,7 @@ bool TiffWriter::writeImage(const QString& file_path, const QImage& image) {
     return false;
   }
 
-  if (!writeImage(file, image)) {
+  if (!writeImage(file, image, options)) {
     file.remove();
 
     return false;
@@ -136,7 +144,7 @@ bool TiffWriter::writeImage(const QString& file_path, const QImage& image) {
   return true;
 }
 
-bool TiffWriter::writeImage(QIODevice& device, const QImage& image) {
+bool TiffWriter::writeImage(QIODevice& device, const QImage& image, const TiffCodecOptions& options) {
   if (image.isNull()) {
     return false;
   }
@@ -167,13 +175,13 @@ bool TiffWriter::writeImage(QIODevice& device, const QImage& image) {
     case QImage::Format_Mono:
     case QImage::Format_MonoLSB:
     case QImage::Format_Indexed8:
-      return writeBitonalOrIndexed8Image(tif, image);
+      return writeBitonalOrIndexed8Image(tif, image, options);
     default:;
   }
   if (image.hasAlphaChannel()) {
-    return writeARGB32Image(tif, image.convertToFormat(QImage::Format_ARGB32));
+    return writeARGB32Image(tif, image.convertToFormat(QImage::Format_ARGB32), options);
   } else {
-    return writeRGB32Image(tif, image.convertToFormat(QImage::Format_RGB32));
+    return writeRGB32Image(tif, image.convertToFormat(QImage::Format_RGB32), options);
   }
 }  // TiffWriter::writeImage
 
@@ -208,7 +216,56 @@ void TiffWriter::setDpm(const TiffHandle& tif, const Dpm& dpm) {
   TIFFSetField(tif.handle(), TIFFTAG_RESOLUTIONUNIT, unit);
 }
 
-bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage& image) {
+void TiffWriter::setCompression(const TiffHandle& tif, const uint16 compression, const TiffCodecOptions& options) {
+  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, compression);
+  setCompressionLevel(tif, compression, options.level());
+
+  if (!options.predictor()) {
+    return;
+  }
+  switch (compression) {
+    case COMPRESSION_LZW:
+    case COMPRESSION_DEFLATE:
+    case COMPRESSION_ADOBE_DEFLATE:
+#ifdef COMPRESSION_ZSTD
+    case COMPRESSION_ZSTD:
+#endif
+      break;
+    default:
+      return;
+  }
+
+  uint16 bits_per_sample = 1;
+  uint16 photometric = PHOTOMETRIC_MINISWHITE;
+  TIFFGetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+  TIFFGetField(tif.handle(), TIFFTAG_PHOTOMETRIC, &photometric);
+  // Differencing palette indices or bilevel pixels doesn't make them any more compressible.
+  if ((bits_per_sample == 8) && ((photometric == PHOTOMETRIC_MINISBLACK) || (photometric == PHOTOMETRIC_RGB))) {
+    TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+  }
+}
+
+void TiffWriter::setCompressionLevel(const TiffHandle& tif, const uint16 compression, const int level) {
+  if (level <= 0) {
+    return;
+  }
+  switch (compression) {
+    case COMPRESSION_DEFLATE:
+    case COMPRESSION_ADOBE_DEFLATE:
+      TIFFSetField(tif.handle(), TIFFTAG_ZIPQUALITY, std::min(level, 9));
+      break;
+#ifdef COMPRESSION_ZSTD
+    case COMPRESSION_ZSTD:
+      TIFFSetField(tif.handle(), TIFFTAG_ZSTD_LEVEL, std::min(level, 22));
+      break;
+#endif
+    default:;
+  }
+}
+
+bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif,
+                                             const QImage& image,
+                                             const TiffCodecOptions& options) {
   TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(1));
 
   uint16 bits_per_sample = 8;
@@ -239,17 +296,15 @@ bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage
     default:;
   }
 
+  TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, bits_per_sample);
+  TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, photometric);
+
   if (image.format() == QImage::Format_Indexed8) {
-    TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION,
-                 uint16(QSettings().value("settings/color_compression", COMPRESSION_LZW).toInt()));
+    setCompression(tif, options.colorCompression(), options);
   } else {
-    TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION,
-                 uint16(QSettings().value("settings/bw_compression", COMPRESSION_CCITTFAX4).toInt()));
+    setCompression(tif, options.bwCompression(), options);
   }
 
-  TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, bits_per_sample);
-  TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, photometric);
-
   if (photometric == PHOTOMETRIC_PALETTE) {
     const int num_colors = 1 << bits_per_sample;
     QVector<QRgb> color_table(image.colorTable());
@@ -279,25 +334,20 @@ bool TiffWriter::writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage
   }
 }  // TiffWriter::writeBitonalOrIndexed8Image
 
-bool TiffWriter::writeRGB32Image(const TiffHandle& tif, const QImage& image) {
+bool TiffWriter::writeRGB32Image(const TiffHandle& tif, const QImage& image, const TiffCodecOptions& options) {
   assert(image.format() == QImage::Format_RGB32);
 
   TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(3));
-  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION,
-               uint16(QSettings().value("settings/color_compression", COMPRESSION_LZW).toInt()));
   TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
   TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  setCompression(tif, options.colorCompression(), options);
 
   const int width = image.width();
-  const int height = image.height();
-
-  std::vector<uint8_t> tmp_line(width * 3);
 
   // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
 
-  for (int y = 0; y < height; ++y) {
+  return writeLines(tif, image.height(), size_t(width) * 3, [&image, width](const int y, uint8_t* p_dst) {
     const auto* p_src = (const uint32_t*) image.scanLine(y);
-    uint8_t* p_dst = &tmp_line[0];
     for (int x = 0; x < width; ++x) {
       const uint32_t ARGB = *p_src;
       p_dst[0] = static_cast<uint8_t>(ARGB >> 16);
@@ -306,33 +356,23 @@ bool TiffWriter::writeRGB32Image(const TiffHandle& tif, const QImage& image) {
       ++p_src;
       p_dst += 3;
     }
-    if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-      return false;
-    }
-  }
-
-  return true;
+  });
 }  // TiffWriter::writeRGB32Image
 
-bool TiffWriter::writeARGB32Image(const TiffHandle& tif, const QImage& image) {
+bool TiffWriter::writeARGB32Image(const TiffHandle& tif, const QImage& image, const TiffCodecOptions& options) {
   assert(image.format() == QImage::Format_ARGB32);
 
   TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(4));
-  TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION,
-               uint16(QSettings().value("settings/color_compression", COMPRESSION_LZW).toInt()));
   TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
   TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  setCompression(tif, options.colorCompression(), options);
 
   const int width = image.width();
-  const int height = image.height();
-
-  std::vector<uint8_t> tmp_line(width * 4);
 
   // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
 
-  for (int y = 0; y < height; ++y) {
+  return writeLines(tif, image.height(), size_t(width) * 4, [&image, width](const int y, uint8_t* p_dst) {
     const auto* p_src = (const uint32_t*) image.scanLine(y);
-    uint8_t* p_dst = &tmp_line[0];
     for (int x = 0; x < width; ++x) {
       const uint32_t ARGB = *p_src;
       p_dst[0] = static_cast<uint8_t>(ARGB >> 16);
@@ -342,46 +382,199 @@ bool TiffWriter::writeARGB32Image(const TiffHandle& tif, const QImage& image) {
       ++p_src;
       p_dst += 4;
     }
-    if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-      return false;
-    }
-  }
-
-  return true;
+  });
 }  // TiffWriter::writeARGB32Image
 
 bool TiffWriter::write8bitLines(const TiffHandle& tif, const QImage& image) {
-  const int width = image.width();
-  const int height = image.height();
+  const size_t width = static_cast<size_t>(image.width());
 
   // TIFFWriteScanline() can actually modify the data you pass it,
   // so we have to use a temporary buffer even when no coversion
   // is required.
-  std::vector<uint8_t> tmp_line(width, 0);
+  return writeLines(tif, image.height(), width,
+                    [&image, width](const int y, uint8_t* dst) { memcpy(dst, image.scanLine(y), width); });
+}
 
-  for (int y = 0; y < height; ++y) {
+bool TiffWriter::writeBinaryLinesAsIs(const TiffHandle& tif, const QImage& image) {
+  // TIFFWriteScanline() can actually modify the data you pass it,
+  // so we have to use a temporary buffer even when no coversion
+  // is required.
+  const size_t bpl = static_cast<size_t>((image.width() + 7) / 8);
+
+  return writeLines(tif, image.height(), bpl,
+                    [&image, bpl](const int y, uint8_t* dst) { memcpy(dst, image.scanLine(y), bpl); });
+}
+
+bool TiffWriter::writeBinaryLinesReversed(const TiffHandle& tif, const QImage& image) {
+  const size_t bpl = static_cast<size_t>((image.width() + 7) / 8);
+
+  return writeLines(tif, image.height(), bpl, [&image, bpl](const int y, uint8_t* dst) {
     const uint8_t* src_line = image.scanLine(y);
-    memcpy(&tmp_line[0], src_line, tmp_line.size());
-    if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-      return false;
+    for (size_t i = 0; i < bpl; ++i) {
+      dst[i] = m_reverseBitsLUT[src_line[i]];
+    }
+  });
+}
+
+/*============================ Strip encoding ============================*/
+
+/**
+ * \brief The fields affecting how strips are compressed.
+ */
+struct TiffWriter::StripFormat {
+  uint32 width = 0;
+  uint16 bits_per_sample = 1;
+  uint16 samples_per_pixel = 1;
+  uint16 photometric = PHOTOMETRIC_MINISWHITE;
+  uint16 compression = COMPRESSION_NONE;
+  uint16 predictor = PREDICTOR_NONE;
+  int level = 0;
+
+  explicit StripFormat(const TiffHandle& tif) {
+    TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+    TIFFGetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+    TIFFGetField(tif.handle(), TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetField(tif.handle(), TIFFTAG_COMPRESSION, &compression);
+    TIFFGetField(tif.handle(), TIFFTAG_PREDICTOR, &predictor);
+    if ((compression == COMPRESSION_DEFLATE) || (compression == COMPRESSION_ADOBE_DEFLATE)) {
+      TIFFGetField(tif.handle(), TIFFTAG_ZIPQUALITY, &level);
+    }
+#ifdef COMPRESSION_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+      TIFFGetField(tif.handle(), TIFFTAG_ZSTD_LEVEL, &level);
     }
+#endif
   }
 
-  return true;
+  void applyTo(const TiffHandle& tif, const uint32 height) const {
+    TIFFSetField(tif.handle(), TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif.handle(), TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, height);
+    TIFFSetField(tif.handle(), TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+    TIFFSetField(tif.handle(), TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, bits_per_sample);
+    TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, samples_per_pixel);
+    TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, photometric);
+    TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, compression);
+    setCompressionLevel(tif, compression, level);
+    if (predictor != PREDICTOR_NONE) {
+      TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, predictor);
+    }
+  }
+};
+
+
+/**
+ * \brief Compresses a single strip by writing it as the only strip
+ *        of a throwaway in-memory TIFF and taking the resulting bytes.
+ */
+class TiffWriter::StripEncoder : public QRunnable {
+ public:
+  StripEncoder(const StripFormat& format,
+               const RowFiller& fill_row,
+               size_t row_bytes,
+               int first_row,
+               int num_rows,
+               QByteArray& result,
+               std::atomic<bool>& failed,
+               QSemaphore& done)
+      : m_format(format),
+        m_fillRow(fill_row),
+        m_rowBytes(row_bytes),
+        m_firstRow(first_row),
+        m_numRows(num_rows),
+        m_result(result),
+        m_failed(failed),
+        m_done(done) {
+    setAutoDelete(true);
+  }
+
+  void run() override {
+    try {
+      encode();
+    } catch (...) {
+      // Whatever the row filler or libtiff threw, it must not escape into
+      // the pool thread, and the semaphore still has to be released.
+      m_result.clear();
+    }
+    if (m_result.isEmpty()) {
+      m_failed = true;
+    }
+    m_done.release();
+  }
+
+ private:
+  void encode() {
+    std::vector<uint8_t> raw(m_rowBytes * m_numRows);
+    for (int i = 0; i < m_numRows; ++i) {
+      m_fillRow(m_firstRow + i, &raw[m_rowBytes * i]);
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    const TiffHandle tif(TIFFClientOpen("strip", "wBm", &buffer, &deviceRead, &deviceWrite, &deviceSeek,
+                                        &deviceClose, &deviceSize, &deviceMap, &deviceUnmap));
+    if (!tif.handle()) {
+      return;
+    }
+    m_format.applyTo(tif, uint32(m_numRows));
+
+    if (TIFFWriteEncodedStrip(tif.handle(), 0, raw.data(), tmsize_t(raw.size())) == -1) {
+      return;
+    }
+
+    toff_t* offsets = nullptr;
+    toff_t* byte_counts = nullptr;
+    if (!TIFFGetField(tif.handle(), TIFFTAG_STRIPOFFSETS, &offsets)
+        || !TIFFGetField(tif.handle(), TIFFTAG_STRIPBYTECOUNTS, &byte_counts) || !offsets || !byte_counts) {
+      return;
+    }
+    m_result = buffer.data().mid(int(offsets[0]), int(byte_counts[0]));
+  }
+
+  const StripFormat& m_format;
+  const RowFiller& m_fillRow;
+  const size_t m_rowBytes;
+  const int m_firstRow;
+  const int m_numRows;
+  QByteArray& m_result;
+  std::atomic<bool>& m_failed;
+  QSemaphore& m_done;
+};
+
+
+static QThreadPool& stripEncoderPool() {
+  static QThreadPool pool;
+
+  return pool;
 }
 
-bool TiffWriter::writeBinaryLinesAsIs(const TiffHandle& tif, const QImage& image) {
-  const int width = image.width();
-  const int height = image.height();
-  // TIFFWriteScanline() can actually modify the data you pass it,
-  // so we have to use a temporary buffer even when no coversion
-  // is required.
-  const int bpl = (width + 7) / 8;
-  std::vector<uint8_t> tmp_line(bpl, 0);
+bool TiffWriter::writeLines(const TiffHandle& tif,
+                            const int height,
+                            const size_t row_bytes,
+                            const RowFiller& fill_row) {
+  uint16 compression = COMPRESSION_NONE;
+  TIFFGetField(tif.handle(), TIFFTAG_COMPRESSION, &compression);
+
+  const int num_threads = stripEncoderPool().maxThreadCount();
+  const qint64 total_bytes = qint64(row_bytes) * height;
+  if (compression == COMPRESSION_CCITTFAX4) {
+    // G4 pages are small and fast to encode anyway.  A single strip
+    // lets PdfWriter pass them through as they are.
+    TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(height));
+  } else if ((num_threads > 1) && isStripwiseCompression(compression) && (total_bytes >= (1 << 20))) {
+    // A couple of strips per thread, but not so small
+    // that the per-strip overhead would dominate.
+    const qint64 strip_bytes = qBound<qint64>(64 << 10, total_bytes / (num_threads * 2), 1 << 20);
+    const int rows_per_strip = int(qBound<qint64>(1, strip_bytes / qint64(row_bytes), height));
+
+    return writeStripsInParallel(tif, height, row_bytes, rows_per_strip, fill_row);
+  }
 
+  std::vector<uint8_t> tmp_line(row_bytes, 0);
   for (int y = 0; y < height; ++y) {
-    const uint8_t* src_line = image.scanLine(y);
-    memcpy(&tmp_line[0], src_line, bpl);
+    fill_row(y, &tmp_line[0]);
     if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
       return false;
     }
@@ -390,22 +583,53 @@ bool TiffWriter::writeBinaryLinesAsIs(const TiffHandle& tif, const QImage& image
   return true;
 }
 
-bool TiffWriter::writeBinaryLinesReversed(const TiffHandle& tif, const QImage& image) {
-  const int width = image.width();
-  const int height = image.height();
-
-  const int bpl = (width + 7) / 8;
-  std::vector<uint8_t> tmp_line(bpl, 0);
+bool TiffWriter::writeStripsInParallel(const TiffHandle& tif,
+                                       const int height,
+                                       const size_t row_bytes,
+                                       const int rows_per_strip,
+                                       const RowFiller& fill_row) {
+  TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(rows_per_strip));
+
+  const StripFormat format(tif);
+  const int num_strips = (height + rows_per_strip - 1) / rows_per_strip;
+  std::vector<QByteArray> strips(static_cast<size_t>(num_strips));
+  std::atomic<bool> failed(false);
+  QSemaphore done;
+
+  for (int i = 0; i < num_strips; ++i) {
+    const int first_row = i * rows_per_strip;
+    const int num_rows = std::min(rows_per_strip, height - first_row);
+    stripEncoderPool().start(
+        new StripEncoder(format, fill_row, row_bytes, first_row, num_rows, strips[i], failed, done));
+  }
+  done.acquire(num_strips);
+  if (failed) {
+    return false;
+  }
 
-  for (int y = 0; y < height; ++y) {
-    const uint8_t* src_line = image.scanLine(y);
-    for (int i = 0; i < bpl; ++i) {
-      tmp_line[i] = m_reverseBitsLUT[src_line[i]];
-    }
-    if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
+  // The strips have to be written in order, so that they are laid out
+  // in the file the way readers expect.
+  for (int i = 0; i < num_strips; ++i) {
+    if (TIFFWriteRawStrip(tif.handle(), uint32(i), strips[i].data(), tmsize_t(strips[i].size())) == -1) {
       return false;
     }
   }
 
   return true;
+}  // TiffWriter::writeStripsInParallel
+
+bool TiffWriter::isStripwiseCompression(const uint16 compression) {
+  switch (compression) {
+    case COMPRESSION_LZW:
+    case COMPRESSION_DEFLATE:
+    case COMPRESSION_ADOBE_DEFLATE:
+    case COMPRESSION_PACKBITS:
+    case COMPRESSION_CCITTFAX4:
+#ifdef COMPRESSION_ZSTD
+    case COMPRESSION_ZSTD:
+#endif
+      return true;
+    default:
+      return false;
+  }
 }
@@ -22,11 +22,13 @@
 #include <tiff.h>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 
 class QIODevice;
 class QString;
 class QImage;
 class Dpm;
+class TiffCodecOptions;
 
 class TiffWriter {
  public:
@@ -35,9 +37,10 @@ class TiffWriter {
    *
    * \param file_path The full path to the file.
    * \param image The image to write.  Writing a null image will fail.
+   * \param options How to compress the image.
    * \return True on success, false on failure.
    */
-  static bool writeImage(const QString& file_path, const QImage& image);
+  static bool writeImage(const QString& file_path, const QImage& image, const TiffCodecOptions& options);
 
   /**
    * \brief Writes a QImage in TIFF format to an IO device.
@@ -45,20 +48,33 @@ class TiffWriter {
    * \param device The device to write to.  This device must be
    *        opened for writing and seekable.
    * \param image The image to write.  Writing a null image will fail.
+   * \param options How to compress the image.
    * \return True on success, false on failure.
    */
-  static bool writeImage(QIODevice& device, const QImage& image);
+  static bool writeImage(QIODevice& device, const QImage& image, const TiffCodecOptions& options);
 
  private:
   class TiffHandle;
 
   static void setDpm(const TiffHandle& tif, const Dpm& dpm);
 
-  static bool writeBitonalOrIndexed8Image(const TiffHandle& tif, const QImage& image);
+  /**
+   * \brief Sets the compression along with its level and the predictor.
+   *
+   * Must be called after the bits per sample and the photometric
+   * interpretation are set, as the predictor depends on them.
+   */
+  static void setCompression(const TiffHandle& tif, uint16 compression, const TiffCodecOptions& options);
+
+  static void setCompressionLevel(const TiffHandle& tif, uint16 compression, int level);
+
+  static bool writeBitonalOrIndexed8Image(const TiffHandle& tif,
+                                          const QImage& image,
+                                          const TiffCodecOptions& options);
 
-  static bool writeRGB32Image(const TiffHandle& tif, const QImage& image);
+  static bool writeRGB32Image(const TiffHandle& tif, const QImage& image, const TiffCodecOptions& options);
 
-  static bool writeARGB32Image(const TiffHandle& tif, const QImage& image);
+  static bool writeARGB32Image(const TiffHandle& tif, const QImage& image, const TiffCodecOptions& options);
 
   static bool write8bitLines(const TiffHandle& tif, const QImage& image);
 
@@ -66,6 +82,37 @@ class TiffWriter {
 
   static bool writeBinaryLinesReversed(const TiffHandle& tif, const QImage& image);
 
+  /**
+   * \brief Fills \p dst with row \p y in the form libtiff expects it.
+   *
+   * Must be safe to call from multiple threads at once.
+   */
+  typedef std::function<void(int y, uint8_t* dst)> RowFiller;
+
+  struct StripFormat;
+  class StripEncoder;
+
+  /**
+   * \brief Writes the image data, row by row or as strips compressed
+   *        in parallel, depending on the compression and the image size.
+   *
+   * CCITT G4 images are always written as a single strip.
+   */
+  static bool writeLines(const TiffHandle& tif, int height, size_t row_bytes, const RowFiller& fill_row);
+
+  static bool writeStripsInParallel(const TiffHandle& tif,
+                                    int height,
+                                    size_t row_bytes,
+                                    int rows_per_strip,
+                                    const RowFiller& fill_row);
+
+  /**
+   * \return Whether strips compressed separately may be concatenated,
+   *         which isn't the case for codecs keeping state in the directory,
+   *         like JPEG with its shared tables.
+   */
+  static bool isStripwiseCompression(uint16 compression);
+
   static const uint8_t m_reverseBitsLUT[256];
 };
 
@@ -25,6 +25,11 @@
 #include <windows.h>
 #else
 #include <stdio.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_MACOS
+#include <sys/sysctl.h>
+#include <sys/types.h>
 #endif
 
 bool Utils::overwritingRename(const QString& from, const QString& to) {
@@ -35,6 +40,32 @@ bool Utils::overwritingRename(const QString& from, const QString& to) {
 #endif
 }
 
+qint64 Utils::physicalMemorySize() {
+#if defined(Q_OS_WIN)
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status)) {
+    return 0;
+  }
+  return qint64(status.ullTotalPhys);
+#elif defined(Q_OS_MACOS)
+  int mib[2] = {CTL_HW, HW_MEMSIZE};
+  int64_t size = 0;
+  size_t len = sizeof(size);
+  if (sysctl(mib, 2, &size, &len, nullptr, 0) != 0) {
+    return 0;
+  }
+  return qint64(size);
+#else
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long page_size = sysconf(_SC_PAGESIZE);
+  if ((pages <= 0) || (page_size <= 0)) {
+    return 0;
+  }
+  return qint64(pages) * page_size;
+#endif
+}
+
 QString Utils::richTextForLink(const QString& label, const QString& target) {
   return QString::fromLatin1(
              "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.0//EN\""
@@ -57,6 +88,10 @@ QString Utils::outputDirToThumbDir(const QString& output_dir) {
   return output_dir + QLatin1String("/cache/thumbs");
 }
 
+QString Utils::outputDirToIntermediateDir(const QString& output_dir) {
+  return output_dir + QLatin1String("/cache/intermediate");
+}
+
 intrusive_ptr<ThumbnailPixmapCache> Utils::createThumbnailCache(const QString& output_dir) {
   const QSize max_pixmap_size = QSettings().value("settings/thumbnail_quality", QSize(200, 200)).toSize();
   const QString thumbs_cache_path(outputDirToThumbDir(output_dir));
@@ -48,6 +48,8 @@ class Utils {
 
   static QString outputDirToThumbDir(const QString& output_dir);
 
+  static QString outputDirToIntermediateDir(const QString& output_dir);
+
   static intrusive_ptr<ThumbnailPixmapCache> createThumbnailCache(const QString& output_dir);
 
   /**
@@ -55,6 +57,13 @@ class Utils {
    */
   static bool overwritingRename(const QString& from, const QString& to);
 
+  /**
+   * \brief The amount of physical memory installed, in bytes.
+   *
+   * \return The amount or 0 if it couldn't be determined.
+   */
+  static qint64 physicalMemorySize();
+
   /**
    * \brief A high precision, locale independent number to string conversion.
    *
@@ -19,8 +19,13 @@
 #include "WorkerThreadPool.h"
 #include <QCoreApplication>
 #include <QThreadPool>
+#include <algorithm>
+#include <limits>
 #include <utility>
+#include "DecodedImageCache.h"
+#include "ImagePrefetcher.h"
 #include "OutOfMemoryHandler.h"
+#include "Utils.h"
 
 class WorkerThreadPool::TaskResultEvent : public QEvent {
  public:
@@ -37,8 +42,43 @@ class WorkerThreadPool::TaskResultEvent : public QEvent {
 };
 
 
-WorkerThreadPool::WorkerThreadPool(QObject* parent) : QObject(parent), m_pool(new QThreadPool(this)) {
+class WorkerThreadPool::Runnable : public QRunnable {
+ public:
+  Runnable(WorkerThreadPool& owner, BackgroundTaskPtr task) : m_owner(owner), m_task(std::move(task)) {
+    setAutoDelete(true);
+  }
+
+  void run() override {
+    FilterResultPtr result;
+    if (!m_task->isCancelledOrPreempted()) {
+      try {
+        result = (*m_task)();
+        if (result) {
+          QCoreApplication::postEvent(&m_owner, new TaskResultEvent(m_task, result));
+        }
+      } catch (const std::bad_alloc&) {
+        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+      }
+    }
+
+    m_owner.taskFinished(m_task, result != nullptr);
+  }
+
+ private:
+  WorkerThreadPool& m_owner;
+  BackgroundTaskPtr m_task;
+};
+
+
+WorkerThreadPool::WorkerThreadPool(QObject* parent)
+    : QObject(parent),
+      m_pool(new QThreadPool(this)),
+      m_numRunningInteractiveTasks(0),
+      m_numThreads(1),
+      m_memoryInUse(0),
+      m_memoryBudget(0) {
   updateNumberOfThreads();
+  updateMemoryBudget();
 }
 
 WorkerThreadPool::~WorkerThreadPool() = default;
@@ -48,42 +88,168 @@ void WorkerThreadPool::shutdown() {
 }
 
 bool WorkerThreadPool::hasSpareCapacity() const {
-  return m_pool->activeThreadCount() < m_pool->maxThreadCount();
+  const QMutexLocker locker(&m_mutex);
+
+  return m_pendingInteractiveTasks.empty() && m_pendingBatchTasks.empty()
+         && (int(m_runningBatchTasks.size()) + m_numRunningInteractiveTasks < m_numThreads);
+}
+
+int WorkerThreadPool::numThreads() const {
+  const QMutexLocker locker(&m_mutex);
+
+  return m_numThreads;
 }
 
 void WorkerThreadPool::submitTask(const BackgroundTaskPtr& task) {
-  class Runnable : public QRunnable {
-   public:
-    Runnable(WorkerThreadPool& owner, BackgroundTaskPtr task) : m_owner(owner), m_task(std::move(task)) {
-      setAutoDelete(true);
+  updateNumberOfThreads();
+  updateMemoryBudget();
+
+  const QMutexLocker locker(&m_mutex);
+  if (task->type() == BackgroundTask::INTERACTIVE) {
+    m_pendingInteractiveTasks.push_back(task);
+  } else {
+    m_pendingBatchTasks.push_back(task);
+  }
+  startAdmittedTasks();
+}
+
+int WorkerThreadPool::defaultMemoryBudgetMb() {
+  const qint64 physical_mb = Utils::physicalMemorySize() / (1024 * 1024);
+  if (physical_mb <= 0) {
+    // Leave some of the address space for the rest of the application.
+    return (sizeof(void*) <= 4) ? 1536 : 0;
+  }
+
+  // Leave the other half to the rest of the application, the OS and
+  // other processes.
+  qint64 budget_mb = std::max<qint64>(physical_mb / 2, 512);
+  if (sizeof(void*) <= 4) {
+    budget_mb = std::min<qint64>(budget_mb, 1536);
+  }
+
+  return static_cast<int>(std::min<qint64>(budget_mb, std::numeric_limits<int>::max()));
+}
+
+void WorkerThreadPool::startAdmittedTasks() {
+  while (!m_pendingInteractiveTasks.empty()) {
+    const BackgroundTaskPtr task(m_pendingInteractiveTasks.front());
+    if (task->isCancelled()) {
+      m_pendingInteractiveTasks.pop_front();
+      continue;
     }
 
-    void run()
+    if (!fitsIntoMemoryBudget(task->memoryFootprint())) {
+      // Wait for the preempted tasks to release their memory.
+      // No batch task is to be started in the meantime.
+      preemptBatchTasksFor(task->memoryFootprint());
+      return;
+    }
+    if (numActiveBatchTasks() + m_numRunningInteractiveTasks >= m_numThreads) {
+      // The reserved thread lets us start right away, but we still
+      // take a processor core from batch processing.
+      preemptNewestBatchTask();
+    }
 
-        override {
-      if (m_task->isCancelled()) {
-        return;
-      }
+    m_pendingInteractiveTasks.pop_front();
+    startTask(task);
+  }
 
-      try {
-        const FilterResultPtr result((*m_task)());
-        if (result) {
-          QCoreApplication::postEvent(&m_owner, new TaskResultEvent(m_task, result));
-        }
-      } catch (const std::bad_alloc&) {
-        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
-      }
+  while (!m_pendingBatchTasks.empty()) {
+    const BackgroundTaskPtr task(m_pendingBatchTasks.front());
+    if (task->isCancelled()) {
+      m_pendingBatchTasks.pop_front();
+      continue;
     }
 
-   private:
-    WorkerThreadPool& m_owner;
-    BackgroundTaskPtr m_task;
-  };
+    if (int(m_runningBatchTasks.size()) + m_numRunningInteractiveTasks >= m_numThreads) {
+      break;
+    }
+    if (!fitsIntoMemoryBudget(task->memoryFootprint())) {
+      // Tasks are started in the order they were submitted, so the ones
+      // behind it wait as well.
+      break;
+    }
 
+    m_pendingBatchTasks.pop_front();
+    startTask(task);
+  }
+}  // WorkerThreadPool::startAdmittedTasks
 
-  updateNumberOfThreads();
+void WorkerThreadPool::startTask(const BackgroundTaskPtr& task) {
+  m_memoryInUse += task->memoryFootprint();
+  if (task->type() == BackgroundTask::INTERACTIVE) {
+    ++m_numRunningInteractiveTasks;
+  } else {
+    m_runningBatchTasks.push_back(task);
+  }
   m_pool->start(new Runnable(*this, task));
-}  // WorkerThreadPool::submitTask
+}
+
+bool WorkerThreadPool::fitsIntoMemoryBudget(const qint64 footprint) const {
+  if ((m_memoryBudget <= 0) || (m_memoryInUse == 0)) {
+    return true;
+  }
+
+  return m_memoryInUse + sharedMemoryInUse() + footprint <= m_memoryBudget;
+}
+
+qint64 WorkerThreadPool::sharedMemoryInUse() {
+  return DecodedImageCache::instance().totalBytes() + ImagePrefetcher::instance().totalBytes();
+}
+
+void WorkerThreadPool::preemptBatchTasksFor(const qint64 footprint) {
+  // Preempting tasks doesn't release the shared memory.
+  const qint64 shared_memory_in_use = sharedMemoryInUse();
+  qint64 memory_in_use = m_memoryInUse;
+  for (const BackgroundTaskPtr& task : m_runningBatchTasks) {
+    if (task->isPreempted()) {
+      memory_in_use -= task->memoryFootprint();
+    }
+  }
+
+  for (auto it = m_runningBatchTasks.rbegin(); it != m_runningBatchTasks.rend(); ++it) {
+    if ((memory_in_use <= 0) || (memory_in_use + shared_memory_in_use + footprint <= m_memoryBudget)) {
+      break;
+    }
+    if (!(*it)->isCancelled() && !(*it)->wasPreempted()) {
+      (*it)->preempt();
+      memory_in_use -= (*it)->memoryFootprint();
+    }
+  }
+}
+
+void WorkerThreadPool::preemptNewestBatchTask() {
+  for (auto it = m_runningBatchTasks.rbegin(); it != m_runningBatchTasks.rend(); ++it) {
+    if (!(*it)->isCancelled() && !(*it)->wasPreempted()) {
+      (*it)->preempt();
+      break;
+    }
+  }
+}
+
+int WorkerThreadPool::numActiveBatchTasks() const {
+  return static_cast<int>(std::count_if(m_runningBatchTasks.begin(), m_runningBatchTasks.end(),
+                                        [](const BackgroundTaskPtr& task) { return !task->isCancelledOrPreempted(); }));
+}
+
+void WorkerThreadPool::taskFinished(const BackgroundTaskPtr& task, const bool completed) {
+  const QMutexLocker locker(&m_mutex);
+
+  m_memoryInUse -= task->memoryFootprint();
+  if (task->type() == BackgroundTask::INTERACTIVE) {
+    --m_numRunningInteractiveTasks;
+  } else {
+    m_runningBatchTasks.erase(std::find(m_runningBatchTasks.begin(), m_runningBatchTasks.end(), task));
+    if (task->isPreempted()) {
+      task->clearPreemption();
+      if (!completed) {
+        m_pendingBatchTasks.push_front(task);
+      }
+    }
+  }
+
+  startAdmittedTasks();
+}
 
 void WorkerThreadPool::customEvent(QEvent* event) {
   if (auto* evt = dynamic_cast<TaskResultEvent*>(event)) {
@@ -106,5 +272,16 @@ void WorkerThreadPool::updateNumberOfThreads() {
 
   int num_threads = m_settings.value("settings/batch_processing_threads", max_threads).toInt();
   num_threads = std::min<int>(num_threads, max_threads);
-  m_pool->setMaxThreadCount(num_threads);
+
+  const QMutexLocker locker(&m_mutex);
+  m_numThreads = num_threads;
+  // One more thread is reserved for interactive tasks.
+  m_pool->setMaxThreadCount(num_threads + 1);
+}
+
+void WorkerThreadPool::updateMemoryBudget() {
+  const qint64 budget_mb = m_settings.value("settings/processing_memory_budget_mb", defaultMemoryBudgetMb()).toInt();
+
+  const QMutexLocker locker(&m_mutex);
+  m_memoryBudget = std::max<qint64>(0, budget_mb) * 1024 * 1024;
 }
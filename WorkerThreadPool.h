@@ -19,9 +19,12 @@
 #ifndef WORKERTHREADPOOL_H_
 #define WORKERTHREADPOOL_H_
 
+#include <QMutex>
 #include <QObject>
 #include <QSettings>
+#include <deque>
 #include <memory>
+#include <vector>
 #include "BackgroundTask.h"
 #include "FilterResult.h"
 
@@ -44,21 +47,94 @@ class WorkerThreadPool : public QObject {
 
   bool hasSpareCapacity() const;
 
+  /**
+   * \brief The number of threads batch tasks are processed on.
+   */
+  int numThreads() const;
+
+  /**
+   * \brief Queues a task for processing.
+   *
+   * A task is held back while running it would exceed the memory budget,
+   * given the memory footprints of the tasks already running and the memory
+   * taken by DecodedImageCache and ImagePrefetcher.  A task is
+   * never held back if nothing else is running, no matter its footprint.
+   *
+   * Interactive tasks are started before any batch ones and have a thread
+   * reserved for them.  If all the processing threads or the memory budget
+   * are taken, the most recently started batch tasks are preempted to make
+   * room.  Preempted tasks are restarted ahead of the other batch tasks.
+   * A task is only ever preempted once, so that it isn't restarted over
+   * and over while interactive tasks keep coming.
+   */
   void submitTask(const BackgroundTaskPtr& task);
 
+  /**
+   * \brief The memory budget in megabytes used if not set in the settings.
+   *
+   * Derived from the amount of physical memory.  0 means no limit, which
+   * is only returned if the amount of physical memory is unknown.
+   */
+  static int defaultMemoryBudgetMb();
+
  signals:
 
   void taskResult(const BackgroundTaskPtr& task, const FilterResultPtr& result);
 
  private:
   class TaskResultEvent;
+  class Runnable;
 
   void customEvent(QEvent* event) override;
 
   void updateNumberOfThreads();
 
+  void updateMemoryBudget();
+
+  /**
+   * \brief Starts the pending tasks there is room for.
+   *
+   * Must be called with m_mutex locked, as the rest of the methods below.
+   */
+  void startAdmittedTasks();
+
+  void startTask(const BackgroundTaskPtr& task);
+
+  bool fitsIntoMemoryBudget(qint64 footprint) const;
+
+  /**
+   * \brief The memory taken outside of the running tasks that counts
+   *        against the budget, namely by DecodedImageCache and ImagePrefetcher.
+   */
+  static qint64 sharedMemoryInUse();
+
+  /**
+   * \brief Preempts batch tasks, newest first, until \p footprint fits
+   *        into the memory left once they are done.
+   *
+   * The tasks preempted before are left running.
+   */
+  void preemptBatchTasksFor(qint64 footprint);
+
+  /**
+   * \brief Preempts the newest batch task that was never preempted before.
+   */
+  void preemptNewestBatchTask();
+
+  int numActiveBatchTasks() const;
+
+  void taskFinished(const BackgroundTaskPtr& task, bool completed);
+
   QThreadPool* m_pool;
   QSettings m_settings;
+  mutable QMutex m_mutex;
+  std::deque<BackgroundTaskPtr> m_pendingInteractiveTasks;
+  std::deque<BackgroundTaskPtr> m_pendingBatchTasks;
+  std::vector<BackgroundTaskPtr> m_runningBatchTasks;  // In the order they were started.
+  int m_numRunningInteractiveTasks;
+  int m_numThreads;
+  qint64 m_memoryInUse;
+  qint64 m_memoryBudget;
 };
 
 
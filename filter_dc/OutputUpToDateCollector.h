@@ -0,0 +1,46 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OUTPUTUPTODATECOLLECTOR_H_
+#define OUTPUTUPTODATECOLLECTOR_H_
+
+#include "AbstractFilterDataCollector.h"
+
+/**
+ * \brief Finds out whether a page's output files are up to date, without
+ *        loading the page's image.
+ *
+ * Only the output stage reports to this collector, and only if all of the
+ * previous stages have valid parameters for the page.  Therefore, a page
+ * that never reaches the output stage is considered not up to date.
+ */
+class OutputUpToDateCollector : public AbstractFilterDataCollector {
+ public:
+  OutputUpToDateCollector() : m_upToDate(false) {}
+
+  void process(bool up_to_date) { m_upToDate = up_to_date; }
+
+  bool isUpToDate() const { return m_upToDate; }
+
+ private:
+  bool m_upToDate;
+};
+
+
+#endif
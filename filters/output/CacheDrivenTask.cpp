@@ -22,6 +22,7 @@
 #include <utility>
 #include "FillZoneComparator.h"
 #include "IncompleteThumbnail.h"
+#include "OutputFileParams.h"
 #include "OutputGenerator.h"
 #include "PageInfo.h"
 #include "PictureZoneComparator.h"
@@ -29,11 +30,14 @@
 #include "Thumbnail.h"
 #include "Utils.h"
 #include "filter_dc/AbstractFilterDataCollector.h"
+#include "filter_dc/OutputUpToDateCollector.h"
 #include "filter_dc/ThumbnailCollector.h"
 
 namespace output {
 CacheDrivenTask::CacheDrivenTask(intrusive_ptr<Settings> settings, const OutputFileNameGenerator& out_file_name_gen)
-    : m_settings(std::move(settings)), m_outFileNameGen(out_file_name_gen) {}
+    : m_settings(std::move(settings)),
+      m_outFileNameGen(out_file_name_gen),
+      m_jpegOptions(JpegOutputOptions::current()) {}
 
 CacheDrivenTask::~CacheDrivenTask() = default;
 
@@ -41,101 +45,34 @@ void CacheDrivenTask::process(const PageInfo& page_info,
                               AbstractFilterDataCollector* collector,
                               const ImageTransformation& xform,
                               const QPolygonF& content_rect_phys) {
-  if (auto* thumb_col = dynamic_cast<ThumbnailCollector*>(collector)) {
-    const QString out_file_path(m_outFileNameGen.filePathFor(page_info.id()));
-    const QFileInfo out_file_info(out_file_path);
-    const QString foreground_dir(Utils::foregroundDir(m_outFileNameGen.outDir()));
-    const QString background_dir(Utils::backgroundDir(m_outFileNameGen.outDir()));
-    const QString original_background_dir(Utils::originalBackgroundDir(m_outFileNameGen.outDir()));
-    const QString foreground_file_path(QDir(foreground_dir).absoluteFilePath(out_file_info.fileName()));
-    const QString background_file_path(QDir(background_dir).absoluteFilePath(out_file_info.fileName()));
-    const QString original_background_file_path(
-        QDir(original_background_dir).absoluteFilePath(out_file_info.fileName()));
-    const QFileInfo foreground_file_info(foreground_file_path);
-    const QFileInfo background_file_info(background_file_path);
-    const QFileInfo original_background_file_info(original_background_file_path);
-
-    const Params params(m_settings->getParams(page_info.id()));
-    RenderParams render_params(params.colorParams(), params.splittingOptions());
-
-    ImageTransformation new_xform(xform);
-    new_xform.postScaleToDpi(params.outputDpi());
-
-    bool need_reprocess = false;
-
-    do {  // Just to be able to break from it.
-      std::unique_ptr<OutputParams> stored_output_params(m_settings->getOutputParams(page_info.id()));
-
-      if (!stored_output_params) {
-        need_reprocess = true;
-        break;
-      }
-
-      const OutputGenerator generator(params.outputDpi(), params.colorParams(), params.splittingOptions(),
-                                      params.pictureShapeOptions(), params.dewarpingOptions(),
-                                      m_settings->getOutputProcessingParams(page_info.id()), params.despeckleLevel(),
-                                      new_xform, content_rect_phys);
-      const OutputImageParams new_output_image_params(
-          generator.outputImageSize(), generator.outputContentRect(), new_xform, params.outputDpi(),
-          params.colorParams(), params.splittingOptions(), params.dewarpingOptions(), params.distortionModel(),
-          params.depthPerception(), params.despeckleLevel(), params.pictureShapeOptions(),
-          m_settings->getOutputProcessingParams(page_info.id()), params.isBlackOnWhite());
-
-      if (!stored_output_params->outputImageParams().matches(new_output_image_params)) {
-        need_reprocess = true;
-        break;
-      }
-
-      const ZoneSet new_picture_zones(m_settings->pictureZonesForPage(page_info.id()));
-      if (!PictureZoneComparator::equal(stored_output_params->pictureZones(), new_picture_zones)) {
-        need_reprocess = true;
-        break;
-      }
-
-      const ZoneSet new_fill_zones(m_settings->fillZonesForPage(page_info.id()));
-      if (!FillZoneComparator::equal(stored_output_params->fillZones(), new_fill_zones)) {
-        need_reprocess = true;
-        break;
-      }
-
-      const QFileInfo out_file_info(out_file_path);
-
-      if (!render_params.splitOutput()) {
-        if (!out_file_info.exists()) {
-          need_reprocess = true;
-          break;
-        }
-
-        if (!stored_output_params->outputFileParams().matches(OutputFileParams(out_file_info))) {
-          need_reprocess = true;
-          break;
-        }
-      } else {
-        if (!foreground_file_info.exists() || !background_file_info.exists()) {
-          need_reprocess = true;
-          break;
-        }
-        if (!(stored_output_params->foregroundFileParams().matches(OutputFileParams(foreground_file_info)))
-            || !(stored_output_params->backgroundFileParams().matches(OutputFileParams(background_file_info)))) {
-          need_reprocess = true;
-          break;
-        }
-
-        if (render_params.originalBackground()) {
-          if (!original_background_file_info.exists()) {
-            need_reprocess = true;
-            break;
-          }
-          if (!(stored_output_params->originalBackgroundFileParams().matches(
-                  OutputFileParams(original_background_file_info)))) {
-            need_reprocess = true;
-            break;
-          }
-        }
+  const Params params(m_settings->getParams(page_info.id()));
+
+  ImageTransformation new_xform(xform);
+  new_xform.postScaleToDpi(params.outputDpi());
+
+  const QString out_file_path(
+      m_outFileNameGen.filePathFor(page_info.id(), Utils::outputFileFormat(params, m_jpegOptions)));
+
+  if (auto* up_to_date_col = dynamic_cast<OutputUpToDateCollector*>(collector)) {
+    bool up_to_date = isOutputUpToDate(page_info, params, new_xform, content_rect_phys);
+    if (up_to_date) {
+      // A source file replaced after the output was generated
+      // isn't noticed by the checks above.
+      const QFileInfo source_file_info(page_info.imageId().filePath());
+      OutputFileParams out_file_params(Utils::outputFileParams(out_file_path));
+      if (!out_file_params.isValid()) {
+        const QString foreground_file_path(QDir(Utils::foregroundDir(m_outFileNameGen.outDir()))
+                                               .absoluteFilePath(m_outFileNameGen.fileNameFor(page_info.id())));
+        out_file_params = OutputFileParams(QFileInfo(foreground_file_path));
       }
-    } while (false);
+      up_to_date = source_file_info.exists() && out_file_params.isValid()
+                   && (source_file_info.lastModified().toTime_t() <= out_file_params.modifiedTime());
+    }
+    up_to_date_col->process(up_to_date);
+  }
 
-    if (need_reprocess) {
+  if (auto* thumb_col = dynamic_cast<ThumbnailCollector*>(collector)) {
+    if (!isOutputUpToDate(page_info, params, new_xform, content_rect_phys)) {
       thumb_col->processThumbnail(std::unique_ptr<QGraphicsItem>(new IncompleteThumbnail(
           thumb_col->thumbnailCache(), thumb_col->maxLogicalThumbSize(), page_info.imageId(), new_xform)));
     } else {
@@ -146,4 +83,85 @@ void CacheDrivenTask::process(const PageInfo& page_info,
     }
   }
 }  // CacheDrivenTask::process
+
+bool CacheDrivenTask::isOutputUpToDate(const PageInfo& page_info,
+                                       const Params& params,
+                                       const ImageTransformation& new_xform,
+                                       const QPolygonF& content_rect_phys) const {
+  const QString out_file_path(
+      m_outFileNameGen.filePathFor(page_info.id(), Utils::outputFileFormat(params, m_jpegOptions)));
+  // The layers are always TIFF.
+  const QString tiff_file_name(m_outFileNameGen.fileNameFor(page_info.id()));
+  const QString foreground_dir(Utils::foregroundDir(m_outFileNameGen.outDir()));
+  const QString background_dir(Utils::backgroundDir(m_outFileNameGen.outDir()));
+  const QString original_background_dir(Utils::originalBackgroundDir(m_outFileNameGen.outDir()));
+  const QString foreground_file_path(QDir(foreground_dir).absoluteFilePath(tiff_file_name));
+  const QString background_file_path(QDir(background_dir).absoluteFilePath(tiff_file_name));
+  const QString original_background_file_path(QDir(original_background_dir).absoluteFilePath(tiff_file_name));
+  const QFileInfo foreground_file_info(foreground_file_path);
+  const QFileInfo background_file_info(background_file_path);
+  const QFileInfo original_background_file_info(original_background_file_path);
+
+  RenderParams render_params(params.colorParams(), params.splittingOptions());
+
+  std::unique_ptr<OutputParams> stored_output_params(m_settings->getOutputParams(page_info.id()));
+  if (!stored_output_params) {
+    return false;
+  }
+
+  const OutputGenerator generator(params.outputDpi(), params.colorParams(), params.splittingOptions(),
+                                  params.pictureShapeOptions(), params.dewarpingOptions(),
+                                  m_settings->getOutputProcessingParams(page_info.id()), params.despeckleLevel(),
+                                  new_xform, content_rect_phys);
+  const OutputImageParams new_output_image_params(
+      generator.outputImageSize(), generator.outputContentRect(), new_xform, params.outputDpi(), params.colorParams(),
+      params.splittingOptions(), params.dewarpingOptions(), params.distortionModel(), params.depthPerception(),
+      params.despeckleLevel(), params.pictureShapeOptions(), m_settings->getOutputProcessingParams(page_info.id()),
+      params.isBlackOnWhite());
+
+  if (!stored_output_params->outputImageParams().matches(new_output_image_params)) {
+    return false;
+  }
+
+  const ZoneSet new_picture_zones(m_settings->pictureZonesForPage(page_info.id()));
+  if (!PictureZoneComparator::equal(stored_output_params->pictureZones(), new_picture_zones)) {
+    return false;
+  }
+
+  const ZoneSet new_fill_zones(m_settings->fillZonesForPage(page_info.id()));
+  if (!FillZoneComparator::equal(stored_output_params->fillZones(), new_fill_zones)) {
+    return false;
+  }
+
+  if (!render_params.splitOutput()) {
+    const OutputFileParams out_file_params(Utils::outputFileParams(out_file_path));
+    if (!out_file_params.isValid()) {
+      return false;
+    }
+
+    if (!stored_output_params->outputFileParams().matches(out_file_params)) {
+      return false;
+    }
+  } else {
+    if (!foreground_file_info.exists() || !background_file_info.exists()) {
+      return false;
+    }
+    if (!(stored_output_params->foregroundFileParams().matches(OutputFileParams(foreground_file_info)))
+        || !(stored_output_params->backgroundFileParams().matches(OutputFileParams(background_file_info)))) {
+      return false;
+    }
+
+    if (render_params.originalBackground()) {
+      if (!original_background_file_info.exists()) {
+        return false;
+      }
+      if (!(stored_output_params->originalBackgroundFileParams().matches(
+              OutputFileParams(original_background_file_info)))) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}  // CacheDrivenTask::isOutputUpToDate
 }  // namespace output
\ No newline at end of file
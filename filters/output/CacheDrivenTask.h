@@ -19,6 +19,7 @@
 #ifndef OUTPUT_CACHEDRIVENTASK_H_
 #define OUTPUT_CACHEDRIVENTASK_H_
 
+#include "JpegOutputOptions.h"
 #include "NonCopyable.h"
 #include "OutputFileNameGenerator.h"
 #include "intrusive_ptr.h"
@@ -31,6 +32,7 @@ class ImageTransformation;
 
 namespace output {
 class Settings;
+class Params;
 
 class CacheDrivenTask : public ref_countable {
   DECLARE_NON_COPYABLE(CacheDrivenTask)
@@ -46,8 +48,20 @@ class CacheDrivenTask : public ref_countable {
                const QPolygonF& content_rect_phys);
 
  private:
+  /**
+   * \brief Checks whether the stored output of a page matches its current
+   *        parameters and whether the output files are intact.
+   *
+   * \param new_xform The transformation to output image coordinates.
+   */
+  bool isOutputUpToDate(const PageInfo& page_info,
+                        const Params& params,
+                        const ImageTransformation& new_xform,
+                        const QPolygonF& content_rect_phys) const;
+
   intrusive_ptr<Settings> m_settings;
   OutputFileNameGenerator m_outFileNameGen;
+  const JpegOutputOptions m_jpegOptions;
 };
 }  // namespace output
 #endif  // ifndef OUTPUT_CACHEDRIVENTASK_H_
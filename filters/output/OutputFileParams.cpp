@@ -31,6 +31,9 @@ OutputFileParams::OutputFileParams(const QFileInfo& file_info) : m_size(-1), m_m
   }
 }
 
+OutputFileParams::OutputFileParams(const qint64 size, const time_t modified_time)
+    : m_size(size), m_modifiedTime(modified_time) {}
+
 OutputFileParams::OutputFileParams(const QDomElement& el) : m_size(-1), m_modifiedTime(0) {
   if (el.hasAttribute("size")) {
     m_size = (qint64) el.attribute("size").toLongLong();
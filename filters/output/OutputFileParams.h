@@ -36,6 +36,8 @@ class OutputFileParams {
 
   explicit OutputFileParams(const QFileInfo& file_info);
 
+  OutputFileParams(qint64 size, time_t modified_time);
+
   explicit OutputFileParams(const QDomElement& el);
 
   QDomElement toXml(QDomDocument& doc, const QString& name) const;
@@ -47,6 +49,8 @@ class OutputFileParams {
    */
   bool matches(const OutputFileParams& other) const;
 
+  time_t modifiedTime() const { return m_modifiedTime; }
+
  private:
   qint64 m_size;
   time_t m_modifiedTime;
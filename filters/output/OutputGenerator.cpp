@@ -23,6 +23,7 @@
 #include <imageproc/ColorSegmenter.h>
 #include <imageproc/ColorTable.h>
 #include <imageproc/ImageCombination.h>
+#include <QDataStream>
 #include <QDebug>
 #include <QPainter>
 #include <QtCore/QSettings>
@@ -32,6 +33,7 @@
 #include "EstimateBackground.h"
 #include "FillColorProperty.h"
 #include "FilterData.h"
+#include "IntermediateImageCache.h"
 #include "RenderParams.h"
 #include "TaskStatus.h"
 #include "Utils.h"
@@ -290,7 +292,8 @@ OutputGenerator::OutputGenerator(const Dpi& dpi,
       m_xform(xform),
       m_outRect(xform.resultingRect().toRect()),
       m_contentRect(xform.transform().map(content_rect_phys).boundingRect().toRect()),
-      m_despeckleLevel(despeckle_level) {
+      m_despeckleLevel(despeckle_level),
+      m_intermediateCache(nullptr) {
   assert(m_outRect.topLeft() == QPoint(0, 0));
 
   if (!m_contentRect.isEmpty()) {
@@ -570,29 +573,45 @@ QImage OutputGenerator::processWithoutDewarping(const TaskStatus& status,
       = (render_params.normalizeIllumination() && render_params.needBinarization())
         || (render_params.normalizeIlluminationColor() && !render_params.needBinarization());
 
+  // Everything maybe_normalized depends on, apart from the input file itself.
+  QByteArray cache_params;
   QImage maybe_normalized;
-  if (needNormalizeIllumination) {
-    maybe_normalized = normalizeIlluminationGray(status, inputGrayImage, preCropAreaInOriginalCs, m_xform.transform(),
-                                                 workingBoundingRect, nullptr, dbg);
-  } else {
-    if (inputOrigImage.allGray()) {
-      maybe_normalized = transformToGray(inputGrayImage, m_xform.transform(), workingBoundingRect,
-                                         OutsidePixels::assumeColor(outsideBackgroundColor));
+  if (m_intermediateCache) {
+    QDataStream strm(&cache_params, QIODevice::WriteOnly);
+    strm << QString("maybe_normalized/1") << input.origImage().size() << qint32(m_dpi.horizontal())
+         << qint32(m_dpi.vertical()) << isBlackOnWhite << needNormalizeIllumination << m_xform.transform()
+         << workingBoundingRect << preCropAreaInOriginalCs << outsideBackgroundColor;
+    maybe_normalized = m_intermediateCache->load(pageId.imageId(), cache_params);
+  }
+
+  if (maybe_normalized.isNull()) {
+    if (needNormalizeIllumination) {
+      maybe_normalized = normalizeIlluminationGray(status, inputGrayImage, preCropAreaInOriginalCs,
+                                                   m_xform.transform(), workingBoundingRect, nullptr, dbg);
     } else {
-      maybe_normalized = transform(inputOrigImage, m_xform.transform(), workingBoundingRect,
-                                   OutsidePixels::assumeColor(outsideBackgroundColor));
+      if (inputOrigImage.allGray()) {
+        maybe_normalized = transformToGray(inputGrayImage, m_xform.transform(), workingBoundingRect,
+                                           OutsidePixels::assumeColor(outsideBackgroundColor));
+      } else {
+        maybe_normalized = transform(inputOrigImage, m_xform.transform(), workingBoundingRect,
+                                     OutsidePixels::assumeColor(outsideBackgroundColor));
+      }
     }
-  }
 
-  if (needNormalizeIllumination && !inputOrigImage.allGray()) {
-    assert(maybe_normalized.format() == QImage::Format_Indexed8);
-    QImage tmp(transform(inputOrigImage, m_xform.transform(), workingBoundingRect,
-                         OutsidePixels::assumeColor(outsideBackgroundColor)));
+    if (needNormalizeIllumination && !inputOrigImage.allGray()) {
+      assert(maybe_normalized.format() == QImage::Format_Indexed8);
+      QImage tmp(transform(inputOrigImage, m_xform.transform(), workingBoundingRect,
+                           OutsidePixels::assumeColor(outsideBackgroundColor)));
 
-    status.throwIfCancelled();
+      status.throwIfCancelled();
+
+      adjustBrightnessGrayscale(tmp, maybe_normalized);
+      maybe_normalized = tmp;
+    }
 
-    adjustBrightnessGrayscale(tmp, maybe_normalized);
-    maybe_normalized = tmp;
+    if (m_intermediateCache) {
+      m_intermediateCache->store(pageId.imageId(), cache_params, maybe_normalized);
+    }
   }
 
   if (dbg) {
@@ -2606,6 +2625,10 @@ const QTransform& OutputGenerator::getPostTransform() const {
   return m_postTransform;
 }
 
+void OutputGenerator::setIntermediateCache(const IntermediateImageCache* cache) {
+  m_intermediateCache = cache;
+}
+
 void OutputGenerator::applyFillZonesToMixedInPlace(QImage& img,
                                                    const ZoneSet& zones,
                                                    const BinaryImage& picture_mask,
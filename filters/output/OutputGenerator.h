@@ -53,6 +53,7 @@ class TaskStatus;
 class DebugImages;
 class FilterData;
 class ZoneSet;
+class IntermediateImageCache;
 class QSize;
 class QImage;
 
@@ -129,6 +130,14 @@ class OutputGenerator {
 
   const QTransform& getPostTransform() const;
 
+  /**
+   * \brief Lets process() reuse the transformed and illumination-normalized
+   *        input from a previous run instead of computing it again.
+   *
+   * The cache must outlive process().  Passing null disables caching.
+   */
+  void setIntermediateCache(const IntermediateImageCache* cache);
+
  private:
   QImage processImpl(const TaskStatus& status,
                      const FilterData& input,
@@ -343,6 +352,8 @@ class OutputGenerator {
 
   /** Store additional transformations after processing such as post deskew after dewarping.*/
   QTransform m_postTransform;
+
+  const IntermediateImageCache* m_intermediateCache;
 };
 }  // namespace output
 #endif  // ifndef OUTPUT_OUTPUTGENERATOR_H_
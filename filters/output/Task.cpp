@@ -18,6 +18,7 @@
 
 #include "Task.h"
 #include <UnitsProvider.h>
+#include <QBuffer>
 #include <QDir>
 #include <boost/bind.hpp>
 #include <utility>
@@ -35,8 +36,13 @@
 #include "FilterData.h"
 #include "FilterUiInterface.h"
 #include "ImageLoader.h"
+#include "ImageMetadata.h"
 #include "ImageView.h"
+#include "IntermediateImageCache.h"
+#include "JpegOutputOptions.h"
+#include "JpegWriter.h"
 #include "OptionsWidget.h"
+#include "OutputContainer.h"
 #include "OutputGenerator.h"
 #include "PictureZoneComparator.h"
 #include "PictureZoneEditor.h"
@@ -110,6 +116,8 @@ Task::Task(intrusive_ptr<Filter> filter,
       m_thumbnailCache(std::move(thumbnail_cache)),
       m_pageId(page_id),
       m_outFileNameGen(out_file_name_gen),
+      m_jpegOptions(JpegOutputOptions::current()),
+      m_tiffOptions(Utils::tiffCodecOptions()),
       m_lastTab(last_tab),
       m_batchProcessing(batch),
       m_debug(debug) {
@@ -120,14 +128,49 @@ Task::Task(intrusive_ptr<Filter> filter,
 
 Task::~Task() = default;
 
+qint64 Task::estimateMemoryFootprint(const ImageMetadata& input_metadata) const {
+  const Params params(m_settings->getParams(m_pageId));
+  const Dpi& input_dpi = input_metadata.dpi();
+  const Dpi& output_dpi = params.outputDpi();
+
+  double scale = 1.0;
+  if (!input_dpi.isNull() && !output_dpi.isNull()) {
+    scale = (double(output_dpi.horizontal()) / input_dpi.horizontal())
+            * (double(output_dpi.vertical()) / input_dpi.vertical());
+  }
+  const double output_pixels = scale * input_metadata.size().width() * input_metadata.size().height();
+
+  // Rough numbers of bytes per output pixel OutputGenerator keeps around at its peak.
+  double bytes_per_pixel;
+  switch (params.colorParams().colorMode()) {
+    case BLACK_AND_WHITE:
+      bytes_per_pixel = 4;
+      break;
+    case COLOR_GRAYSCALE:
+      bytes_per_pixel = 12;
+      break;
+    case MIXED:
+    default:
+      bytes_per_pixel = 16;
+      break;
+  }
+  if (params.dewarpingOptions().dewarpingMode() != OFF) {
+    bytes_per_pixel *= 1.5;
+  }
+
+  return static_cast<qint64>(output_pixels * bytes_per_pixel);
+}
+
 FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data, const QPolygonF& content_rect_phys) {
   status.throwIfCancelled();
 
   Params params(m_settings->getParams(m_pageId));
 
   RenderParams render_params(params.colorParams(), params.splittingOptions());
-  const QString out_file_path(m_outFileNameGen.filePathFor(m_pageId));
-  const QFileInfo out_file_info(out_file_path);
+  const OutputFileNameGenerator::FileFormat out_file_format = Utils::outputFileFormat(params, m_jpegOptions);
+  const QString out_file_path(m_outFileNameGen.filePathFor(m_pageId, out_file_format));
+  // The layers and the cached masks are always TIFF.
+  const QString tiff_file_name(m_outFileNameGen.fileNameFor(m_pageId));
 
   ImageTransformation new_xform(data.xform());
   new_xform.postScaleToDpi(params.outputDpi());
@@ -135,19 +178,19 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
   const QString foreground_dir(Utils::foregroundDir(m_outFileNameGen.outDir()));
   const QString background_dir(Utils::backgroundDir(m_outFileNameGen.outDir()));
   const QString original_background_dir(Utils::originalBackgroundDir(m_outFileNameGen.outDir()));
-  const QString foreground_file_path(QDir(foreground_dir).absoluteFilePath(out_file_info.fileName()));
-  const QString background_file_path(QDir(background_dir).absoluteFilePath(out_file_info.fileName()));
-  const QString original_background_file_path(QDir(original_background_dir).absoluteFilePath(out_file_info.fileName()));
+  const QString foreground_file_path(QDir(foreground_dir).absoluteFilePath(tiff_file_name));
+  const QString background_file_path(QDir(background_dir).absoluteFilePath(tiff_file_name));
+  const QString original_background_file_path(QDir(original_background_dir).absoluteFilePath(tiff_file_name));
   const QFileInfo foreground_file_info(foreground_file_path);
   const QFileInfo background_file_info(background_file_path);
   const QFileInfo original_background_file_info(original_background_file_path);
 
   const QString automask_dir(Utils::automaskDir(m_outFileNameGen.outDir()));
-  const QString automask_file_path(QDir(automask_dir).absoluteFilePath(out_file_info.fileName()));
+  const QString automask_file_path(QDir(automask_dir).absoluteFilePath(tiff_file_name));
   QFileInfo automask_file_info(automask_file_path);
 
   const QString speckles_dir(Utils::specklesDir(m_outFileNameGen.outDir()));
-  const QString speckles_file_path(QDir(speckles_dir).absoluteFilePath(out_file_info.fileName()));
+  const QString speckles_file_path(QDir(speckles_dir).absoluteFilePath(tiff_file_name));
   QFileInfo speckles_file_info(speckles_file_path);
 
   const bool need_picture_editor = render_params.mixedOutput() && !m_batchProcessing;
@@ -171,6 +214,13 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
                             m_settings->getOutputProcessingParams(m_pageId), params.despeckleLevel(), new_xform,
                             content_rect_phys);
 
+  std::unique_ptr<IntermediateImageCache> intermediate_cache;
+  if (IntermediateImageCache::isEnabled()) {
+    intermediate_cache
+        = std::make_unique<IntermediateImageCache>(Utils::outputDirToIntermediateDir(m_outFileNameGen.outDir()));
+    generator.setIntermediateCache(intermediate_cache.get());
+  }
+
   OutputImageParams new_output_image_params(
       generator.outputImageSize(), generator.outputContentRect(), new_xform, params.outputDpi(), params.colorParams(),
       params.splittingOptions(), params.dewarpingOptions(), params.distortionModel(), params.depthPerception(),
@@ -205,12 +255,13 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
     }
 
     if (!render_params.splitOutput()) {
-      if (!out_file_info.exists()) {
+      const OutputFileParams out_file_params(Utils::outputFileParams(out_file_path));
+      if (!out_file_params.isValid()) {
         need_reprocess = true;
         break;
       }
 
-      if (!stored_output_params->outputFileParams().matches(OutputFileParams(out_file_info))) {
+      if (!stored_output_params->outputFileParams().matches(out_file_params)) {
         need_reprocess = true;
         break;
       }
@@ -267,10 +318,7 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
   BinaryImage speckles_img;
 
   if (!need_reprocess) {
-    QFile out_file(out_file_path);
-    if (out_file.open(QIODevice::ReadOnly)) {
-      out_img = ImageLoader::load(out_file, 0);
-    }
+    out_img = Utils::loadOutputImage(out_file_path);
     if (out_img.isNull() && render_params.splitOutput()) {
       QImage foreground_image;
       QImage background_image;
@@ -362,15 +410,16 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
       QDir().mkdir(foreground_dir);
       QDir().mkdir(background_dir);
 
-      if (!TiffWriter::writeImage(foreground_file_path, splitImage.getForegroundImage())
-          || !TiffWriter::writeImage(background_file_path, splitImage.getBackgroundImage())) {
+      if (!TiffWriter::writeImage(foreground_file_path, splitImage.getForegroundImage(), m_tiffOptions)
+          || !TiffWriter::writeImage(background_file_path, splitImage.getBackgroundImage(), m_tiffOptions)) {
         invalidate_params = true;
       }
 
       if (render_params.originalBackground()) {
         QDir().mkdir(original_background_dir);
 
-        if (!TiffWriter::writeImage(original_background_file_path, splitImage.getOriginalBackgroundImage())) {
+        if (!TiffWriter::writeImage(original_background_file_path, splitImage.getOriginalBackgroundImage(),
+                                    m_tiffOptions)) {
           invalidate_params = true;
         }
       }
@@ -383,10 +432,10 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
       QFile(background_file_path).remove();
       QFile(original_background_file_path).remove();
     }
-    if (!TiffWriter::writeImage(out_file_path, out_img)) {
+    if (!writeOutputImage(out_file_path, out_file_format, out_img)) {
       invalidate_params = true;
     } else {
-      deleteMutuallyExclusiveOutputFiles();
+      deleteMutuallyExclusiveOutputFiles(out_file_format);
     }
 
     if (write_speckles_file && speckles_img.isNull()) {
@@ -404,14 +453,14 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
       QDir().mkdir(automask_dir);
       // Also note that QDir::mkdir() will fail if the directory already exists,
       // so we ignore its return value here.
-      if (!TiffWriter::writeImage(automask_file_path, automask_img.toQImage())) {
+      if (!TiffWriter::writeImage(automask_file_path, automask_img.toQImage(), m_tiffOptions)) {
         invalidate_params = true;
       }
     }
     if (write_speckles_file) {
       if (!QDir().mkpath(speckles_dir)) {
         invalidate_params = true;
-      } else if (!TiffWriter::writeImage(speckles_file_path, speckles_img.toQImage())) {
+      } else if (!TiffWriter::writeImage(speckles_file_path, speckles_img.toQImage(), m_tiffOptions)) {
         invalidate_params = true;
       }
     }
@@ -422,7 +471,7 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
       // Note that we can't reuse *_file_info objects
       // as we've just overwritten those files.
       const OutputParams out_params(
-          new_output_image_params, OutputFileParams(QFileInfo(out_file_path)),
+          new_output_image_params, Utils::outputFileParams(out_file_path),
           render_params.splitOutput() ? OutputFileParams(QFileInfo(foreground_file_path)) : OutputFileParams(),
           render_params.splitOutput() ? OutputFileParams(QFileInfo(background_file_path)) : OutputFileParams(),
           render_params.originalBackground() ? OutputFileParams(QFileInfo(original_background_file_path))
@@ -457,19 +506,59 @@ FilterResultPtr Task::process(const TaskStatus& status, const FilterData& data,
   }
 }  // Task::process
 
+bool Task::writeOutputImage(const QString& file_path,
+                            const OutputFileNameGenerator::FileFormat format,
+                            const QImage& image) const {
+  const JpegOutputOptions& jpeg_options = m_jpegOptions;
+  if (!Utils::isOutputContainerEnabled()) {
+    if (format == OutputFileNameGenerator::JPEG_FORMAT) {
+      return JpegWriter::writeImage(file_path, image, jpeg_options.quality(), jpeg_options.subsampling());
+    }
+
+    return TiffWriter::writeImage(file_path, image, m_tiffOptions);
+  }
+
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  const bool encoded = (format == OutputFileNameGenerator::JPEG_FORMAT)
+                           ? JpegWriter::writeImage(buffer, image, jpeg_options.quality(), jpeg_options.subsampling())
+                           : TiffWriter::writeImage(buffer, image, m_tiffOptions);
+  if (!encoded) {
+    return false;
+  }
+
+  const QFileInfo file_info(file_path);
+  if (!OutputContainer::forDir(file_info.absolutePath())->write(file_info.fileName(), buffer.data())) {
+    return false;
+  }
+  // A file left from before the container was enabled would shadow the page.
+  QFile::remove(file_path);
+
+  return true;
+}
+
 /**
- * Delete output files mutually exclusive to m_pageId.
+ * Delete output files mutually exclusive to m_pageId,
+ * including the ones in the format it's no longer written in.
  */
-void Task::deleteMutuallyExclusiveOutputFiles() {
-  switch (m_pageId.subPage()) {
-    case PageId::SINGLE_PAGE:
-      QFile::remove(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::LEFT_PAGE)));
-      QFile::remove(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::RIGHT_PAGE)));
-      break;
-    case PageId::LEFT_PAGE:
-    case PageId::RIGHT_PAGE:
-      QFile::remove(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::SINGLE_PAGE)));
-      break;
+void Task::deleteMutuallyExclusiveOutputFiles(const OutputFileNameGenerator::FileFormat format) {
+  const OutputFileNameGenerator::FileFormat other_format = (format == OutputFileNameGenerator::TIFF_FORMAT)
+                                                               ? OutputFileNameGenerator::JPEG_FORMAT
+                                                               : OutputFileNameGenerator::TIFF_FORMAT;
+  OutputContainer::removeFile(m_outFileNameGen.filePathFor(m_pageId, other_format));
+
+  for (const OutputFileNameGenerator::FileFormat f :
+       {OutputFileNameGenerator::TIFF_FORMAT, OutputFileNameGenerator::JPEG_FORMAT}) {
+    switch (m_pageId.subPage()) {
+      case PageId::SINGLE_PAGE:
+        OutputContainer::removeFile(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::LEFT_PAGE), f));
+        OutputContainer::removeFile(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::RIGHT_PAGE), f));
+        break;
+      case PageId::LEFT_PAGE:
+      case PageId::RIGHT_PAGE:
+        OutputContainer::removeFile(m_outFileNameGen.filePathFor(PageId(m_pageId.imageId(), PageId::SINGLE_PAGE), f));
+        break;
+    }
   }
 }
 
@@ -24,9 +24,11 @@
 #include <memory>
 #include "FilterResult.h"
 #include "ImageViewTab.h"
+#include "JpegOutputOptions.h"
 #include "NonCopyable.h"
 #include "OutputFileNameGenerator.h"
 #include "PageId.h"
+#include "TiffCodecOptions.h"
 #include "ref_countable.h"
 
 class DebugImages;
@@ -38,6 +40,7 @@ class QPolygonF;
 class QSize;
 class QImage;
 class Dpi;
+class ImageMetadata;
 
 namespace imageproc {
 class BinaryImage;
@@ -64,10 +67,20 @@ class Task : public ref_countable {
 
   FilterResultPtr process(const TaskStatus& status, const FilterData& data, const QPolygonF& content_rect_phys);
 
+  /**
+   * \brief Estimates the peak memory usage of rendering the output for
+   *        an input image of the given size and DPI.
+   */
+  qint64 estimateMemoryFootprint(const ImageMetadata& input_metadata) const;
+
  private:
   class UiUpdater;
 
-  void deleteMutuallyExclusiveOutputFiles();
+  bool writeOutputImage(const QString& file_path,
+                        OutputFileNameGenerator::FileFormat format,
+                        const QImage& image) const;
+
+  void deleteMutuallyExclusiveOutputFiles(OutputFileNameGenerator::FileFormat format);
 
   intrusive_ptr<Filter> m_filter;
   intrusive_ptr<Settings> m_settings;
@@ -75,6 +88,8 @@ class Task : public ref_countable {
   std::unique_ptr<DebugImages> m_dbg;
   PageId m_pageId;
   OutputFileNameGenerator m_outFileNameGen;
+  const JpegOutputOptions m_jpegOptions;
+  const TiffCodecOptions m_tiffOptions;
   ImageViewTab m_lastTab;
   bool m_batchProcessing;
   bool m_debug;
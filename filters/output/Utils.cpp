@@ -17,10 +17,21 @@
  */
 
 #include "Utils.h"
+#include <QBuffer>
 #include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QSettings>
 #include <QString>
 #include <QTransform>
+#include "CommandLine.h"
 #include "Dpi.h"
+#include "ImageLoader.h"
+#include "JpegOutputOptions.h"
+#include "OutputContainer.h"
+#include "OutputFileParams.h"
+#include "Params.h"
+#include "RenderParams.h"
 
 namespace output {
 QString Utils::automaskDir(const QString& out_dir) {
@@ -53,4 +64,65 @@ QString Utils::backgroundDir(const QString& out_dir) {
 QString Utils::originalBackgroundDir(const QString& out_dir) {
   return QDir(out_dir).absoluteFilePath("original_background");
 }
-}  // namespace output
\ No newline at end of file
+
+OutputFileNameGenerator::FileFormat Utils::outputFileFormat(const Params& params,
+                                                            const JpegOutputOptions& jpeg_options) {
+  if (!jpeg_options.isEnabled()) {
+    return OutputFileNameGenerator::TIFF_FORMAT;
+  }
+
+  const RenderParams render_params(params.colorParams(), params.splittingOptions());
+  if ((params.colorParams().colorMode() == BLACK_AND_WHITE) || render_params.splitOutput()) {
+    return OutputFileNameGenerator::TIFF_FORMAT;
+  }
+
+  return OutputFileNameGenerator::JPEG_FORMAT;
+}
+
+bool Utils::isOutputContainerEnabled() {
+  const CommandLine& cli = CommandLine::get();
+  if (!cli.isGui()) {
+    return cli.hasOutputContainer();
+  }
+
+  return QSettings().value("settings/output_container", false).toBool();
+}
+
+TiffCodecOptions Utils::tiffCodecOptions() {
+  const CommandLine& cli = CommandLine::get();
+  if (cli.hasTiffCodecOptions()) {
+    return cli.getTiffCodecOptions();
+  }
+
+  return TiffCodecOptions::fromSettings();
+}
+
+OutputFileParams Utils::outputFileParams(const QString& file_path) {
+  if (!isOutputContainerEnabled()) {
+    return OutputFileParams(QFileInfo(file_path));
+  }
+
+  const QFileInfo file_info(file_path);
+  const OutputContainer::Entry entry(OutputContainer::forDir(file_info.absolutePath())->entry(file_info.fileName()));
+  if (!entry.exists()) {
+    return OutputFileParams();
+  }
+
+  return OutputFileParams(entry.size, time_t(entry.modifiedTime));
+}
+
+QImage Utils::loadOutputImage(const QString& file_path) {
+  if (!isOutputContainerEnabled()) {
+    return ImageLoader::load(file_path, 0);
+  }
+
+  QByteArray data(OutputContainer::readFile(file_path));
+  if (data.isNull()) {
+    return QImage();
+  }
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+
+  return ImageLoader::load(buffer, 0);
+}
+}  // namespace output
@@ -19,11 +19,19 @@
 #ifndef OUTPUT_UTILS_H_
 #define OUTPUT_UTILS_H_
 
+#include "OutputFileNameGenerator.h"
+#include "TiffCodecOptions.h"
+
 class Dpi;
+class JpegOutputOptions;
+class QImage;
 class QString;
 class QTransform;
 
 namespace output {
+class OutputFileParams;
+class Params;
+
 class Utils {
  public:
   static QString automaskDir(const QString& out_dir);
@@ -39,6 +47,43 @@ class Utils {
   static QString originalBackgroundDir(const QString& out_dir);
 
   static QTransform scaleFromToDpi(const Dpi& from, const Dpi& to);
+
+  /**
+   * \return The format of the output file of a page with \p params.
+   *         That's JPEG for pages neither black and white nor split
+   *         into layers, if JPEG output is enabled, and TIFF otherwise.
+   *
+   * \param jpeg_options Normally JpegOutputOptions::current(), which
+   *        callers are to obtain once rather than per page.
+   */
+  static OutputFileNameGenerator::FileFormat outputFileFormat(const Params& params,
+                                                              const JpegOutputOptions& jpeg_options);
+
+  /**
+   * \brief Whether output pages are to be written into OutputContainer.
+   *
+   * In the command line mode, that's whether --output-container is given.
+   * Otherwise, that's settings/output_container.
+   */
+  static bool isOutputContainerEnabled();
+
+  /**
+   * \return The TIFF codec options given on the command line, if any,
+   *         or the ones from the settings otherwise.
+   */
+  static TiffCodecOptions tiffCodecOptions();
+
+  /**
+   * \return The parameters of the output file, which is looked up
+   *         in the output container if that one is enabled.
+   */
+  static OutputFileParams outputFileParams(const QString& file_path);
+
+  /**
+   * \return The output image, which is read from the output container
+   *         if that one is enabled, or a null image on failure.
+   */
+  static QImage loadOutputImage(const QString& file_path);
 };
 }  // namespace output
 #endif
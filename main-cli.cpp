@@ -18,10 +18,14 @@
  */
 
 #include <QCoreApplication>
+#include <QDir>
+#include <QFile>
 #include <iostream>
 
 #include "CommandLine.h"
 #include "ConsoleBatch.h"
+#include "OutputContainer.h"
+#include "TiffCodecBenchmark.h"
 
 
 int main(int argc, char** argv) {
@@ -42,21 +46,86 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (cli.isMergeProjects()) {
+    if (!cli.hasOutputProject() || cli.projectFiles().isEmpty()) {
+      cli.printHelp();
+
+      return 1;
+    }
+
+    try {
+      ConsoleBatch::mergeProjects(cli.projectFiles(), cli.outputProjectFile());
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+
+    return 0;
+  }
+
+  if (cli.isBenchmarkTiffCodecs()) {
+    // Without images given, the pages in the output directory make the samples.
+    QStringList file_paths;
+    for (const ImageFileInfo& image : cli.images()) {
+      file_paths.push_back(image.fileInfo().absoluteFilePath());
+    }
+    if (file_paths.isEmpty() && !cli.outputDirectory().isEmpty()) {
+      const QDir dir(cli.outputDirectory());
+      for (const QString& file_name : dir.entryList(QDir::Files, QDir::Name)) {
+        file_paths.push_back(dir.filePath(file_name));
+      }
+    }
+    TiffCodecBenchmark::run(file_paths, std::cout);
+
+    return 0;
+  }
+
+  if (cli.isExtractOutputContainer()) {
+    if (cli.outputDirectory().isEmpty()) {
+      cli.printHelp();
+
+      return 1;
+    }
+
+    const QDir out_dir(cli.outputDirectory());
+    const QString container_path(out_dir.absoluteFilePath(QString::fromLatin1(OutputContainer::FILE_NAME)));
+    if (!QFile::exists(container_path) || !OutputContainer(container_path).extractTo(out_dir.absolutePath())) {
+      std::cerr << "Unable to extract the output container." << std::endl;
+
+      return 1;
+    }
+
+    return 0;
+  }
+
   if (cli.hasHelp() || cli.outputDirectory().isEmpty() || ((cli.images().size() == 0) && cli.projectFile().isEmpty())) {
     cli.printHelp();
 
     return 0;
   }
 
+  // Checkpoints are written to, and resumed from, the output project.
+  if ((cli.hasCheckpointEvery() || cli.isResume()) && !cli.hasOutputProject()) {
+    cli.printHelp();
+
+    return 1;
+  }
+
   std::unique_ptr<ConsoleBatch> cbatch;
 
   try {
-    if (!cli.projectFile().isEmpty()) {
+    if (cli.isResume() && QFile::exists(cli.outputProjectFile())) {
+      // Pages whose output is up to date will be skipped.
+      cbatch = std::make_unique<ConsoleBatch>(cli.outputProjectFile());
+    } else if (!cli.projectFile().isEmpty()) {
       cbatch = std::make_unique<ConsoleBatch>(cli.projectFile());
     } else {
       cbatch = std::make_unique<ConsoleBatch>(cli.images(), cli.outputDirectory(), cli.getLayoutDirection());
     }
     cbatch->process();
+    if (cli.hasPdf()) {
+      cbatch->exportPdf(cli.pdfFile());
+    }
   } catch (const std::exception& e) {
     std::cerr << e.what() << std::endl;
     exit(1);
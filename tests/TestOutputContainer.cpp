@@ -0,0 +1,185 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+#include <QTemporaryDir>
+#include <boost/test/auto_unit_test.hpp>
+#include "OutputContainer.h"
+
+namespace Tests {
+BOOST_AUTO_TEST_SUITE(OutputContainerTestSuite);
+
+namespace {
+const QString PAGE_A(QLatin1String("page_a.tif"));
+const QString PAGE_B(QLatin1String("page_b.jpg"));
+const QString PAGE_C(QLatin1String("page_c.tif"));
+
+QString containerPath(const QTemporaryDir& dir) {
+  return dir.path() + QLatin1Char('/') + QLatin1String(OutputContainer::FILE_NAME);
+}
+
+QByteArray pageData(const char fill, const int size) {
+  return QByteArray(size, fill);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_append) {
+  const QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString file_path(containerPath(dir));
+
+  {
+    OutputContainer container(file_path);
+    BOOST_CHECK(!container.entry(PAGE_A).exists());
+    BOOST_CHECK(container.read(PAGE_A).isNull());
+
+    BOOST_REQUIRE(container.write(PAGE_A, pageData('a', 100)));
+    BOOST_REQUIRE(container.write(PAGE_B, pageData('b', 200)));
+    // Supersedes the first record.
+    BOOST_REQUIRE(container.write(PAGE_A, pageData('A', 150)));
+
+    BOOST_CHECK_EQUAL(container.entry(PAGE_A).size, 150);
+    BOOST_CHECK(container.read(PAGE_A) == pageData('A', 150));
+    BOOST_CHECK(container.read(PAGE_B) == pageData('b', 200));
+  }
+
+  // The index is rebuilt from the record headers.
+  OutputContainer reopened(file_path);
+  BOOST_CHECK_EQUAL(reopened.entry(PAGE_A).size, 150);
+  BOOST_CHECK(reopened.read(PAGE_A) == pageData('A', 150));
+  BOOST_CHECK(reopened.read(PAGE_B) == pageData('b', 200));
+}
+
+BOOST_AUTO_TEST_CASE(test_tombstone) {
+  const QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString file_path(containerPath(dir));
+
+  {
+    OutputContainer container(file_path);
+    BOOST_REQUIRE(container.write(PAGE_A, pageData('a', 100)));
+    BOOST_REQUIRE(container.write(PAGE_B, pageData('b', 200)));
+    container.remove(PAGE_A);
+
+    BOOST_CHECK(!container.entry(PAGE_A).exists());
+    BOOST_CHECK(container.read(PAGE_A).isNull());
+    BOOST_CHECK(container.read(PAGE_B) == pageData('b', 200));
+  }
+
+  OutputContainer reopened(file_path);
+  BOOST_CHECK(!reopened.entry(PAGE_A).exists());
+  BOOST_CHECK(reopened.read(PAGE_B) == pageData('b', 200));
+
+  // A removed page may be written again.
+  BOOST_REQUIRE(reopened.write(PAGE_A, pageData('A', 50)));
+  BOOST_CHECK(reopened.read(PAGE_A) == pageData('A', 50));
+}
+
+BOOST_AUTO_TEST_CASE(test_truncated_tail_recovery) {
+  // Cut into the data of the last record, and into its header.
+  for (const int cut : {1, 100, 210}) {
+    const QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    const QString file_path(containerPath(dir));
+
+    {
+      OutputContainer container(file_path);
+      BOOST_REQUIRE(container.write(PAGE_A, pageData('a', 100)));
+      BOOST_REQUIRE(container.write(PAGE_B, pageData('b', 200)));
+    }
+
+    // As if we crashed while appending the last record.
+    {
+      QFile file(file_path);
+      BOOST_REQUIRE(file.resize(file.size() - cut));
+    }
+
+    {
+      OutputContainer container(file_path);
+      BOOST_CHECK(container.read(PAGE_A) == pageData('a', 100));
+      BOOST_CHECK(!container.entry(PAGE_B).exists());
+
+      // The partial record is dropped, so new ones can follow.
+      BOOST_REQUIRE(container.write(PAGE_C, pageData('c', 300)));
+    }
+
+    OutputContainer reopened(file_path);
+    BOOST_CHECK(reopened.read(PAGE_A) == pageData('a', 100));
+    BOOST_CHECK(!reopened.entry(PAGE_B).exists());
+    BOOST_CHECK(reopened.read(PAGE_C) == pageData('c', 300));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_compaction) {
+  const QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString file_path(containerPath(dir));
+
+  OutputContainer container(file_path);
+  BOOST_REQUIRE(container.write(PAGE_A, pageData('1', 1000)));
+  BOOST_REQUIRE(container.write(PAGE_A, pageData('2', 1000)));
+  BOOST_REQUIRE(container.write(PAGE_A, pageData('3', 1000)));
+  BOOST_REQUIRE(container.write(PAGE_B, pageData('b', 1000)));
+  container.remove(PAGE_B);
+
+  // Far too little to be worth compacting.
+  const qint64 size_before = QFileInfo(file_path).size();
+  container.compactIfWorthIt();
+  BOOST_CHECK_EQUAL(QFileInfo(file_path).size(), size_before);
+
+  BOOST_REQUIRE(container.compact());
+  const qint64 size_after = QFileInfo(file_path).size();
+  BOOST_CHECK(size_after < size_before);
+  BOOST_CHECK(size_after > 1000);
+  BOOST_CHECK(size_after < 2000);
+  BOOST_CHECK(container.read(PAGE_A) == pageData('3', 1000));
+  BOOST_CHECK(!container.entry(PAGE_B).exists());
+
+  // Still usable, both as it is and once reopened.
+  BOOST_REQUIRE(container.write(PAGE_C, pageData('c', 10)));
+  BOOST_CHECK(container.read(PAGE_C) == pageData('c', 10));
+
+  OutputContainer reopened(file_path);
+  BOOST_CHECK(reopened.read(PAGE_A) == pageData('3', 1000));
+  BOOST_CHECK(!reopened.entry(PAGE_B).exists());
+  BOOST_CHECK(reopened.read(PAGE_C) == pageData('c', 10));
+}
+
+BOOST_AUTO_TEST_CASE(test_extraction) {
+  const QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+
+  OutputContainer container(containerPath(dir));
+  BOOST_REQUIRE(container.write(PAGE_A, pageData('a', 100)));
+  BOOST_REQUIRE(container.write(PAGE_B, pageData('b', 200)));
+  BOOST_REQUIRE(container.write(PAGE_A, pageData('A', 150)));
+  container.remove(PAGE_B);
+
+  BOOST_REQUIRE(container.extractTo(dir.path()));
+
+  QFile page_a(dir.path() + QLatin1Char('/') + PAGE_A);
+  BOOST_REQUIRE(page_a.open(QIODevice::ReadOnly));
+  BOOST_CHECK(page_a.readAll() == pageData('A', 150));
+  BOOST_CHECK(!QFile::exists(dir.path() + QLatin1Char('/') + PAGE_B));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+}  // namespace Tests
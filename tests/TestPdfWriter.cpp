@@ -0,0 +1,231 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tiff.h>
+#include <tiffio.h>
+#include <QBuffer>
+#include <QFile>
+#include <QImage>
+#include <QTemporaryDir>
+#include <boost/test/auto_unit_test.hpp>
+#include <vector>
+#include "PdfWriter.h"
+#include "TiffCodecOptions.h"
+#include "TiffWriter.h"
+
+namespace Tests {
+BOOST_AUTO_TEST_SUITE(PdfWriterTestSuite);
+
+namespace {
+QByteArray toPng(const QImage& image) {
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  image.save(&buffer, "PNG");
+
+  return buffer.data();
+}
+
+QImage grayImage(const int width, const int height) {
+  QImage image(width, height, QImage::Format_Grayscale8);
+  for (int y = 0; y < height; ++y) {
+    uchar* line = image.scanLine(y);
+    for (int x = 0; x < width; ++x) {
+      line[x] = static_cast<uchar>(x * 7 + y * 13);
+    }
+  }
+
+  return image;
+}
+
+QImage monoImage(const int width, const int height) {
+  QImage image(width, height, QImage::Format_Mono);
+  image.setColor(0, qRgb(255, 255, 255));
+  image.setColor(1, qRgb(0, 0, 0));
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      image.setPixel(x, y, ((x / 8 + y / 8) % 2 == 0) ? 1 : 0);
+    }
+  }
+
+  return image;
+}
+
+/**
+ * \brief Writes an LZW compressed grayscale image split into several strips.
+ */
+QByteArray stripedTiff(const QString& file_path, const int width, const int height) {
+  TIFF* tif = TIFFOpen(QFile::encodeName(file_path).constData(), "w");
+  if (!tif) {
+    return QByteArray();
+  }
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, uint32(width));
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, uint32(height));
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, uint16(1));
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, uint16(8));
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, uint16(PLANARCONFIG_CONTIG));
+  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, uint16(PHOTOMETRIC_MINISBLACK));
+  TIFFSetField(tif, TIFFTAG_COMPRESSION, uint16(COMPRESSION_LZW));
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, uint32(16));
+
+  const QImage image(grayImage(width, height));
+  bool ok = true;
+  for (int y = 0; y < height; ++y) {
+    ok = ok && (TIFFWriteScanline(tif, const_cast<uchar*>(image.constScanLine(y)), uint32(y), 0) >= 0);
+  }
+  TIFFClose(tif);
+
+  QFile file(file_path);
+  if (!ok || !file.open(QIODevice::ReadOnly)) {
+    return QByteArray();
+  }
+
+  return file.readAll();
+}
+
+/**
+ * \brief Writes a bi-level image through TiffWriter, the way the output filter does.
+ */
+QByteArray g4Tiff(const QImage& image) {
+  TiffCodecOptions options;
+  options.setBwCompression(COMPRESSION_CCITTFAX4);
+
+  QBuffer buffer;
+  buffer.open(QIODevice::ReadWrite);
+  if (!TiffWriter::writeImage(buffer, image, options)) {
+    return QByteArray();
+  }
+
+  return buffer.data();
+}
+
+int countOf(const QByteArray& data, const QByteArray& what) {
+  int count = 0;
+  for (int pos = data.indexOf(what); pos != -1; pos = data.indexOf(what, pos + 1)) {
+    ++count;
+  }
+
+  return count;
+}
+
+/**
+ * \brief Checks that startxref leads to the table, that every entry of
+ *        the table points at its object and that the trailer agrees on
+ *        the object count.
+ *
+ * \return The number of objects, not counting the free entry 0,
+ *         or -1 if the file is inconsistent.
+ */
+int checkedObjectCount(const QByteArray& pdf) {
+  const int startxref_pos = pdf.lastIndexOf("startxref\n");
+  if (startxref_pos == -1) {
+    return -1;
+  }
+  const int number_pos = startxref_pos + 10;
+  const qint64 xref_pos = pdf.mid(number_pos, pdf.indexOf('\n', number_pos) - number_pos).toLongLong();
+  if (!pdf.mid(int(xref_pos)).startsWith("xref\n0 ")) {
+    return -1;
+  }
+
+  const int size_pos = int(xref_pos) + 7;
+  const int entries_pos = pdf.indexOf('\n', size_pos) + 1;
+  const int size = pdf.mid(size_pos, entries_pos - 1 - size_pos).toInt();
+  if ((size < 1) || (pdf.mid(entries_pos, 20) != "0000000000 65535 f \n")) {
+    return -1;
+  }
+
+  for (int id = 1; id < size; ++id) {
+    const QByteArray entry(pdf.mid(entries_pos + id * 20, 20));
+    if ((entry.size() != 20) || !entry.endsWith(" 00000 n \n")) {
+      return -1;
+    }
+    const int offset = entry.left(10).toInt();
+    if (!pdf.mid(offset).startsWith(QByteArray::number(id) + " 0 obj\n")) {
+      return -1;
+    }
+  }
+
+  if (!pdf.mid(entries_pos + size * 20).startsWith("trailer\n<< /Size " + QByteArray::number(size) + ' ')) {
+    return -1;
+  }
+  if (countOf(pdf, " 0 obj\n") != size - 1) {
+    return -1;
+  }
+
+  return size - 1;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_xref_points_at_every_object) {
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  PdfWriter writer(buffer);
+  BOOST_REQUIRE(writer.addPage(toPng(grayImage(40, 30))));
+  BOOST_REQUIRE(writer.addMaskedPage(toPng(grayImage(40, 30)), toPng(monoImage(40, 30))));
+  BOOST_REQUIRE(writer.finish());
+
+  // Catalog and page tree, plus an image, a content stream and a page object
+  // for the first page and one image more for the second.
+  BOOST_CHECK_EQUAL(checkedObjectCount(buffer.data()), 2 + 3 + 4);
+  BOOST_CHECK_EQUAL(countOf(buffer.data(), "/Type /Page "), 2);
+  BOOST_CHECK_EQUAL(countOf(buffer.data(), "/ImageMask true"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_document) {
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  PdfWriter writer(buffer);
+  BOOST_REQUIRE(writer.finish());
+
+  BOOST_CHECK_EQUAL(checkedObjectCount(buffer.data()), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_striped_tiff_makes_one_image) {
+  QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QByteArray tiff(stripedTiff(dir.filePath("striped.tif"), 40, 100));
+  BOOST_REQUIRE(!tiff.isEmpty());
+
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  PdfWriter writer(buffer);
+  BOOST_REQUIRE(writer.addPage(tiff));
+  BOOST_REQUIRE(writer.finish());
+
+  BOOST_CHECK_EQUAL(checkedObjectCount(buffer.data()), 2 + 3);
+  BOOST_CHECK_EQUAL(countOf(buffer.data(), "/Subtype /Image"), 1);
+  BOOST_CHECK_EQUAL(countOf(buffer.data(), "/Width 40 /Height 100"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_g4_output_is_passed_through) {
+  // Large enough for libtiff to split it into several strips by default.
+  const QByteArray tiff(g4Tiff(monoImage(2000, 1500)));
+  BOOST_REQUIRE(!tiff.isEmpty());
+
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  PdfWriter writer(buffer);
+  BOOST_REQUIRE(writer.addPage(tiff));
+  BOOST_REQUIRE(writer.finish());
+
+  BOOST_CHECK_EQUAL(checkedObjectCount(buffer.data()), 2 + 3);
+  BOOST_CHECK_EQUAL(countOf(buffer.data(), "/Filter /CCITTFaxDecode"), 1);
+  BOOST_CHECK_EQUAL(countOf(buffer.data(), "/FlateDecode"), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+}  // namespace Tests
@@ -0,0 +1,84 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QImage>
+#include <boost/test/auto_unit_test.hpp>
+#include "ThumbnailCodec.h"
+
+namespace Tests {
+BOOST_AUTO_TEST_SUITE(ThumbnailCodecTestSuite);
+
+namespace {
+/**
+ * Mixes runs, small and large steps, so that every QOI op gets used.
+ */
+QRgb pixelAt(const int x, const int y, const bool with_alpha) {
+  const int alpha = with_alpha ? ((x / 4) * 37) & 0xff : 255;
+  if (x < 8) {
+    return qRgba(200, 100, 50, alpha);
+  }
+
+  return qRgba((x * 3) & 0xff, (x + y) & 0xff, (y * 29 + x * x) & 0xff, alpha);
+}
+
+QImage makeImage(const int width, const int height, const QImage::Format format) {
+  QImage image(width, height, format);
+  const bool with_alpha = image.hasAlphaChannel();
+  for (int y = 0; y < height; ++y) {
+    auto* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+    for (int x = 0; x < width; ++x) {
+      line[x] = pixelAt(x, y, with_alpha);
+    }
+  }
+
+  return image;
+}
+
+bool roundTrips(const QImage& image) {
+  const QByteArray data(ThumbnailCodec::encode(image, ThumbnailCodec::QOI));
+  if (!data.startsWith("STQI")) {
+    return false;
+  }
+
+  const QImage decoded(ThumbnailCodec::decode(data));
+
+  return (decoded.format() == image.format()) && (decoded == image);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_opaque_image) {
+  BOOST_CHECK(roundTrips(makeImage(97, 61, QImage::Format_RGB32)));
+}
+
+BOOST_AUTO_TEST_CASE(test_image_with_alpha) {
+  BOOST_CHECK(roundTrips(makeImage(97, 61, QImage::Format_ARGB32)));
+}
+
+BOOST_AUTO_TEST_CASE(test_single_pixel_image) {
+  BOOST_CHECK(roundTrips(makeImage(1, 1, QImage::Format_RGB32)));
+  BOOST_CHECK(roundTrips(makeImage(1, 1, QImage::Format_ARGB32)));
+}
+
+BOOST_AUTO_TEST_CASE(test_corrupted_data) {
+  QByteArray data(ThumbnailCodec::encode(makeImage(20, 20, QImage::Format_RGB32), ThumbnailCodec::QOI));
+  data.truncate(data.size() / 2);
+  BOOST_CHECK(ThumbnailCodec::decode(data).isNull());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+}  // namespace Tests
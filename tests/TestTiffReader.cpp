@@ -0,0 +1,260 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tiff.h>
+#include <tiffio.h>
+#include <QFile>
+#include <QImage>
+#include <QRect>
+#include <QRgba64>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <boost/test/auto_unit_test.hpp>
+#include <vector>
+#include "TiffReader.h"
+
+namespace Tests {
+BOOST_AUTO_TEST_SUITE(TiffReaderTestSuite);
+
+namespace {
+const int WIDTH = 100;
+const int HEIGHT = 100;
+const int ROWS_PER_STRIP = 16;
+
+/**
+ * Varies along both axes, so that misplaced rows or columns show up.
+ */
+int sampleAt(const int x, const int y, const int bits_per_sample) {
+  return (x * 7 + y * 13) % (1 << bits_per_sample);
+}
+
+void setCommonFields(TIFF* tif, const int samples_per_pixel, const int bits_per_sample) {
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, uint32(WIDTH));
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, uint32(HEIGHT));
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, uint16(samples_per_pixel));
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, uint16(bits_per_sample));
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, uint16(PLANARCONFIG_CONTIG));
+  TIFFSetField(tif, TIFFTAG_COMPRESSION, uint16(COMPRESSION_LZW));
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, uint32(ROWS_PER_STRIP));
+}
+
+/**
+ * \brief Writes an LZW compressed grayscale image, with several rows per strip.
+ */
+bool writeGrayTiff(const QString& file_path, const int bits_per_sample) {
+  TIFF* tif = TIFFOpen(QFile::encodeName(file_path).constData(), "w");
+  if (!tif) {
+    return false;
+  }
+  setCommonFields(tif, 1, bits_per_sample);
+  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, uint16(PHOTOMETRIC_MINISBLACK));
+
+  bool ok = true;
+  std::vector<uint8> line(static_cast<size_t>(TIFFScanlineSize(tif)));
+  for (int y = 0; y < HEIGHT; ++y) {
+    std::fill(line.begin(), line.end(), 0);
+    for (int x = 0; x < WIDTH; ++x) {
+      const int sample = sampleAt(x, y, bits_per_sample);
+      for (int bit = 0; bit < bits_per_sample; ++bit) {
+        if (sample & (1 << (bits_per_sample - 1 - bit))) {
+          const int pos = x * bits_per_sample + bit;
+          line[pos >> 3] |= static_cast<uint8>(0x80 >> (pos & 7));
+        }
+      }
+    }
+    ok = ok && (TIFFWriteScanline(tif, line.data(), uint32(y), 0) >= 0);
+  }
+  TIFFClose(tif);
+
+  return ok;
+}
+
+/**
+ * \brief Writes an LZW compressed 8-bit RGB image, with several rows per strip.
+ */
+bool writeRgbTiff(const QString& file_path) {
+  TIFF* tif = TIFFOpen(QFile::encodeName(file_path).constData(), "w");
+  if (!tif) {
+    return false;
+  }
+  setCommonFields(tif, 3, 8);
+  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, uint16(PHOTOMETRIC_RGB));
+
+  bool ok = true;
+  std::vector<uint8> line(static_cast<size_t>(TIFFScanlineSize(tif)));
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      line[x * 3] = static_cast<uint8>(sampleAt(x, y, 8));
+      line[x * 3 + 1] = static_cast<uint8>(x);
+      line[x * 3 + 2] = static_cast<uint8>(y);
+    }
+    ok = ok && (TIFFWriteScanline(tif, line.data(), uint32(y), 0) >= 0);
+  }
+  TIFFClose(tif);
+
+  return ok;
+}
+
+/**
+ * \brief Writes an LZW compressed 16-bit grayscale or RGB image.
+ *
+ * Most samples are small enough for their most significant byte to be 0,
+ * so reducing them to 8 bits would show.
+ */
+bool writeDeepTiff(const QString& file_path, const int samples_per_pixel) {
+  TIFF* tif = TIFFOpen(QFile::encodeName(file_path).constData(), "w");
+  if (!tif) {
+    return false;
+  }
+  setCommonFields(tif, samples_per_pixel, 16);
+  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, uint16((samples_per_pixel == 1) ? PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_RGB));
+
+  bool ok = true;
+  std::vector<uint16> line(static_cast<size_t>(WIDTH * samples_per_pixel));
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      for (int c = 0; c < samples_per_pixel; ++c) {
+        line[x * samples_per_pixel + c] = static_cast<uint16>(sampleAt(x, y, 16) + c);
+      }
+    }
+    ok = ok && (TIFFWriteScanline(tif, line.data(), uint32(y), 0) >= 0);
+  }
+  TIFFClose(tif);
+
+  return ok;
+}
+
+QImage readImage(const QString& file_path, const QRect& roi) {
+  QFile file(file_path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QImage();
+  }
+
+  return TiffReader::readImage(file, 0, roi);
+}
+
+bool grayRoiMatches(const QImage& image, const QRect& roi, const int bits_per_sample) {
+  if (image.size() != roi.size()) {
+    return false;
+  }
+  for (int y = 0; y < roi.height(); ++y) {
+    for (int x = 0; x < roi.width(); ++x) {
+      if (image.pixelIndex(x, y) != sampleAt(roi.left() + x, roi.top() + y, bits_per_sample)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void checkGrayRois(const int bits_per_sample) {
+  const QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString file_path(dir.path() + QLatin1String("/gray.tif"));
+  BOOST_REQUIRE(writeGrayTiff(file_path, bits_per_sample));
+
+  // Both start in the middle of a strip.
+  const QRect full_width_roi(0, ROWS_PER_STRIP * 2 + 5, WIDTH, 30);
+  BOOST_CHECK(grayRoiMatches(readImage(file_path, full_width_roi), full_width_roi, bits_per_sample));
+
+  const QRect partial_roi(13, ROWS_PER_STRIP + 3, 50, 40);
+  BOOST_CHECK(grayRoiMatches(readImage(file_path, partial_roi), partial_roi, bits_per_sample));
+
+  const QRect whole_page(0, 0, WIDTH, HEIGHT);
+  BOOST_CHECK(grayRoiMatches(readImage(file_path, QRect()), whole_page, bits_per_sample));
+}
+bool rgbRoiMatches(const QImage& image, const QRect& roi) {
+  if (image.size() != roi.size()) {
+    return false;
+  }
+  for (int y = 0; y < roi.height(); ++y) {
+    for (int x = 0; x < roi.width(); ++x) {
+      const int src_x = roi.left() + x;
+      const int src_y = roi.top() + y;
+      if (image.pixel(x, y) != qRgb(sampleAt(src_x, src_y, 8), src_x, src_y)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_lzw_roi_bilevel) {
+  checkGrayRois(1);
+}
+
+BOOST_AUTO_TEST_CASE(test_lzw_roi_gray4) {
+  checkGrayRois(4);
+}
+
+BOOST_AUTO_TEST_CASE(test_lzw_roi_gray8) {
+  checkGrayRois(8);
+}
+
+BOOST_AUTO_TEST_CASE(test_lzw_roi_rgb) {
+  const QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString file_path(dir.path() + QLatin1String("/rgb.tif"));
+  BOOST_REQUIRE(writeRgbTiff(file_path));
+
+  const QRect roi(13, ROWS_PER_STRIP + 3, 50, 40);
+  BOOST_CHECK(rgbRoiMatches(readImage(file_path, roi), roi));
+
+  const QRect whole_page(0, 0, WIDTH, HEIGHT);
+  BOOST_CHECK(rgbRoiMatches(readImage(file_path, QRect()), whole_page));
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+BOOST_AUTO_TEST_CASE(test_16_bit_samples_are_kept) {
+  const QTemporaryDir dir;
+  BOOST_REQUIRE(dir.isValid());
+  const QString gray_path(dir.path() + QLatin1String("/gray16.tif"));
+  const QString rgb_path(dir.path() + QLatin1String("/rgb16.tif"));
+  BOOST_REQUIRE(writeDeepTiff(gray_path, 1));
+  BOOST_REQUIRE(writeDeepTiff(rgb_path, 3));
+
+  const QRect roi(13, ROWS_PER_STRIP + 3, 50, 40);
+  const QImage gray(readImage(gray_path, roi));
+  const QImage rgb(readImage(rgb_path, roi));
+  BOOST_REQUIRE(gray.format() == QImage::Format_Grayscale16);
+  BOOST_REQUIRE(rgb.format() == QImage::Format_RGBX64);
+  BOOST_REQUIRE(gray.size() == roi.size());
+  BOOST_REQUIRE(rgb.size() == roi.size());
+
+  bool gray_matches = true;
+  bool rgb_matches = true;
+  for (int y = 0; y < roi.height(); ++y) {
+    const auto* gray_line = reinterpret_cast<const uint16*>(gray.constScanLine(y));
+    const auto* rgb_line = reinterpret_cast<const QRgba64*>(rgb.constScanLine(y));
+    for (int x = 0; x < roi.width(); ++x) {
+      const int sample = sampleAt(roi.left() + x, roi.top() + y, 16);
+      gray_matches = gray_matches && (gray_line[x] == sample);
+      rgb_matches = rgb_matches && (rgb_line[x].red() == sample) && (rgb_line[x].green() == sample + 1)
+                    && (rgb_line[x].blue() == sample + 2) && (rgb_line[x].alpha() == 0xFFFF);
+    }
+  }
+  BOOST_CHECK(gray_matches);
+  BOOST_CHECK(rgb_matches);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END();
+}  // namespace Tests
@@ -0,0 +1,148 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <boost/test/auto_unit_test.hpp>
+#include "BackgroundTask.h"
+#include "WorkerThreadPool.h"
+
+namespace Tests {
+BOOST_AUTO_TEST_SUITE(WorkerThreadPoolTestSuite);
+
+namespace {
+class DummyResult : public FilterResult {
+ public:
+  void updateUI(FilterUiInterface*) override {}
+
+  intrusive_ptr<AbstractFilter> filter() override { return nullptr; }
+};
+
+/**
+ * A batch task that gets preempted while running on its first run.
+ */
+class SelfPreemptingTask : public BackgroundTask {
+ public:
+  explicit SelfPreemptingTask(bool complete_when_preempted)
+      : BackgroundTask(BATCH), m_completeWhenPreempted(complete_when_preempted) {}
+
+  FilterResultPtr operator()() override {
+    if (m_numRuns.fetchAndAddOrdered(1) == 0) {
+      preempt();
+      if (!m_completeWhenPreempted) {
+        try {
+          throwIfCancelled();
+        } catch (const CancelledException&) {
+          return nullptr;
+        }
+      }
+    }
+
+    return make_intrusive<DummyResult>();
+  }
+
+  int numRuns() const { return m_numRuns.load(); }
+
+ private:
+  const bool m_completeWhenPreempted;
+  QAtomicInt m_numRuns;
+};
+
+class ResultCollector {
+ public:
+  explicit ResultCollector(WorkerThreadPool& pool) {
+    QObject::connect(&pool, &WorkerThreadPool::taskResult,
+                     [this](const BackgroundTaskPtr& task, const FilterResultPtr&) {
+                       ++numResults;
+                       if (task->isCancelled()) {
+                         ++numCancelledResults;
+                       }
+                     });
+  }
+
+  int numResults = 0;
+  int numCancelledResults = 0;
+};
+
+void runToCompletion(WorkerThreadPool& pool, const BackgroundTaskPtr& task) {
+  pool.submitTask(task);
+  pool.shutdown();
+  QCoreApplication::sendPostedEvents(&pool);
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(test_preempted_task_that_completes) {
+  int argc = 1;
+  char arg0[] = "generic_tests";
+  char* argv[] = {arg0};
+  const QCoreApplication app(argc, argv);
+
+  WorkerThreadPool pool;
+  const ResultCollector collector(pool);
+  const intrusive_ptr<SelfPreemptingTask> task(make_intrusive<SelfPreemptingTask>(true));
+  runToCompletion(pool, task);
+
+  // The result is delivered as a regular one, and the task is not run again.
+  BOOST_CHECK_EQUAL(task->numRuns(), 1);
+  BOOST_CHECK_EQUAL(collector.numResults, 1);
+  BOOST_CHECK_EQUAL(collector.numCancelledResults, 0);
+  BOOST_CHECK(!task->isCancelled());
+  BOOST_CHECK(!task->isPreempted());
+  BOOST_CHECK(pool.hasSpareCapacity());
+}
+
+BOOST_AUTO_TEST_CASE(test_preempted_task_is_restarted) {
+  int argc = 1;
+  char arg0[] = "generic_tests";
+  char* argv[] = {arg0};
+  const QCoreApplication app(argc, argv);
+
+  WorkerThreadPool pool;
+  const ResultCollector collector(pool);
+  const intrusive_ptr<SelfPreemptingTask> task(make_intrusive<SelfPreemptingTask>(false));
+  runToCompletion(pool, task);
+
+  BOOST_CHECK_EQUAL(task->numRuns(), 2);
+  BOOST_CHECK_EQUAL(collector.numResults, 1);
+  BOOST_CHECK_EQUAL(collector.numCancelledResults, 0);
+  BOOST_CHECK(!task->isPreempted());
+  // Which keeps the pool from preempting it again.
+  BOOST_CHECK(task->wasPreempted());
+}
+
+BOOST_AUTO_TEST_CASE(test_preemption_and_cancellation_flags) {
+  const intrusive_ptr<SelfPreemptingTask> task(make_intrusive<SelfPreemptingTask>(true));
+  BOOST_CHECK(!task->wasPreempted());
+  task->preempt();
+  BOOST_CHECK(!task->isCancelled());
+  BOOST_CHECK(task->isPreempted());
+  BOOST_CHECK(task->isCancelledOrPreempted());
+
+  task->clearPreemption();
+  BOOST_CHECK(!task->isPreempted());
+  BOOST_CHECK(task->wasPreempted());
+
+  task->preempt();
+  task->cancel();
+  BOOST_CHECK(task->isCancelled());
+  BOOST_CHECK(!task->isPreempted());
+  BOOST_CHECK_THROW(task->throwIfCancelled(), BackgroundTask::CancelledException);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+}  // namespace Tests